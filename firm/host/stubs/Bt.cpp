@@ -0,0 +1,615 @@
+// Bluedroid GATT server and GAP with a simulated central on every connection.
+//
+// Calls that the stack hands to its BTC task on the device are queued to a BTC_TASK task here
+// too, through a queue of the same length, so callbacks run on that task and a notification
+// fails when the queue is full. A notification handed to a link waits in the L2CAP buffers of
+// the link until the radio sends it in a connection event; a link with all buffers in use
+// reports congestion and refuses further notifications, like the device stack.
+#include "esp_gatts_api.h"
+#include "esp_gap_ble_api.h"
+#include "esp_gatt_common_api.h"
+#include "esp_bt_main.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "Host.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr esp_gatt_if_t GATTS_IF        = 3;
+    constexpr uint16_t      HANDLE_BASE     = 40;
+    constexpr size_t        BTC_QUEUE_LEN   = 60; ///< Length of the BTC task queue of Bluedroid.
+    constexpr size_t        LINK_BUFFERS    = 10; ///< L2CAP buffers of a link before it congests.
+    constexpr uint16_t      DEFAULT_MTU     = 23;
+    constexpr uint16_t      DEFAULT_TX_LEN  = 27;
+    constexpr uint32_t      IFS_US          = 150; ///< Inter frame space.
+    constexpr uint32_t      EMPTY_PDU_US    = 80;  ///< Empty acknowledgement packet of the central.
+    constexpr uint32_t      PDU_OVERHEAD    = 14;  ///< Preamble, access address, header and CRC bytes.
+    constexpr uint32_t      L2CAP_ATT_BYTES = 7;   ///< L2CAP header and ATT notification header bytes.
+
+    struct Packet
+    {
+        uint16_t    handle;
+        bool        confirm;
+        std::string value;
+    };
+
+    struct Link
+    {
+        esp_bd_addr_t      bda;
+        uint16_t           interval;
+        uint16_t           latency;
+        uint16_t           timeout;
+        uint16_t           tx_len;
+        uint16_t           mtu;
+        size_t             queued; ///< Notifications in the BTC queue for this link.
+        std::deque<Packet> buffers;
+        bool               congested;
+        Clock::time_point  nextEvent;
+        Host::BleLinkStats stats;
+    };
+
+    struct Inbox
+    {
+        std::deque<std::string> values;
+    };
+
+    // Allocated once and never freed: the BTC task and the radio thread still use them while the process exits.
+    std::mutex                        &mutex     = *new std::mutex; ///< Protects the links, inboxes and settings.
+    std::condition_variable           &radioCv   = *new std::condition_variable;
+    std::condition_variable           &inboxCv   = *new std::condition_variable;
+    std::map<uint16_t, Link>          &links     = *new std::map<uint16_t, Link>;
+    std::map<uint16_t, Inbox>         &inboxes   = *new std::map<uint16_t, Inbox>;
+    std::vector<uint16_t>             &attrUuids = *new std::vector<uint16_t>;
+    std::vector<uint16_t>             &handles   = *new std::vector<uint16_t>;
+    std::mutex                        &btcMutex  = *new std::mutex;
+    std::condition_variable           &btcCv     = *new std::condition_variable;
+    std::deque<std::function<void()>> &btcQueue  = *new std::deque<std::function<void()>>;
+
+    Host::BleCentral central       = {0x06, 0x0C80, 251, 247};
+    uint16_t         localMtu      = DEFAULT_MTU;
+    bool             advertising   = false;
+    bool             radioRunning  = false;
+    bool             btcRunning    = false;
+    esp_gatts_cb_t   gattsCallback = nullptr;
+    esp_gap_ble_cb_t gapCallback   = nullptr;
+
+    void btcTask(void *)
+    {
+        while (true)
+        {
+            std::function<void()> work;
+            {
+                std::unique_lock<std::mutex> lock(btcMutex);
+                btcCv.wait(lock, [] { return !btcQueue.empty(); });
+                work = std::move(btcQueue.front());
+                btcQueue.pop_front();
+            }
+            btcCv.notify_all();
+            work();
+        }
+    }
+
+    /**
+     * @brief Queues work for the BTC task.
+     * @param work Work to run.
+     * @param bounded `true` for calls of the application, which fail on a full queue; events of
+     *                the controller always get through.
+     * @return `false` if the queue was full.
+     */
+    bool post(std::function<void()> work, bool bounded)
+    {
+        {
+            std::lock_guard<std::mutex> guard(btcMutex);
+            if (bounded && btcQueue.size() >= BTC_QUEUE_LEN)
+            {
+                return false;
+            }
+            btcQueue.push_back(std::move(work));
+        }
+        btcCv.notify_all();
+        return true;
+    }
+
+    void gatts(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t &param)
+    {
+        if (gattsCallback != nullptr)
+        {
+            gattsCallback(event, GATTS_IF, &param);
+        }
+    }
+
+    void gap(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t &param)
+    {
+        if (gapCallback != nullptr)
+        {
+            gapCallback(event, &param);
+        }
+    }
+
+    Link *findLink(const uint8_t *bda, uint16_t *conn_id)
+    {
+        for (auto &entry : links)
+        {
+            if (memcmp(entry.second.bda, bda, sizeof(esp_bd_addr_t)) == 0)
+            {
+                *conn_id = entry.first;
+                return &entry.second;
+            }
+        }
+        return nullptr;
+    }
+
+    uint32_t airTimeUs(size_t len, uint16_t tx_len)
+    {
+        // The notification is fragmented into link layer packets of at most tx_len bytes.
+        size_t   bytes   = len + L2CAP_ATT_BYTES;
+        uint32_t air     = 0;
+        size_t   packets = (bytes + tx_len - 1) / tx_len;
+        air += (bytes + packets * PDU_OVERHEAD) * 8;
+        air += packets * (2 * IFS_US + EMPTY_PDU_US);
+        return air;
+    }
+
+    // Sends what fits in one connection event of a link. Called with `mutex` held.
+    void connectionEvent(uint16_t conn_id, Link &link, size_t active)
+    {
+        uint32_t budget = link.interval * 1250 / std::max<size_t>(active, 1);
+        uint32_t used   = 0;
+        while (!link.buffers.empty())
+        {
+            Packet  &packet = link.buffers.front();
+            uint32_t air    = airTimeUs(packet.value.size(), link.tx_len);
+            if (used > 0 && used + air > budget)
+            {
+                break;
+            }
+            used += air;
+            inboxes[conn_id].values.push_back(packet.value);
+            link.stats.delivered++;
+            if (packet.confirm)
+            {
+                uint16_t handle = packet.handle;
+                post(
+                    [conn_id, handle]
+                    {
+                        esp_ble_gatts_cb_param_t param = {};
+                        param.conf.status              = ESP_GATT_OK;
+                        param.conf.conn_id             = conn_id;
+                        param.conf.handle              = handle;
+                        gatts(ESP_GATTS_CONF_EVT, param);
+                    },
+                    false);
+            }
+            link.buffers.pop_front();
+        }
+        if (link.congested && link.buffers.size() <= LINK_BUFFERS / 2)
+        {
+            link.congested = false;
+            post(
+                [conn_id]
+                {
+                    esp_ble_gatts_cb_param_t param = {};
+                    param.congest.conn_id          = conn_id;
+                    param.congest.congested        = false;
+                    gatts(ESP_GATTS_CONGEST_EVT, param);
+                },
+                false);
+        }
+        inboxCv.notify_all();
+    }
+
+    void radio()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            Clock::time_point now  = Clock::now();
+            Clock::time_point wake = now + std::chrono::milliseconds(100);
+            for (auto &entry : links)
+            {
+                Link &link = entry.second;
+                if (link.nextEvent <= now)
+                {
+                    connectionEvent(entry.first, link, links.size());
+                    link.nextEvent += std::chrono::microseconds(link.interval * 1250);
+                    if (link.nextEvent < now)
+                    {
+                        link.nextEvent = now + std::chrono::microseconds(link.interval * 1250);
+                    }
+                }
+                wake = std::min(wake, link.nextEvent);
+            }
+            radioCv.wait_until(lock, wake);
+        }
+    }
+}
+
+esp_err_t esp_bluedroid_init(void)
+{
+    std::lock_guard<std::mutex> guard(btcMutex);
+    if (!btcRunning)
+    {
+        btcRunning = true;
+        xTaskCreatePinnedToCore(btcTask, "BTC_TASK", CONFIG_BT_BTC_TASK_STACK_SIZE, nullptr, configMAX_PRIORITIES - 6, nullptr,
+                                CONFIG_BT_BLUEDROID_PINNED_TO_CORE);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_bluedroid_enable(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t callback)
+{
+    gattsCallback = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id)
+{
+    bool queued = post(
+        [app_id]
+        {
+            esp_ble_gatts_cb_param_t param = {};
+            param.reg.status               = ESP_GATT_OK;
+            param.reg.app_id               = app_id;
+            gatts(ESP_GATTS_REG_EVT, param);
+        },
+        true);
+    return queued ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gatts_create_attr_tab(const esp_gatts_attr_db_t *gatts_attr_db, esp_gatt_if_t, uint16_t max_nb_attr, uint8_t srvc_inst_id)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        attrUuids.clear();
+        handles.clear();
+        for (uint16_t i = 0; i < max_nb_attr; ++i)
+        {
+            const esp_attr_desc_t &desc = gatts_attr_db[i].att_desc;
+            attrUuids.push_back(desc.uuid_length == ESP_UUID_LEN_16 ? desc.uuid_p[0] | (desc.uuid_p[1] << 8) : 0);
+            handles.push_back(HANDLE_BASE + i);
+        }
+    }
+    bool queued = post(
+        [max_nb_attr, srvc_inst_id]
+        {
+            esp_ble_gatts_cb_param_t param = {};
+            param.add_attr_tab.status      = ESP_GATT_OK;
+            param.add_attr_tab.svc_inst_id = srvc_inst_id;
+            param.add_attr_tab.num_handle  = max_nb_attr;
+            param.add_attr_tab.handles     = handles.data();
+            gatts(ESP_GATTS_CREAT_ATTR_TAB_EVT, param);
+        },
+        true);
+    return queued ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gatts_start_service(uint16_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle, uint16_t value_len, uint8_t *value,
+                                      bool need_confirm)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    auto                        it = links.find(conn_id);
+    if (gatts_if != GATTS_IF || it == links.end())
+    {
+        return ESP_FAIL;
+    }
+    Link &link = it->second;
+    if (link.queued + link.buffers.size() >= LINK_BUFFERS)
+    {
+        // No L2CAP buffer left for the link.
+        link.stats.refused++;
+        return ESP_FAIL;
+    }
+    if (value_len > link.mtu - 3)
+    {
+        link.stats.oversized++;
+        value_len = link.mtu - 3;
+    }
+    Packet packet = {attr_handle, need_confirm, std::string(reinterpret_cast<const char *>(value), value_len)};
+    bool   queued = post(
+        [conn_id, packet]
+        {
+            bool congested = false;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                auto                        it = links.find(conn_id);
+                if (it == links.end())
+                {
+                    return;
+                }
+                Link &link = it->second;
+                link.queued--;
+                link.buffers.push_back(packet);
+                if (link.buffers.size() >= LINK_BUFFERS && !link.congested)
+                {
+                    link.congested = true;
+                    link.stats.congestions++;
+                    congested = true;
+                }
+            }
+            if (congested)
+            {
+                esp_ble_gatts_cb_param_t param = {};
+                param.congest.conn_id          = conn_id;
+                param.congest.congested        = true;
+                gatts(ESP_GATTS_CONGEST_EVT, param);
+            }
+        },
+        true);
+    if (!queued)
+    {
+        link.stats.refused++;
+        return ESP_FAIL;
+    }
+    link.queued++;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    localMtu = mtu;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback)
+{
+    gapCallback = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_device_name(const char *)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t *, uint32_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    advertising = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    uint16_t                    conn_id = 0;
+    Link                       *link    = findLink(params->bda, &conn_id);
+    if (link == nullptr)
+    {
+        return ESP_FAIL;
+    }
+
+    // The central picks the shortest interval both sides accept, or keeps the current settings.
+    esp_ble_gap_cb_param_t param = {};
+    memcpy(param.update_conn_params.bda, params->bda, sizeof(esp_bd_addr_t));
+    param.update_conn_params.min_int = params->min_int;
+    param.update_conn_params.max_int = params->max_int;
+    if (params->min_int <= central.max_int && params->max_int >= central.min_int && params->min_int <= params->max_int)
+    {
+        link->interval = std::max(params->min_int, central.min_int);
+        link->latency  = params->latency;
+        link->timeout  = params->timeout;
+        param.update_conn_params.status = ESP_BT_STATUS_SUCCESS;
+    }
+    else
+    {
+        param.update_conn_params.status = ESP_BT_STATUS_FAIL;
+    }
+    param.update_conn_params.conn_int = link->interval;
+    param.update_conn_params.latency  = link->latency;
+    param.update_conn_params.timeout  = link->timeout;
+    return post([param]() mutable { gap(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, param); }, true) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    uint16_t                    conn_id = 0;
+    Link                       *link    = findLink(remote_device, &conn_id);
+    if (link == nullptr)
+    {
+        return ESP_FAIL;
+    }
+    link->tx_len = std::max(DEFAULT_TX_LEN, std::min(tx_data_length, central.max_tx_len));
+
+    esp_ble_gap_cb_param_t param = {};
+    param.pkt_data_length_cmpl.status        = ESP_BT_STATUS_SUCCESS;
+    param.pkt_data_length_cmpl.params.tx_len = link->tx_len;
+    param.pkt_data_length_cmpl.params.rx_len = link->tx_len;
+    memcpy(param.pkt_data_length_cmpl.remote_bd_addr, remote_device, sizeof(esp_bd_addr_t));
+    return post([param]() mutable { gap(ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, param); }, true) ? ESP_OK : ESP_FAIL;
+}
+
+void Host::BleSetCentral(const BleCentral &settings)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    central = settings;
+}
+
+bool Host::BleAdvertising()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return advertising;
+}
+
+bool Host::BleConnect(uint16_t conn_id, const uint8_t *bda, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (links.size() >= CONFIG_BT_ACL_CONNECTIONS || links.count(conn_id) != 0)
+        {
+            return false;
+        }
+        Link link      = {};
+        link.interval  = interval;
+        link.latency   = latency;
+        link.timeout   = timeout;
+        link.tx_len    = DEFAULT_TX_LEN;
+        link.mtu       = DEFAULT_MTU;
+        link.nextEvent = Clock::now();
+        memcpy(link.bda, bda, sizeof(esp_bd_addr_t));
+        links[conn_id] = link;
+        inboxes[conn_id].values.clear();
+        advertising = false;
+        if (!radioRunning)
+        {
+            radioRunning = true;
+            std::thread(radio).detach();
+        }
+    }
+    radioCv.notify_all();
+
+    esp_ble_gatts_cb_param_t param = {};
+    param.connect.conn_id          = conn_id;
+    param.connect.link_role        = 1;
+    memcpy(param.connect.remote_bda, bda, sizeof(esp_bd_addr_t));
+    param.connect.conn_params.interval = interval;
+    param.connect.conn_params.latency  = latency;
+    param.connect.conn_params.timeout  = timeout;
+    post([param]() mutable { gatts(ESP_GATTS_CONNECT_EVT, param); }, false);
+    return true;
+}
+
+void Host::BleDisconnect(uint16_t conn_id)
+{
+    esp_ble_gatts_cb_param_t param = {};
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto                        it = links.find(conn_id);
+        if (it == links.end())
+        {
+            return;
+        }
+        memcpy(param.disconnect.remote_bda, it->second.bda, sizeof(esp_bd_addr_t));
+        links.erase(it);
+    }
+    param.disconnect.conn_id = conn_id;
+    param.disconnect.reason  = 0x13; // Remote user terminated the connection.
+    post([param]() mutable { gatts(ESP_GATTS_DISCONNECT_EVT, param); }, false);
+}
+
+void Host::BleExchangeMtu(uint16_t conn_id)
+{
+    esp_ble_gatts_cb_param_t param = {};
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto                        it = links.find(conn_id);
+        if (it == links.end())
+        {
+            return;
+        }
+        it->second.mtu = std::min(central.mtu, localMtu);
+        param.mtu.mtu  = it->second.mtu;
+    }
+    param.mtu.conn_id = conn_id;
+    post([param]() mutable { gatts(ESP_GATTS_MTU_EVT, param); }, false);
+}
+
+uint16_t Host::BleHandle(uint16_t uuid, bool cccd)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    for (size_t i = 1; i < attrUuids.size(); ++i)
+    {
+        if (attrUuids[i] != uuid || attrUuids[i - 1] != ESP_GATT_UUID_CHAR_DECLARE)
+        {
+            continue;
+        }
+        if (!cccd)
+        {
+            return handles[i];
+        }
+        return (i + 1 < attrUuids.size() && attrUuids[i + 1] == ESP_GATT_UUID_CHAR_CLIENT_CONFIG) ? handles[i + 1] : 0;
+    }
+    return 0;
+}
+
+void Host::BleWrite(uint16_t conn_id, uint16_t handle, const void *data, size_t len)
+{
+    esp_bd_addr_t bda = {};
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto                        it = links.find(conn_id);
+        if (it == links.end())
+        {
+            return;
+        }
+        memcpy(bda, it->second.bda, sizeof(bda));
+    }
+    std::string value(static_cast<const char *>(data), len);
+    post(
+        [conn_id, handle, value, bda]() mutable
+        {
+            esp_ble_gatts_cb_param_t param = {};
+            param.write.conn_id            = conn_id;
+            param.write.handle             = handle;
+            param.write.len                = value.size();
+            param.write.value              = reinterpret_cast<uint8_t *>(value.data());
+            memcpy(param.write.bda, bda, sizeof(bda));
+            gatts(ESP_GATTS_WRITE_EVT, param);
+        },
+        false);
+}
+
+bool Host::BleReceive(uint16_t conn_id, std::string &value, uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    Inbox                       &inbox = inboxes[conn_id];
+    if (!inboxCv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return !inbox.values.empty(); }))
+    {
+        return false;
+    }
+    value = std::move(inbox.values.front());
+    inbox.values.pop_front();
+    return true;
+}
+
+void Host::BleSync()
+{
+    std::mutex              doneMutex;
+    std::condition_variable doneCv;
+    bool                    done = false;
+    post(
+        [&]
+        {
+            std::lock_guard<std::mutex> guard(doneMutex);
+            done = true;
+            doneCv.notify_all();
+        },
+        false);
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCv.wait(lock, [&] { return done; });
+}
+
+Host::BleLinkStats Host::BleStats(uint16_t conn_id)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    auto                        it = links.find(conn_id);
+    return it != links.end() ? it->second.stats : BleLinkStats{};
+}
@@ -0,0 +1,392 @@
+// Flash partitions from the partition table, and the SPIFFS mount point on a host directory.
+#include "esp_partition.h"
+#include "esp_spiffs.h"
+#include "Host.hpp"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr size_t SECTOR_SIZE  = 4096;
+    constexpr char   SPIFFS_DIR[] = "spiffs";
+
+    struct Partition
+    {
+        esp_partition_t      info;
+        std::vector<uint8_t> data;
+        uint32_t             erases;
+    };
+
+    std::mutex              lock;
+    std::vector<Partition> *table       = nullptr;
+    size_t                  powerBudget = SIZE_MAX;
+    std::string             mountPoint;
+    bool                    failMount = false;
+    bool                    failOpen  = false;
+
+    size_t parseSize(const std::string &text)
+    {
+        char  *end   = nullptr;
+        size_t value = strtoul(text.c_str(), &end, 0);
+        if (*end == 'K' || *end == 'k')
+        {
+            value *= 1024;
+        }
+        else if (*end == 'M' || *end == 'm')
+        {
+            value *= 1024 * 1024;
+        }
+        return value;
+    }
+
+    std::string trim(const std::string &text)
+    {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        size_t last  = text.find_last_not_of(" \t\r\n");
+        return first == std::string::npos ? "" : text.substr(first, last - first + 1);
+    }
+
+    // Loads the data partitions of the firmware partition table, see HOST_PARTITION_TABLE.
+    std::vector<Partition> &partitions()
+    {
+        if (table != nullptr)
+        {
+            return *table;
+        }
+        table   = new std::vector<Partition>;
+        FILE *f = fopen(HOST_PARTITION_TABLE, "r");
+        if (f == nullptr)
+        {
+            fprintf(stderr, "cannot open partition table %s\n", HOST_PARTITION_TABLE);
+            abort();
+        }
+        char     line[256];
+        uint32_t address = 0x9000;
+        while (fgets(line, sizeof(line), f) != nullptr)
+        {
+            std::vector<std::string> fields;
+            std::string              text = line;
+            if (trim(text).empty() || trim(text)[0] == '#')
+            {
+                continue;
+            }
+            size_t start = 0;
+            for (size_t pos = text.find(','); pos != std::string::npos; start = pos + 1, pos = text.find(',', start))
+            {
+                fields.push_back(trim(text.substr(start, pos - start)));
+            }
+            fields.push_back(trim(text.substr(start)));
+            if (fields.size() < 5)
+            {
+                continue;
+            }
+
+            size_t size = parseSize(fields[4]);
+            if (!fields[3].empty())
+            {
+                address = parseSize(fields[3]);
+            }
+            if (fields[1] == "data")
+            {
+                Partition partition = {};
+                partition.info.type = ESP_PARTITION_TYPE_DATA;
+                partition.info.subtype =
+                    (fields[2] == "nvs") ? ESP_PARTITION_SUBTYPE_DATA_NVS : static_cast<esp_partition_subtype_t>(parseSize(fields[2]));
+                partition.info.address    = address;
+                partition.info.size       = size;
+                partition.info.erase_size = SECTOR_SIZE;
+                strncpy(partition.info.label, fields[0].c_str(), sizeof(partition.info.label) - 1);
+                partition.data.assign(size, 0xFF);
+                table->push_back(std::move(partition));
+            }
+            address += size;
+        }
+        fclose(f);
+        return *table;
+    }
+
+    Partition *find(const char *label)
+    {
+        for (Partition &partition : partitions())
+        {
+            if (strcmp(partition.info.label, label) == 0)
+            {
+                return &partition;
+            }
+        }
+        return nullptr;
+    }
+
+    Partition *find(const esp_partition_t *info)
+    {
+        for (Partition &partition : partitions())
+        {
+            if (&partition.info == info)
+            {
+                return &partition;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string hostPath(const char *path)
+    {
+        return std::string(SPIFFS_DIR) + (path + mountPoint.size());
+    }
+
+    bool onMount(const char *path)
+    {
+        return !mountPoint.empty() && strncmp(path, mountPoint.c_str(), mountPoint.size()) == 0 && path[mountPoint.size()] == '/';
+    }
+}
+
+extern "C"
+{
+    FILE *__real_fopen(const char *path, const char *mode);
+    int   __real_remove(const char *path);
+    int   __real_rename(const char *from, const char *to);
+
+    // Linked with --wrap, so the firmware sources keep their device paths.
+    FILE *__wrap_fopen(const char *path, const char *mode)
+    {
+        if (!onMount(path))
+        {
+            return __real_fopen(path, mode);
+        }
+        if (failOpen)
+        {
+            errno = EIO;
+            return nullptr;
+        }
+        return __real_fopen(hostPath(path).c_str(), mode);
+    }
+
+    int __wrap_remove(const char *path)
+    {
+        return onMount(path) ? __real_remove(hostPath(path).c_str()) : __real_remove(path);
+    }
+
+    int __wrap_rename(const char *from, const char *to)
+    {
+        if (onMount(from) != onMount(to))
+        {
+            errno = EXDEV;
+            return -1;
+        }
+        return onMount(from) ? __real_rename(hostPath(from).c_str(), hostPath(to).c_str()) : __real_rename(from, to);
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (Partition &partition : partitions())
+    {
+        if (partition.info.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || partition.info.subtype == subtype) &&
+            (label == nullptr || strcmp(partition.info.label, label) == 0))
+        {
+            return &partition.info;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *info, size_t offset, void *dst, size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(info);
+    if (partition == nullptr || offset + size > info->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, partition->data.data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *info, size_t offset, const void *src, size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(info);
+    if (partition == nullptr || offset + size > info->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t         written = std::min(size, powerBudget);
+    const uint8_t *bytes   = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < written; i++)
+    {
+        partition->data[offset + i] &= bytes[i];
+    }
+    if (powerBudget != SIZE_MAX)
+    {
+        powerBudget -= written;
+    }
+    return written == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *info, size_t offset, size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(info);
+    if (partition == nullptr || offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0 || offset + size > info->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (powerBudget == 0)
+    {
+        return ESP_FAIL;
+    }
+    memset(partition->data.data() + offset, 0xFF, size);
+    partition->erases += size / SECTOR_SIZE;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *info, size_t offset, size_t size, esp_partition_mmap_memory_t,
+                             const void **out_ptr, esp_partition_mmap_handle_t *out_handle)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(info);
+    if (partition == nullptr || offset + size > info->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Writes show through the mapping at once, like a mapping of flash after a cache flush.
+    *out_ptr    = partition->data.data() + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t)
+{
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (failMount || conf == nullptr || conf->base_path == nullptr)
+    {
+        return ESP_FAIL;
+    }
+    if (mkdir(SPIFFS_DIR, 0755) != 0 && errno != EEXIST)
+    {
+        return ESP_FAIL;
+    }
+    mountPoint = conf->base_path;
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(partition_label != nullptr ? partition_label : "spiffs");
+    if (partition == nullptr || mountPoint.empty())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *total_bytes = partition->info.size;
+    *used_bytes  = 0;
+    if (DIR *dir = opendir(SPIFFS_DIR))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            struct stat st;
+            std::string path = std::string(SPIFFS_DIR) + "/" + entry->d_name;
+            if (entry->d_name[0] != '.' && stat(path.c_str(), &st) == 0)
+            {
+                *used_bytes += st.st_size;
+            }
+        }
+        closedir(dir);
+    }
+    return ESP_OK;
+}
+
+void HostNvsReset();
+
+void Host::ResetStorage()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (Partition &partition : partitions())
+        {
+            std::fill(partition.data.begin(), partition.data.end(), 0xFF);
+            partition.erases = 0;
+        }
+        powerBudget = SIZE_MAX;
+        failMount   = false;
+        failOpen    = false;
+        if (DIR *dir = opendir(SPIFFS_DIR))
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                if (entry->d_name[0] != '.')
+                {
+                    __real_remove((std::string(SPIFFS_DIR) + "/" + entry->d_name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+    }
+    HostNvsReset();
+}
+
+void Host::ResizePartition(const char *label, size_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(label);
+    if (partition != nullptr && size % SECTOR_SIZE == 0)
+    {
+        partition->info.size = size;
+        partition->data.assign(size, 0xFF);
+    }
+}
+
+uint8_t *Host::PartitionData(const char *label, size_t *size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(label);
+    if (partition == nullptr)
+    {
+        return nullptr;
+    }
+    *size = partition->info.size;
+    return partition->data.data();
+}
+
+uint32_t Host::SectorErases(const char *label)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Partition                  *partition = find(label);
+    return partition != nullptr ? partition->erases : 0;
+}
+
+void Host::CutPowerAfter(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    powerBudget = bytes;
+}
+
+void Host::RestorePower()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    powerBudget = SIZE_MAX;
+}
+
+void Host::FailMount(bool fail)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    failMount = fail;
+}
+
+void Host::FailFileOpen(bool fail)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    failOpen = fail;
+}
@@ -0,0 +1,616 @@
+// FreeRTOS kernel objects, esp_timer and heap statistics on top of the C++ thread library.
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "Host.hpp"
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const Clock::time_point bootTime = Clock::now();
+    std::atomic<int64_t>    uptimeOffset{0}; ///< Added to `esp_timer_get_time`, see `Host::SetUptime`.
+
+    /**
+     * @brief Waits on a condition variable for a FreeRTOS tick timeout.
+     * @return The predicate value when the wait ended.
+     */
+    template <class Predicate>
+    bool waitTicks(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate predicate)
+    {
+        if (ticks == portMAX_DELAY)
+        {
+            cv.wait(lock, predicate);
+            return true;
+        }
+        return cv.wait_for(lock, std::chrono::milliseconds(pdTICKS_TO_MS(ticks)), predicate);
+    }
+
+    std::recursive_mutex &criticalLock()
+    {
+        static std::recursive_mutex *lock = new std::recursive_mutex;
+        return *lock;
+    }
+}
+
+/* Objects are allocated once and never freed: threads may still block on them while the process exits. */
+
+struct tskTaskControlBlock
+{
+    std::string             name;
+    BaseType_t              core;
+    UBaseType_t             priority;
+    uint32_t                stackDepth;
+    std::mutex              mutex;
+    std::condition_variable cv;
+    uint32_t                notifications = 0;
+};
+
+struct QueueDefinition
+{
+    enum Kind
+    {
+        QUEUE,
+        MUTEX,
+        COUNTING,
+    };
+
+    Kind                             kind;
+    UBaseType_t                      length;
+    UBaseType_t                      itemSize;
+    UBaseType_t                      count = 0; ///< Items or semaphore count.
+    std::deque<std::vector<uint8_t>> items;
+    std::mutex                       mutex;
+    std::condition_variable          cv;
+};
+
+struct EventGroupDef_t
+{
+    EventBits_t             bits = 0;
+    std::mutex              mutex;
+    std::condition_variable cv;
+};
+
+namespace
+{
+    std::mutex &registryLock()
+    {
+        static std::mutex *lock = new std::mutex;
+        return *lock;
+    }
+    std::vector<tskTaskControlBlock *> &registry()
+    {
+        static auto *tasks = new std::vector<tskTaskControlBlock *>;
+        return *tasks;
+    }
+
+    const std::thread::id mainThread = std::this_thread::get_id();
+    thread_local tskTaskControlBlock *currentTask = nullptr;
+
+    tskTaskControlBlock *registerTask(const char *name, BaseType_t core, UBaseType_t priority, uint32_t depth)
+    {
+        auto *task       = new tskTaskControlBlock;
+        task->name       = name;
+        task->core       = core;
+        task->priority   = priority;
+        task->stackDepth = depth;
+        std::lock_guard<std::mutex> guard(registryLock());
+        registry().push_back(task);
+        return task;
+    }
+
+    tskTaskControlBlock *current()
+    {
+        if (currentTask == nullptr)
+        {
+            // The process main thread plays app_main; other foreign threads get an unpinned task.
+            bool isMain = std::this_thread::get_id() == mainThread;
+            currentTask = registerTask(isMain ? "main" : "host", isMain ? CONFIG_ESP_MAIN_TASK_AFFINITY : tskNO_AFFINITY, 1,
+                                       isMain ? CONFIG_ESP_MAIN_TASK_STACK_SIZE : 0);
+        }
+        return currentTask;
+    }
+
+    tskTaskControlBlock *findTask(const char *name)
+    {
+        std::lock_guard<std::mutex> guard(registryLock());
+        for (tskTaskControlBlock *task : registry())
+        {
+            if (task->name == name)
+            {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    QueueDefinition *newQueue(QueueDefinition::Kind kind, UBaseType_t length, UBaseType_t itemSize, UBaseType_t count)
+    {
+        auto *queue     = new QueueDefinition;
+        queue->kind     = kind;
+        queue->length   = length;
+        queue->itemSize = itemSize;
+        queue->count    = count;
+        return queue;
+    }
+}
+
+// Critical sections
+
+void vPortEnterCritical(portMUX_TYPE *)
+{
+    criticalLock().lock();
+}
+
+void vPortExitCritical(portMUX_TYPE *)
+{
+    criticalLock().unlock();
+}
+
+BaseType_t xPortInIsrContext(void)
+{
+    return pdFALSE;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    BaseType_t core = current()->core;
+    return core == tskNO_AFFINITY ? 0 : core;
+}
+
+// Tasks
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority,
+                                   TaskHandle_t *created_task, BaseType_t core_id)
+{
+    tskTaskControlBlock *task = registerTask(name, core_id, priority, stack_depth);
+    if (created_task != nullptr)
+    {
+        *created_task = task;
+    }
+    std::thread(
+        [task, code, parameters]
+        {
+            currentTask = task;
+            code(parameters);
+        })
+        .detach();
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority,
+                                           StackType_t *stack_buffer, StaticTask_t *task_buffer, BaseType_t core_id)
+{
+    if (stack_buffer == nullptr || task_buffer == nullptr)
+    {
+        return nullptr;
+    }
+    TaskHandle_t handle = nullptr;
+    xTaskCreatePinnedToCore(code, name, stack_depth, parameters, priority, &handle, core_id);
+    return handle;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr || task == currentTask)
+    {
+        pthread_exit(nullptr);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(pdTICKS_TO_MS(ticks)));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return pdMS_TO_TICKS(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - bootTime).count());
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current();
+}
+
+BaseType_t xTaskGetCoreID(TaskHandle_t task)
+{
+    return (task != nullptr ? task : current())->core;
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    return (task != nullptr ? task : current())->name.c_str();
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    std::lock_guard<std::mutex> guard(registryLock());
+    return registry().size();
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t count, uint32_t *total_runtime)
+{
+    std::lock_guard<std::mutex> guard(registryLock());
+    UBaseType_t                 n = 0;
+    for (tskTaskControlBlock *task : registry())
+    {
+        if (n == count)
+        {
+            break;
+        }
+        status[n]                      = {};
+        status[n].xHandle              = task;
+        status[n].pcTaskName           = task->name.c_str();
+        status[n].xTaskNumber          = n;
+        status[n].eCurrentState        = eBlocked;
+        status[n].uxCurrentPriority    = task->priority;
+        status[n].uxBasePriority       = task->priority;
+        status[n].usStackHighWaterMark = task->stackDepth; // Stack use cannot be observed on the host.
+        n++;
+    }
+    if (total_runtime != nullptr)
+    {
+        *total_runtime = static_cast<uint32_t>(esp_timer_get_time());
+    }
+    return n;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return (task != nullptr ? task : current())->stackDepth;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    tskTaskControlBlock         *task = current();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    waitTicks(task->cv, lock, ticks, [task] { return task->notifications > 0; });
+    uint32_t value      = task->notifications;
+    task->notifications = (clear_on_exit || value == 0) ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> guard(task->mutex);
+        task->notifications++;
+    }
+    task->cv.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken != nullptr)
+    {
+        *woken = pdFALSE;
+    }
+}
+
+// Queues and semaphores
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return newQueue(QueueDefinition::QUEUE, length, item_size, 0);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *queue_buffer)
+{
+    if ((storage == nullptr && item_size != 0) || queue_buffer == nullptr)
+    {
+        return nullptr;
+    }
+    return xQueueCreate(length, item_size);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        if (!waitTicks(queue->cv, lock, ticks, [queue] { return queue->count < queue->length; }))
+        {
+            return pdFAIL;
+        }
+        if (queue->kind == QueueDefinition::QUEUE)
+        {
+            const uint8_t *bytes = static_cast<const uint8_t *>(item);
+            queue->items.emplace_back(bytes, bytes + queue->itemSize);
+        }
+        queue->count++;
+    }
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    if (woken != nullptr)
+    {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    {
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        if (!waitTicks(queue->cv, lock, ticks, [queue] { return queue->count > 0; }))
+        {
+            return pdFAIL;
+        }
+        if (queue->kind == QueueDefinition::QUEUE)
+        {
+            memcpy(item, queue->items.front().data(), queue->itemSize);
+            queue->items.pop_front();
+        }
+        queue->count--;
+    }
+    queue->cv.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    return queue->length - queue->count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return newQueue(QueueDefinition::MUTEX, 1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    return buffer != nullptr ? xSemaphoreCreateMutex() : nullptr;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return newQueue(QueueDefinition::COUNTING, 1, 0, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    return buffer != nullptr ? xSemaphoreCreateBinary() : nullptr;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t max_count, UBaseType_t initial_count, StaticSemaphore_t *buffer)
+{
+    return buffer != nullptr ? newQueue(QueueDefinition::COUNTING, max_count, 0, initial_count) : nullptr;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    return xQueueReceive(semaphore, nullptr, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return xQueueSend(semaphore, nullptr, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *woken)
+{
+    return xQueueSendFromISR(semaphore, nullptr, woken);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    vQueueDelete(semaphore);
+}
+
+// Event groups
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return new EventGroupDef_t;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer)
+{
+    return buffer != nullptr ? xEventGroupCreate() : nullptr;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t result;
+    {
+        std::lock_guard<std::mutex> guard(group->mutex);
+        group->bits |= bits;
+        result = group->bits;
+    }
+    group->cv.notify_all();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> guard(group->mutex);
+    EventBits_t                 previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    std::lock_guard<std::mutex> guard(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto                         done = [&] { return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0; };
+    bool                         met  = waitTicks(group->cv, lock, ticks, done);
+    EventBits_t                  now  = group->bits;
+    if (met && clear_on_exit)
+    {
+        group->bits &= ~bits;
+    }
+    return now;
+}
+
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, EventBits_t bits, BaseType_t *woken)
+{
+    xEventGroupSetBits(group, bits);
+    if (woken != nullptr)
+    {
+        *woken = pdFALSE;
+    }
+    return pdPASS;
+}
+
+// esp_timer
+
+struct esp_timer
+{
+    esp_timer_create_args_t args;
+    std::mutex              mutex;
+    std::condition_variable cv;
+    uint32_t                generation = 0; ///< Bumped by every start and stop, ends the previous run.
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    if (args == nullptr || args->callback == nullptr || out == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto *timer = new esp_timer;
+    timer->args = *args;
+    *out        = timer;
+    return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t period_us, bool periodic)
+{
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> guard(timer->mutex);
+        generation = ++timer->generation;
+    }
+    timer->cv.notify_all();
+    std::thread(
+        [timer, period_us, periodic, generation]
+        {
+            std::unique_lock<std::mutex> lock(timer->mutex);
+            do
+            {
+                if (timer->cv.wait_for(lock, std::chrono::microseconds(period_us), [&] { return timer->generation != generation; }))
+                {
+                    return;
+                }
+                lock.unlock();
+                timer->args.callback(timer->args.arg);
+                lock.lock();
+            } while (periodic && timer->generation == generation);
+        })
+        .detach();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return startTimer(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return startTimer(timer, period_us, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    {
+        std::lock_guard<std::mutex> guard(timer->mutex);
+        timer->generation++;
+    }
+    timer->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    return esp_timer_stop(timer);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - bootTime).count() + uptimeOffset;
+}
+
+// Heap statistics of a device with the default heap layout.
+
+size_t heap_caps_get_free_size(uint32_t)
+{
+    return 200 * 1024;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t)
+{
+    return 180 * 1024;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t)
+{
+    return 110 * 1024;
+}
+
+// Host controls
+
+int Host::TaskCore(const char *name)
+{
+    tskTaskControlBlock *task = findTask(name);
+    return task != nullptr ? task->core : -1;
+}
+
+int Host::CurrentCore()
+{
+    return current()->core;
+}
+
+uint32_t Host::TaskStackSize(const char *name)
+{
+    tskTaskControlBlock *task = findTask(name);
+    return task != nullptr ? task->stackDepth : 0;
+}
+
+void Host::SetUptime(int64_t us)
+{
+    uptimeOffset += us - esp_timer_get_time();
+}
@@ -0,0 +1,352 @@
+// NVS partitions as maps, accounting for space in 32-byte entries like the device library.
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "esp_partition.h"
+#include "Host.hpp"
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr size_t ENTRY_SIZE       = 32;
+    constexpr size_t ENTRIES_PER_PAGE = 126;
+    constexpr size_t PAGE_SIZE        = 4096;
+
+    struct Value
+    {
+        nvs_type_t  type;
+        uint32_t    number;
+        std::string text;
+    };
+
+    struct Store
+    {
+        bool                                                initialized = false;
+        size_t                                              filler      = 0; ///< Entries of other users, see `Host::FillNvs`.
+        std::map<std::string, std::map<std::string, Value>> namespaces;
+    };
+
+    struct Handle
+    {
+        std::string     partition;
+        std::string     name;
+        nvs_open_mode_t mode;
+    };
+
+    std::recursive_mutex         lock;
+    std::map<std::string, Store> stores;
+    std::vector<Handle>          handles;
+
+    size_t entries(nvs_type_t type, size_t textLen)
+    {
+        // A string takes a header entry plus its data, including the terminator, in whole entries.
+        return type == NVS_TYPE_STR ? 1 + (textLen + 1 + ENTRY_SIZE - 1) / ENTRY_SIZE : 1;
+    }
+
+    size_t entries(const Value &value)
+    {
+        return entries(value.type, value.text.size());
+    }
+
+    size_t capacity(const char *label)
+    {
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, label);
+        // One page is always kept free for garbage collection.
+        return partition != nullptr && partition->size >= 2 * PAGE_SIZE ? (partition->size / PAGE_SIZE - 1) * ENTRIES_PER_PAGE : 0;
+    }
+
+    size_t used(const Store &store)
+    {
+        size_t total = store.filler;
+        for (const auto &name : store.namespaces)
+        {
+            total++; // Namespace entry.
+            for (const auto &item : name.second)
+            {
+                total += entries(item.second);
+            }
+        }
+        return total;
+    }
+
+    Handle *find(nvs_handle_t handle)
+    {
+        return (handle == 0 || handle > handles.size()) ? nullptr : &handles[handle - 1];
+    }
+
+    // Updates the value in place, so rewriting a key does not allocate and allocation tests see only the firmware.
+    esp_err_t set(nvs_handle_t handle, const char *key, nvs_type_t type, uint32_t number, const char *text)
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        Handle                               *h = find(handle);
+        if (h == nullptr || h->mode != NVS_READWRITE)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        Store &store   = stores[h->partition];
+        auto  &items   = store.namespaces[h->name];
+        size_t current = used(store);
+        auto   it      = items.find(key);
+        // The old value stays until the new one is written, so an update needs room for both.
+        if (current + entries(type, strlen(text)) > capacity(h->partition.c_str()))
+        {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        if (it != items.end() && it->second.type != type)
+        {
+            items.erase(it);
+            it = items.end();
+        }
+        Value &slot = (it != items.end()) ? it->second : items[key];
+        slot.type   = type;
+        slot.number = number;
+        slot.text.assign(text);
+        return ESP_OK;
+    }
+
+    const Value *get(nvs_handle_t handle, const char *key, nvs_type_t type)
+    {
+        Handle *h = find(handle);
+        if (h == nullptr)
+        {
+            return nullptr;
+        }
+        auto &items = stores[h->partition].namespaces[h->name];
+        auto  it    = items.find(key);
+        return (it != items.end() && it->second.type == type) ? &it->second : nullptr;
+    }
+}
+
+struct nvs_opaque_iterator_t
+{
+    std::vector<nvs_entry_info_t> entries;
+    size_t                        position;
+};
+
+void HostNvsReset()
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    stores.clear();
+}
+
+esp_err_t nvs_flash_init_partition(const char *partition_label)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (capacity(partition_label) == 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    stores[partition_label].initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return nvs_flash_init_partition(NVS_DEFAULT_PART_NAME);
+}
+
+esp_err_t nvs_flash_erase_partition(const char *partition_label)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    stores.erase(partition_label);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    return nvs_flash_erase_partition(NVS_DEFAULT_PART_NAME);
+}
+
+esp_err_t nvs_open_from_partition(const char *part_name, const char *name, nvs_open_mode_t mode, nvs_handle_t *out_handle)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    auto                                  it = stores.find(part_name);
+    if (it == stores.end() || !it->second.initialized)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (it->second.namespaces.count(name) == 0)
+    {
+        if (mode == NVS_READONLY)
+        {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        if (used(it->second) + 1 > capacity(part_name))
+        {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        it->second.namespaces[name];
+    }
+    handles.push_back({part_name, name, mode});
+    *out_handle = handles.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out_handle)
+{
+    return nvs_open_from_partition(NVS_DEFAULT_PART_NAME, name, mode, out_handle);
+}
+
+void nvs_close(nvs_handle_t)
+{
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return set(handle, key, NVS_TYPE_STR, 0, value);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    const Value                          *value = get(handle, key, NVS_TYPE_STR);
+    if (value == nullptr)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    size_t needed = value->text.size() + 1;
+    if (out_value != nullptr)
+    {
+        if (*length < needed)
+        {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        memcpy(out_value, value->text.c_str(), needed);
+    }
+    *length = needed;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set(handle, key, NVS_TYPE_U32, value, "");
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    const Value                          *value = get(handle, key, NVS_TYPE_U32);
+    if (value == nullptr)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_value = value->number;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    Handle                               *h = find(handle);
+    if (h == nullptr || h->mode != NVS_READWRITE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return stores[h->partition].namespaces[h->name].erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    Handle                               *h = find(handle);
+    if (h == nullptr || h->mode != NVS_READWRITE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stores[h->partition].namespaces[h->name].clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return find(handle) != nullptr ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type, nvs_iterator_t *output_iterator)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    *output_iterator = nullptr;
+    auto store       = stores.find(part_name);
+    if (store == stores.end() || !store->second.initialized)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    auto *it = new nvs_opaque_iterator_t{{}, 0};
+    for (const auto &name : store->second.namespaces)
+    {
+        if (namespace_name != nullptr && name.first != namespace_name)
+        {
+            continue;
+        }
+        for (const auto &item : name.second)
+        {
+            if (type != NVS_TYPE_ANY && item.second.type != type)
+            {
+                continue;
+            }
+            nvs_entry_info_t info = {};
+            strncpy(info.namespace_name, name.first.c_str(), sizeof(info.namespace_name) - 1);
+            strncpy(info.key, item.first.c_str(), sizeof(info.key) - 1);
+            info.type = item.second.type;
+            it->entries.push_back(info);
+        }
+    }
+    if (it->entries.empty())
+    {
+        delete it;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *output_iterator = it;
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *iterator)
+{
+    if (iterator == nullptr || *iterator == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (++(*iterator)->position >= (*iterator)->entries.size())
+    {
+        delete *iterator;
+        *iterator = nullptr;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t *out_info)
+{
+    if (iterator == nullptr || out_info == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_info = iterator->entries[iterator->position];
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    delete iterator;
+}
+
+void Host::FillNvs(const char *label, size_t entries)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    stores[label].filler = entries;
+}
+
+size_t Host::NvsUsedEntries(const char *label, size_t *total)
+{
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    *total = capacity(label);
+    return used(stores[label]);
+}
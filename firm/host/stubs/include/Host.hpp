@@ -0,0 +1,212 @@
+#ifndef HOST_HPP
+#define HOST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Controls of the host emulation of ESP-IDF and FreeRTOS, for tests and benchmarks.
+ *
+ * Tasks run as threads, flash partitions are RAM arrays sized from `main/partitions.csv` with
+ * NOR semantics (a write can only clear bits, an erase sets a whole sector), NVS partitions are
+ * maps that account for space in 32-byte entries like the device, and the SPIFFS mount point is
+ * redirected to a `spiffs` directory below the working directory.
+ *
+ * The Bluetooth stack is a simulated link to one central per connection: Bluedroid events are
+ * delivered from a `BTC_TASK` task through a bounded queue, and a radio thread sends queued
+ * notifications once per connection event, sharing the air time between connections.
+ */
+namespace Host
+{
+    /**
+     * @brief Erases every partition, NVS contents and SPIFFS file, and clears all injected faults.
+     */
+    void ResetStorage();
+
+    /**
+     * @brief Resizes a partition, erasing it. Call before the owner of the partition initializes.
+     * @param label Partition label.
+     * @param size New size in bytes, a multiple of the sector size.
+     */
+    void ResizePartition(const char *label, size_t size);
+
+    /**
+     * @brief Gives access to the emulated contents of a partition.
+     * @param label Partition label.
+     * @param size Output partition size.
+     * @return Partition contents, `nullptr` if there is no such partition.
+     */
+    uint8_t *PartitionData(const char *label, size_t *size);
+
+    /**
+     * @brief Counts the sector erases of a partition since the last reset.
+     * @param label Partition label.
+     * @return Number of sectors erased.
+     */
+    uint32_t SectorErases(const char *label);
+
+    /**
+     * @brief Simulates a power cut after the given number of further flash bytes are written.
+     *
+     * The write that crosses the limit is applied partially and fails, as do all writes and
+     * erases after it, until `RestorePower` or `ResetStorage`.
+     * @param bytes Bytes still written in full.
+     */
+    void CutPowerAfter(size_t bytes);
+
+    /**
+     * @brief Ends a simulated power cut, as a reboot would.
+     */
+    void RestorePower();
+
+    /**
+     * @brief Makes the next SPIFFS mounts fail or succeed.
+     * @param fail `true` to fail mounts.
+     */
+    void FailMount(bool fail);
+
+    /**
+     * @brief Makes opening files on the SPIFFS mount point fail or succeed.
+     * @param fail `true` to fail opens.
+     */
+    void FailFileOpen(bool fail);
+
+    /**
+     * @brief Occupies NVS entries, as other users of a partition such as BT bonding and PHY calibration do.
+     * @param label NVS partition label.
+     * @param entries Number of 32-byte entries to occupy.
+     */
+    void FillNvs(const char *label, size_t entries);
+
+    /**
+     * @brief Reports the used and total 32-byte entries of an NVS partition.
+     * @param label NVS partition label.
+     * @param total Output number of usable entries.
+     * @return Number of used entries.
+     */
+    size_t NvsUsedEntries(const char *label, size_t *total);
+
+    /**
+     * @brief Reports the core a task was pinned to.
+     * @param name Task name.
+     * @return Core number, `tskNO_AFFINITY`, or -1 if no such task exists.
+     */
+    int TaskCore(const char *name);
+
+    /**
+     * @brief Reports the core the calling task is pinned to, as `xPortGetCoreID` would.
+     * @return Core number, or `tskNO_AFFINITY` for threads that are not tasks.
+     */
+    int CurrentCore();
+
+    /**
+     * @brief Reports the stack size a task was created with.
+     * @param name Task name.
+     * @return Stack size in bytes, 0 if no such task exists.
+     */
+    uint32_t TaskStackSize(const char *name);
+
+    /**
+     * @brief Sets the time `esp_timer_get_time` continues from, as a reboot (0) or a long wait would.
+     *
+     * FreeRTOS ticks and timers keep running on the real clock.
+     * @param us Microseconds since boot.
+     */
+    void SetUptime(int64_t us);
+
+    /**
+     * @brief Link settings the simulated central accepts.
+     */
+    struct BleCentral
+    {
+        uint16_t min_int;    ///< Shortest connection interval accepted, in 1.25 ms units.
+        uint16_t max_int;    ///< Longest connection interval accepted, in 1.25 ms units.
+        uint16_t max_tx_len; ///< Longest LE data length supported, in bytes.
+        uint16_t mtu;        ///< ATT MTU offered in the MTU exchange.
+    };
+
+    /**
+     * @brief Counters of a simulated link.
+     */
+    struct BleLinkStats
+    {
+        uint32_t delivered;   ///< Notifications received by the central.
+        uint32_t refused;     ///< Notifications refused with an error by `esp_ble_gatts_send_indicate`.
+        uint32_t oversized;   ///< Notifications longer than the MTU allows, which the stack truncates.
+        uint32_t congestions; ///< Times the link reported congestion.
+    };
+
+    /**
+     * @brief Sets what the central accepts in later negotiations.
+     * @param central Link settings.
+     */
+    void BleSetCentral(const BleCentral &central);
+
+    /**
+     * @brief Reports whether the peripheral is advertising.
+     */
+    bool BleAdvertising();
+
+    /**
+     * @brief Connects a central, as the stack reports it with `ESP_GATTS_CONNECT_EVT`.
+     * @param conn_id Connection ID.
+     * @param bda Central address, 6 bytes.
+     * @param interval Initial connection interval, in 1.25 ms units.
+     * @param latency Initial slave latency.
+     * @param timeout Initial supervision timeout, in 10 ms units.
+     * @return `false` if the stack has no free ACL link (`CONFIG_BT_ACL_CONNECTIONS`).
+     */
+    bool BleConnect(uint16_t conn_id, const uint8_t *bda, uint16_t interval, uint16_t latency, uint16_t timeout);
+
+    /**
+     * @brief Disconnects a central.
+     * @param conn_id Connection ID.
+     */
+    void BleDisconnect(uint16_t conn_id);
+
+    /**
+     * @brief Runs the MTU exchange with the MTU of the central.
+     * @param conn_id Connection ID.
+     */
+    void BleExchangeMtu(uint16_t conn_id);
+
+    /**
+     * @brief Finds the handle of a characteristic value, or of its CCCD.
+     * @param uuid 16-bit characteristic UUID.
+     * @param cccd `true` for the Client Characteristic Configuration descriptor.
+     * @return Attribute handle, 0 if the table has not been created.
+     */
+    uint16_t BleHandle(uint16_t uuid, bool cccd);
+
+    /**
+     * @brief Writes an attribute from the central, as `ESP_GATTS_WRITE_EVT`.
+     * @param conn_id Connection ID.
+     * @param handle Attribute handle.
+     * @param data Written value.
+     * @param len Length of `data`.
+     */
+    void BleWrite(uint16_t conn_id, uint16_t handle, const void *data, size_t len);
+
+    /**
+     * @brief Waits for the next notification received by a central.
+     * @param conn_id Connection ID.
+     * @param value Output notification value.
+     * @param timeout_ms Longest wait.
+     * @return `false` on timeout.
+     */
+    bool BleReceive(uint16_t conn_id, std::string &value, uint32_t timeout_ms);
+
+    /**
+     * @brief Waits until the BTC task has handled every event queued so far.
+     */
+    void BleSync();
+
+    /**
+     * @brief Reports the counters of a link since it connected.
+     * @param conn_id Connection ID.
+     */
+    BleLinkStats BleStats(uint16_t conn_id);
+}
+
+#endif // HOST_HPP
@@ -0,0 +1,81 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    UART_NUM_0,
+} uart_port_t;
+
+typedef enum
+{
+    UART_DATA_8_BITS = 3,
+} uart_word_length_t;
+
+typedef enum
+{
+    UART_PARITY_DISABLE,
+} uart_parity_t;
+
+typedef enum
+{
+    UART_STOP_BITS_1 = 1,
+} uart_stop_bits_t;
+
+typedef enum
+{
+    UART_HW_FLOWCTRL_DISABLE,
+} uart_hw_flowcontrol_t;
+
+typedef enum
+{
+    UART_SCLK_DEFAULT,
+} uart_sclk_t;
+
+typedef struct
+{
+    int                   baud_rate;
+    uart_word_length_t    data_bits;
+    uart_parity_t         parity;
+    uart_stop_bits_t      stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t               rx_flow_ctrl_thresh;
+    uart_sclk_t           source_clk;
+    struct
+    {
+        uint32_t backup_before_sleep : 1;
+    } flags;
+} uart_config_t;
+
+typedef enum
+{
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+} uart_event_type_t;
+
+typedef struct
+{
+    uart_event_type_t type;
+    size_t            size;
+    bool              timeout_flag;
+} uart_event_t;
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *config);
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue,
+                              int intr_alloc_flags);
+esp_err_t uart_driver_delete(uart_port_t uart_num);
+int       uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait);
+int       uart_write_bytes(uart_port_t uart_num, const void *src, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
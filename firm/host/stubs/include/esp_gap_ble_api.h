@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    ADV_TYPE_IND = 0x00,
+} esp_ble_adv_type_t;
+
+typedef enum
+{
+    ADV_CHNL_ALL = 0x07,
+} esp_ble_adv_channel_t;
+
+typedef enum
+{
+    ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0x00,
+} esp_ble_adv_filter_t;
+
+typedef struct
+{
+    uint16_t              adv_int_min;
+    uint16_t              adv_int_max;
+    esp_ble_adv_type_t    adv_type;
+    esp_ble_addr_type_t   own_addr_type;
+    esp_bd_addr_t         peer_addr;
+    esp_ble_addr_type_t   peer_addr_type;
+    esp_ble_adv_channel_t channel_map;
+    esp_ble_adv_filter_t  adv_filter_policy;
+} esp_ble_adv_params_t;
+
+typedef struct
+{
+    esp_bd_addr_t bda;
+    uint16_t      min_int;
+    uint16_t      max_int;
+    uint16_t      latency;
+    uint16_t      timeout;
+} esp_ble_conn_update_params_t;
+
+typedef struct
+{
+    uint16_t rx_len;
+    uint16_t tx_len;
+} esp_ble_pkt_data_length_params_t;
+
+typedef enum
+{
+    ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT = 4,
+    ESP_GAP_BLE_ADV_START_COMPLETE_EVT        = 6,
+    ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT        = 20,
+    ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT   = 21,
+} esp_gap_ble_cb_event_t;
+
+typedef union
+{
+    struct ble_update_conn_params_evt_param
+    {
+        esp_bt_status_t status;
+        esp_bd_addr_t   bda;
+        uint16_t        min_int;
+        uint16_t        max_int;
+        uint16_t        latency;
+        uint16_t        conn_int;
+        uint16_t        timeout;
+    } update_conn_params;
+
+    struct ble_pkt_data_length_cmpl_evt_param
+    {
+        esp_bt_status_t                  status;
+        esp_ble_pkt_data_length_params_t params;
+        esp_bd_addr_t                    remote_bd_addr;
+    } pkt_data_length_cmpl;
+
+    struct ble_adv_start_cmpl_evt_param
+    {
+        esp_bt_status_t status;
+    } adv_start_cmpl;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_set_device_name(const char *name);
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t *raw_data, uint32_t raw_data_len);
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *adv_params);
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params);
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu);
+
+#ifdef __cplusplus
+}
+#endif
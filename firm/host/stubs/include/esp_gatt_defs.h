@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_GATT_PERM_READ               (1 << 0)
+#define ESP_GATT_PERM_WRITE              (1 << 4)
+#define ESP_GATT_CHAR_PROP_BIT_READ      (1 << 1)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE_NR  (1 << 2)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE     (1 << 3)
+#define ESP_GATT_CHAR_PROP_BIT_NOTIFY    (1 << 4)
+#define ESP_GATT_CHAR_PROP_BIT_INDICATE  (1 << 5)
+#define ESP_GATT_RSP_BY_APP              0
+#define ESP_GATT_AUTO_RSP                1
+#define ESP_GATT_UUID_PRI_SERVICE        0x2800
+#define ESP_GATT_UUID_CHAR_DECLARE       0x2803
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG 0x2902
+
+typedef uint8_t  esp_gatt_if_t;
+typedef uint16_t esp_gatt_perm_t;
+typedef uint8_t  esp_gatt_char_prop_t;
+
+typedef enum
+{
+    ESP_GATT_OK        = 0x00,
+    ESP_GATT_CONGESTED = 0x8f,
+} esp_gatt_status_t;
+
+typedef struct
+{
+    uint16_t interval; ///< Connection interval, in 1.25 ms units.
+    uint16_t latency;  ///< Slave latency, in connection events.
+    uint16_t timeout;  ///< Supervision timeout, in 10 ms units.
+} esp_gatt_conn_params_t;
+
+typedef struct
+{
+    uint8_t auto_rsp;
+} esp_attr_control_t;
+
+typedef struct
+{
+    uint16_t uuid_length;
+    uint8_t *uuid_p;
+    uint16_t perm;
+    uint16_t max_length;
+    uint16_t length;
+    uint8_t *value;
+} esp_attr_desc_t;
+
+typedef struct
+{
+    esp_attr_control_t attr_control;
+    esp_attr_desc_t    att_desc;
+} esp_gatts_attr_db_t;
+
+#ifdef __cplusplus
+}
+#endif
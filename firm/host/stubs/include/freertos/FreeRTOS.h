@@ -0,0 +1,55 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t      TickType_t;
+typedef int           BaseType_t;
+typedef unsigned int  UBaseType_t;
+typedef uint8_t       StackType_t;
+
+#define pdFALSE               ((BaseType_t)0)
+#define pdTRUE                ((BaseType_t)1)
+#define pdFAIL                pdFALSE
+#define pdPASS                pdTRUE
+#define portMAX_DELAY         ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ    CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS    ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(ticks)  ((uint32_t)(((uint64_t)(ticks) * 1000U) / configTICK_RATE_HZ))
+#define configMAX_PRIORITIES  25
+#define configMAX_TASK_NAME_LEN 16
+#define portNUM_PROCESSORS    2
+#define configNUMBER_OF_CORES portNUM_PROCESSORS
+#define tskNO_AFFINITY        ((BaseType_t)0x7FFFFFFF)
+#define IRAM_ATTR
+
+/* The control blocks only reserve memory on the host; the objects live in FreeRtos.cpp. */
+typedef struct { void *handle; uint8_t reserved[64]; } StaticTask_t;
+typedef struct { void *handle; uint8_t reserved[64]; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef struct { void *handle; uint8_t reserved[32]; } StaticEventGroup_t;
+
+/* Critical sections map to one process-wide recursive lock, like disabling interrupts. */
+typedef struct { uint32_t owner; uint32_t count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+void       vPortEnterCritical(portMUX_TYPE *mux);
+void       vPortExitCritical(portMUX_TYPE *mux);
+BaseType_t xPortInIsrContext(void);
+BaseType_t xPortGetCoreID(void);
+
+#define portENTER_CRITICAL(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)      vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)  vPortExitCritical(mux)
+#define portYIELD_FROM_ISR(woken)   ((void)(woken))
+
+#ifdef __cplusplus
+}
+#endif
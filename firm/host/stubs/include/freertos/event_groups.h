@@ -0,0 +1,23 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EventGroupDef_t *EventGroupHandle_t;
+typedef uint32_t                EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer);
+void               vEventGroupDelete(EventGroupHandle_t group);
+EventBits_t        xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t        xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t        xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t        xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all,
+                                       TickType_t ticks);
+BaseType_t         xEventGroupSetBitsFromISR(EventGroupHandle_t group, EventBits_t bits, BaseType_t *woken);
+
+#ifdef __cplusplus
+}
+#endif
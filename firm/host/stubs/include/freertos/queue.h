@@ -0,0 +1,23 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct QueueDefinition *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *queue_buffer);
+BaseType_t    xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t    xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+BaseType_t    xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t   uxQueueSpacesAvailable(QueueHandle_t queue);
+void          vQueueDelete(QueueHandle_t queue);
+
+#define xQueueSendToBack(queue, item, ticks) xQueueSend(queue, item, ticks)
+
+#ifdef __cplusplus
+}
+#endif
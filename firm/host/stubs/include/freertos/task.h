@@ -0,0 +1,59 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef enum
+{
+    eRunning,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid,
+} eTaskState;
+
+typedef struct
+{
+    TaskHandle_t xHandle;
+    const char  *pcTaskName;
+    UBaseType_t  xTaskNumber;
+    eTaskState   eCurrentState;
+    UBaseType_t  uxCurrentPriority;
+    UBaseType_t  uxBasePriority;
+    uint32_t     ulRunTimeCounter;
+    StackType_t *pxStackBase;
+    uint32_t     usStackHighWaterMark;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+    BaseType_t xCoreID;
+#endif
+} TaskStatus_t;
+
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority,
+                                     TaskHandle_t *created_task, BaseType_t core_id);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters,
+                                           UBaseType_t priority, StackType_t *stack_buffer, StaticTask_t *task_buffer, BaseType_t core_id);
+void         vTaskDelete(TaskHandle_t task);
+void         vTaskDelay(TickType_t ticks);
+TickType_t   xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t   xTaskGetCoreID(TaskHandle_t task);
+const char  *pcTaskGetName(TaskHandle_t task);
+UBaseType_t  uxTaskGetNumberOfTasks(void);
+UBaseType_t  uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t count, uint32_t *total_runtime);
+UBaseType_t  uxTaskGetStackHighWaterMark(TaskHandle_t task);
+uint32_t     ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+BaseType_t   xTaskNotifyGive(TaskHandle_t task);
+void         vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+#define xTaskCreate(code, name, depth, params, priority, handle) \
+    xTaskCreatePinnedToCore(code, name, depth, params, priority, handle, tskNO_AFFINITY)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+#ifndef BLE_CLIENT_HPP
+#define BLE_CLIENT_HPP
+
+#include <cstdint>
+#include <string>
+#include "Host.hpp"
+#include "HostTest.hpp"
+
+/**
+ * @brief A simulated central talking to the GATT service of `BleManager`.
+ */
+class BleClient
+{
+  public:
+    static constexpr uint16_t CMD_UUID    = 0xFF01;
+    static constexpr uint16_t NOTIFY_UUID = 0xFF02;
+    static constexpr uint16_t BULK_UUID   = 0xFF03;
+
+    /**
+     * @brief Waits until the attribute table of an initialized `BleManager` is created.
+     */
+    static void WaitForService()
+    {
+        for (int i = 0; i < 100 && Host::BleHandle(CMD_UUID, false) == 0; ++i)
+        {
+            Host::BleSync();
+        }
+        CHECK(Host::BleHandle(CMD_UUID, false) != 0);
+    }
+
+    /**
+     * @brief Connects and enables notifications on the notify and bulk characteristics.
+     * @param conn_id Connection ID.
+     * @param interval Initial connection interval, in 1.25 ms units.
+     * @param latency Initial slave latency.
+     * @param timeout Initial supervision timeout, in 10 ms units.
+     * @return `false` if the stack refused the connection.
+     */
+    bool Connect(uint16_t conn_id, uint16_t interval = 0x28, uint16_t latency = 0, uint16_t timeout = 500)
+    {
+        uint8_t bda[6] = {0x24, 0x0a, 0xc4, 0x00, static_cast<uint8_t>(conn_id >> 8), static_cast<uint8_t>(conn_id)};
+        if (!Host::BleConnect(conn_id, bda, interval, latency, timeout))
+        {
+            return false;
+        }
+        id                = conn_id;
+        uint8_t enable[2] = {0x01, 0x00};
+        Host::BleWrite(id, Host::BleHandle(NOTIFY_UUID, true), enable, sizeof(enable));
+        Host::BleWrite(id, Host::BleHandle(BULK_UUID, true), enable, sizeof(enable));
+        Host::BleSync();
+        return true;
+    }
+
+    /**
+     * @brief Writes a command to the command characteristic.
+     */
+    void Send(const std::string &cmd)
+    {
+        Host::BleWrite(id, Host::BleHandle(CMD_UUID, false), cmd.data(), cmd.size());
+    }
+
+    /**
+     * @brief Writes a command and waits for the first notification of the response.
+     * @param cmd Command.
+     * @param timeout_ms Longest wait.
+     * @return First notification, empty on timeout.
+     */
+    std::string Command(const std::string &cmd, uint32_t timeout_ms = 2000)
+    {
+        std::string response;
+        Send(cmd);
+        Host::BleReceive(id, response, timeout_ms);
+        return response;
+    }
+
+    /**
+     * @brief Writes a command and joins every notification of the response.
+     * @param cmd Command.
+     * @param quiet_ms Time without notifications that ends the response.
+     * @return Response, empty on timeout.
+     */
+    std::string CommandAll(const std::string &cmd, uint32_t quiet_ms = 300)
+    {
+        std::string response;
+        std::string chunk;
+        Send(cmd);
+        while (Host::BleReceive(id, chunk, quiet_ms))
+        {
+            response += chunk;
+        }
+        return response;
+    }
+
+    uint16_t Id() const
+    {
+        return id;
+    }
+
+  private:
+    uint16_t id = 0;
+};
+
+#endif // BLE_CLIENT_HPP
@@ -0,0 +1,165 @@
+#ifndef CAPTURE_REPLAY_HPP
+#define CAPTURE_REPLAY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CommandManager.hpp"
+#include "TrafficCapture.hpp"
+#include "HostTest.hpp"
+
+/**
+ * @brief One record of a traffic capture, see `TrafficCapture`.
+ */
+struct CaptureRecord
+{
+    uint64_t    timestamp; ///< Microseconds since boot.
+    uint8_t     transport; ///< `CommandManager::Transport`.
+    bool        response;  ///< `true` for a response.
+    uint16_t    session;   ///< Session within the transport.
+    std::string payload;   ///< Payload, truncated to `TrafficCapture::MAX_PAYLOAD`.
+};
+
+/**
+ * @brief Decodes the hexadecimal export of `tre`.
+ * @param hex Export, whitespace is ignored.
+ * @param records Output records, oldest first.
+ * @return `false` if the export is malformed.
+ */
+inline bool ParseCapture(const std::string &hex, std::vector<CaptureRecord> &records)
+{
+    std::vector<uint8_t> bytes;
+    int                  high = -1;
+    for (char c : hex)
+    {
+        int nibble = (c >= '0' && c <= '9') ? c - '0' : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (nibble < 0)
+        {
+            if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+            {
+                continue;
+            }
+            return false;
+        }
+        if (high < 0)
+        {
+            high = nibble;
+        }
+        else
+        {
+            bytes.push_back(static_cast<uint8_t>(high << 4 | nibble));
+            high = -1;
+        }
+    }
+
+    size_t pos = 0;
+    while (pos < bytes.size())
+    {
+        if (bytes.size() - pos < TrafficCapture::HEADER_SIZE)
+        {
+            return false;
+        }
+        const uint8_t *header = &bytes[pos];
+        CaptureRecord  record;
+        record.timestamp = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            record.timestamp |= static_cast<uint64_t>(header[i]) << (8 * i);
+        }
+        record.transport = header[8] & ~TrafficCapture::FLAG_RESPONSE;
+        record.response  = (header[8] & TrafficCapture::FLAG_RESPONSE) != 0;
+        record.session   = header[9] | (header[10] << 8);
+        size_t len       = header[11] | (header[12] << 8);
+        pos += TrafficCapture::HEADER_SIZE;
+        if (bytes.size() - pos < len)
+        {
+            return false;
+        }
+        record.payload.assign(reinterpret_cast<const char *>(&bytes[pos]), len);
+        pos += len;
+        records.push_back(record);
+    }
+    return high < 0;
+}
+
+/**
+ * @brief Outcome of a replay.
+ */
+struct ReplayResult
+{
+    Latencies latency;  ///< Processing time of each replayed request.
+    size_t    requests; ///< Requests replayed.
+    size_t    skipped;  ///< Requests not replayed because the capture truncated them.
+    size_t    diffs;    ///< Responses that differ from the captured ones.
+    int64_t   elapsed;  ///< Duration of the replay in microseconds.
+};
+
+/**
+ * @brief Re-drives the requests of a capture through the command managers of this build.
+ *
+ * Requests are replayed one at a time in capture order. Each response is compared with the next
+ * captured response of the same transport and session, up to the length the capture kept.
+ * @param records Capture records, oldest first.
+ * @param speed Replay speed relative to the capture, 0 to replay without waiting.
+ * @param diffOut Stream the differences are described on, `nullptr` for none.
+ * @return Latencies and counters of the replay.
+ */
+inline ReplayResult ReplayCapture(const std::vector<CaptureRecord> &records, double speed, FILE *diffOut)
+{
+    static CommandManager managers[] = {CommandManager(CommandManager::TRANSPORT_USB), CommandManager(CommandManager::TRANSPORT_BLE)};
+
+    ReplayResult result = {};
+    auto         start  = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const CaptureRecord &request = records[i];
+        if (request.response || request.transport >= sizeof(managers) / sizeof(managers[0]))
+        {
+            continue;
+        }
+        if (request.payload.size() >= TrafficCapture::MAX_PAYLOAD)
+        {
+            result.skipped++;
+            continue;
+        }
+        if (speed > 0)
+        {
+            auto offset = std::chrono::microseconds(static_cast<int64_t>((request.timestamp - records.front().timestamp) / speed));
+            std::this_thread::sleep_until(start + offset);
+        }
+
+        BlobStore::View view;
+        std::string     code;
+        result.latency.Add(TimeUs([&] { code = managers[request.transport].ProcessCommand(request.payload, request.session, &view); }));
+        std::string actual = view.Valid() ? std::string(view.Data(), view.Size()) : code;
+        result.requests++;
+
+        for (size_t j = i + 1; j < records.size(); ++j)
+        {
+            const CaptureRecord &expected = records[j];
+            if (!expected.response || expected.transport != request.transport || expected.session != request.session)
+            {
+                continue;
+            }
+            bool truncated = expected.payload.size() == TrafficCapture::MAX_PAYLOAD;
+            bool same      = truncated ? actual.compare(0, TrafficCapture::MAX_PAYLOAD, expected.payload) == 0 : actual == expected.payload;
+            if (!same)
+            {
+                result.diffs++;
+                if (diffOut != nullptr)
+                {
+                    fprintf(diffOut, "%u/%u %s: expected \"%s\", got \"%s\"\n", request.transport, request.session, request.payload.c_str(),
+                            expected.payload.c_str(), actual.substr(0, TrafficCapture::MAX_PAYLOAD).c_str());
+                }
+            }
+            break;
+        }
+    }
+    result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+#endif // CAPTURE_REPLAY_HPP
@@ -0,0 +1,80 @@
+#ifndef HOST_TEST_HPP
+#define HOST_TEST_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "esp_timer.h"
+
+/**
+ * @brief Fails the test with the location and condition when `cond` is false.
+ */
+#define CHECK(cond)                                                                     \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(cond))                                                                    \
+        {                                                                               \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);    \
+            exit(1);                                                                    \
+        }                                                                               \
+    } while (0)
+
+/**
+ * @brief Latency samples of a benchmark, in microseconds.
+ */
+class Latencies
+{
+  public:
+    void Add(int64_t us)
+    {
+        samples.push_back(us);
+    }
+
+    /**
+     * @brief Computes a percentile of the samples.
+     * @param percent Percentile, 0 to 100.
+     * @return Sample at that rank, 0 without samples.
+     */
+    int64_t Percentile(double percent)
+    {
+        if (samples.empty())
+        {
+            return 0;
+        }
+        std::sort(samples.begin(), samples.end());
+        size_t rank = static_cast<size_t>(percent / 100.0 * (samples.size() - 1) + 0.5);
+        return samples[rank];
+    }
+
+    size_t Count() const
+    {
+        return samples.size();
+    }
+
+    /**
+     * @brief Prints `<name>: n=<count> p50=<us> p99=<us> max=<us>`.
+     */
+    void Print(const char *name)
+    {
+        printf("%s: n=%zu p50=%lldus p99=%lldus max=%lldus\n", name, samples.size(), static_cast<long long>(Percentile(50)),
+               static_cast<long long>(Percentile(99)), static_cast<long long>(Percentile(100)));
+    }
+
+  private:
+    std::vector<int64_t> samples;
+};
+
+/**
+ * @brief Measures the duration of a call in microseconds.
+ */
+template <class Function>
+int64_t TimeUs(Function function)
+{
+    int64_t start = esp_timer_get_time();
+    function();
+    return esp_timer_get_time() - start;
+}
+
+#endif // HOST_TEST_HPP
@@ -0,0 +1,132 @@
+// A steady stream of get and put commands, in every storage tier, makes no heap allocation.
+//
+// The transports hand `CommandManager` a response buffer they reuse, so once the buffers, the
+// codec scratch space and the blob index have grown to their working size, commands only touch
+// fixed storage. The hook counts the C++ allocations made on this thread; the `FILE` objects of
+// the host C library are outside it (newlib on the device reuses them, and `FlashManager` gives
+// them its own buffers).
+#include "CommandManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static thread_local bool counting;
+static size_t            allocations;
+
+void *operator new(size_t size)
+{
+    if (counting)
+    {
+        allocations++;
+    }
+    void *p = malloc(size > 0 ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static constexpr int WARM_UP_ROUNDS = 60;  ///< Enough blob writes for one compaction.
+static constexpr int ROUNDS         = 120; ///< At least two more compactions.
+
+// Number of blob bank switches so far, the last field of `tfq`.
+static unsigned long compactions(CommandManager &manager)
+{
+    std::string capacity = manager.ProcessCommand("tfq");
+    return strtoul(capacity.c_str() + capacity.rfind(',') + 1, nullptr, 10);
+}
+
+int main()
+{
+    Host::ResetStorage();
+    Host::ResizePartition("blobs", 65536);
+    CommandManager ble(CommandManager::TRANSPORT_BLE);
+    CHECK(ble.ProcessCommand("tf@") == "OK");
+
+    std::string small(24, 's');       // NVS tier.
+    std::string packed(100, 'p');     // Data file, compressed.
+    std::string plain;                // Data file, stored as given.
+    std::string large(600, 'l');      // Blob partition.
+    for (int i = 0; i < 60; ++i)
+    {
+        plain.push_back(static_cast<char>('!' + (i * 37) % 90));
+    }
+    const std::string commands[] = {
+        "tf10|" + small, "tf10", "tf20:3600|" + packed, "tf20", "tf21:3600|" + plain, "tf21", "tfr21,8,16",
+        "tf30|" + large, "tfv30", "tfr30,100,200",
+    };
+    const std::string expected[] = {
+        "OK", small, "OK", packed, "OK", plain, plain.substr(8, 16), "OK", large, large.substr(100, 200),
+    };
+
+    std::string response;
+    response.reserve(1024);
+    unsigned long before = 0;
+    for (int round = 0; round < WARM_UP_ROUNDS + ROUNDS; ++round)
+    {
+        if (round == WARM_UP_ROUNDS)
+        {
+            before   = compactions(ble);
+            counting = true;
+        }
+        // A session of its own for every round, so the rate limits never answer BUSY.
+        uint16_t session = static_cast<uint16_t>(round + 1);
+        for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i)
+        {
+            BlobStore::View view;
+            ble.ProcessCommand(commands[i], response, session, &view);
+            bool same = view.Valid() ? std::string_view(view.Data(), view.Size()) == expected[i] : response == expected[i];
+            view.Reset();
+            if (!same)
+            {
+                counting = false;
+                fprintf(stderr, "%s: unexpected response \"%s\"\n", commands[i].c_str(), response.c_str());
+                CHECK(same);
+            }
+        }
+    }
+    counting = false;
+    printf("%d commands, %zu allocations, %lu blob compactions\n", ROUNDS * static_cast<int>(sizeof(commands) / sizeof(commands[0])),
+           allocations, compactions(ble) - before);
+    CHECK(compactions(ble) - before >= 2);
+    CHECK(allocations == 0);
+
+    // A session over its limits is answered without allocating either.
+    counting = true;
+    for (int i = 0; i < 200 && response.rfind("BUSY,", 0) != 0; ++i)
+    {
+        ble.ProcessCommand("tf10", response, 1);
+    }
+    counting = false;
+    CHECK(response.rfind("BUSY,", 0) == 0);
+    CHECK(allocations == 0);
+    return 0;
+}
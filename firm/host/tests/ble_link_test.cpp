@@ -0,0 +1,50 @@
+// Link settings reported by `tc` across connect, profile negotiation and rejection by the central.
+#include "BleManager.hpp"
+#include "BleClient.hpp"
+
+static constexpr uint16_t CONNECT_INTERVAL = 0x28;
+static constexpr uint16_t CONNECT_LATENCY  = 0;
+static constexpr uint16_t CONNECT_TIMEOUT  = 500;
+
+int main()
+{
+    Host::ResetStorage();
+    BleManager ble;
+    ble.Init();
+    BleClient::WaitForService();
+    CHECK(Host::BleAdvertising());
+
+    // A central that only accepts intervals of 30 ms and more rejects the throughput profile, so the
+    // link keeps the parameters it connected with, and the data length is capped by the central.
+    Host::BleSetCentral({0x18, 0x0C80, 123, 185});
+    BleClient slow;
+    CHECK(slow.Connect(1, CONNECT_INTERVAL, CONNECT_LATENCY, CONNECT_TIMEOUT));
+    CHECK(Host::BleAdvertising());
+    CHECK(slow.Command("tc") == "0,40,0,500,123,23,0");
+    Host::BleExchangeMtu(slow.Id());
+    CHECK(slow.Command("tc") == "0,40,0,500,123,185,0");
+
+    // The low power profile fits the central.
+    CHECK(slow.Command("tp1") == "OK");
+    CHECK(slow.Command("tc") == "1,80,4,600,27,185,0");
+
+    // A central that accepts everything gets the throughput profile on connect.
+    Host::BleSetCentral({0x06, 0x0C80, 251, 247});
+    BleClient fast;
+    CHECK(fast.Connect(2, CONNECT_INTERVAL, CONNECT_LATENCY, CONNECT_TIMEOUT));
+    Host::BleExchangeMtu(fast.Id());
+    CHECK(fast.Command("tc") == "0,6,0,400,251,247,0");
+    CHECK(fast.Command("tp1") == "OK");
+    CHECK(fast.Command("tc") == "1,80,4,600,27,247,0");
+    CHECK(fast.Command("tp0") == "OK");
+    CHECK(fast.Command("tc") == "0,6,0,400,251,247,0");
+    CHECK(fast.Command("tp2") == "SYNTAX_ERROR");
+
+    // The first connection is not affected by the second.
+    CHECK(slow.Command("tc") == "1,80,4,600,27,185,0");
+
+    Host::BleDisconnect(slow.Id());
+    Host::BleDisconnect(fast.Id());
+    Host::BleSync();
+    return 0;
+}
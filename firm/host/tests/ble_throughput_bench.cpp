@@ -0,0 +1,126 @@
+// Command round trip and notification throughput over 1 to MAX_CONNECTIONS simulated BLE links.
+//
+// Every client runs on its own thread: it first sends `tc` commands one after the other and
+// measures the time to the response, then reads a blob value in slices with `tfr` and counts
+// the bytes received. A `BUSY` response is retried after its hint, as a client would. Every
+// response must arrive complete, however often the stack refused a notification or reported
+// congestion on the way.
+#include "BleManager.hpp"
+#include "CommandManager.hpp"
+#include "BleClient.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+static constexpr int    MAX_CLIENTS = 9; ///< BleManager::MAX_CONNECTIONS.
+static constexpr int    ROUND_TRIPS = 20;
+static constexpr int    READS       = 4;
+static constexpr size_t SLICE       = BleManager::VIEW_WINDOW;
+static constexpr size_t VALUE_SIZE  = 8192;
+
+static std::mutex       resultsMutex;
+static Latencies        rtt;
+static std::atomic<int> busy;
+
+// Sends a command until it is not answered with BUSY, returns the first notification.
+static std::string request(BleClient &client, const std::string &cmd)
+{
+    while (true)
+    {
+        std::string response = client.Command(cmd, 5000);
+        if (response.rfind("BUSY,", 0) != 0)
+        {
+            return response;
+        }
+        busy++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(atoi(response.c_str() + 5)));
+    }
+}
+
+static void run(BleClient &client, size_t &received)
+{
+    for (int i = 0; i < ROUND_TRIPS; ++i)
+    {
+        std::string response;
+        int64_t     us = TimeUs([&] { response = request(client, "tc"); });
+        CHECK(response.rfind("0,6,0,400,251,247,", 0) == 0);
+        std::lock_guard<std::mutex> guard(resultsMutex);
+        rtt.Add(us);
+    }
+    for (int i = 0; i < READS; ++i)
+    {
+        size_t      offset = (i * SLICE) % VALUE_SIZE;
+        std::string data   = request(client, "tfr1000," + std::to_string(offset) + "," + std::to_string(SLICE));
+        std::string chunk;
+        while (data.size() < SLICE && Host::BleReceive(client.Id(), chunk, 5000))
+        {
+            data += chunk;
+        }
+        CHECK(data == std::string(SLICE, 'x'));
+        received += data.size();
+    }
+}
+
+int main()
+{
+    Host::ResetStorage();
+    BleManager ble;
+    ble.Init();
+    BleClient::WaitForService();
+
+    CommandManager usb(CommandManager::TRANSPORT_USB);
+    CHECK(usb.ProcessCommand("tf1000|" + std::string(VALUE_SIZE, 'x')) == "OK");
+
+    Host::BleSetCentral({0x06, 0x0C80, 251, 247});
+    BleClient          clients[MAX_CLIENTS];
+    Host::BleLinkStats before[MAX_CLIENTS] = {};
+    for (int count = 1; count <= MAX_CLIENTS; ++count)
+    {
+        BleClient &added = clients[count - 1];
+        CHECK(added.Connect(count));
+        Host::BleExchangeMtu(added.Id());
+        Host::BleSync();
+
+        rtt  = Latencies();
+        busy = 0;
+        std::vector<size_t>      received(count, 0);
+        std::vector<std::thread> threads;
+        int64_t                  start = esp_timer_get_time();
+        for (int i = 0; i < count; ++i)
+        {
+            threads.emplace_back(run, std::ref(clients[i]), std::ref(received[i]));
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        int64_t elapsed = esp_timer_get_time() - start;
+
+        size_t   bytes = 0;
+        uint32_t refused = 0, congestions = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            Host::BleLinkStats stats = Host::BleStats(clients[i].Id());
+            CHECK(stats.oversized == 0);
+            bytes += received[i];
+            refused += stats.refused - before[i].refused;
+            congestions += stats.congestions - before[i].congestions;
+            before[i] = stats;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%d links rtt", count);
+        rtt.Print(name);
+        printf("%d links: %zu bytes in %lld ms, %lld KB/s, busy %d, refused %u, congestions %u\n", count, bytes,
+               static_cast<long long>(elapsed / 1000), static_cast<long long>(bytes * 1000000 / elapsed / 1024), busy.load(), refused, congestions);
+    }
+
+    // A whole value longer than one window is refused with its size, and a longer slice is cut.
+    CHECK(clients[0].Command("tfv1000") == "TOO_LARGE," + std::to_string(VALUE_SIZE));
+    CHECK(clients[0].CommandAll("tfr1000,0," + std::to_string(VALUE_SIZE)) == std::string(BleManager::VIEW_WINDOW, 'x'));
+
+    // The stack accepts as many links as the manager tracks.
+    uint8_t bda[6] = {0x24, 0x0a, 0xc4, 0xff, 0xff, 0xff};
+    CHECK(!Host::BleConnect(100, bda, 0x28, 0, 500));
+    return 0;
+}
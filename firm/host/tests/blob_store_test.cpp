@@ -0,0 +1,159 @@
+// Bank switches, torn records, pinned views, streamed values and the live-byte check of the blob tier.
+#include "BlobStore.hpp"
+#include "FlashManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include "esp_rom_crc.h"
+#include <cstdio>
+#include <string>
+
+static constexpr size_t BANK_SIZE = 8192;
+static constexpr size_t VALUE     = 1000;
+
+static uint32_t sequence = 0;
+static uint32_t purged   = 0;
+
+static BlobStore::Result put(BlobStore &store, long id, char fill, size_t size = VALUE)
+{
+    BlobStore::Result result = store.Put(id, sequence + 1, std::string(size, fill), purged);
+    sequence += (result == BlobStore::RESULT_OK) ? 1 : 0;
+    return result;
+}
+
+static bool holds(const BlobStore &store, long id, char fill, size_t size = VALUE)
+{
+    BlobStore::View view;
+    return store.Get(id, view) && std::string(view.Data(), view.Size()) == std::string(size, fill);
+}
+
+// Last field of `Usage`.
+static unsigned long compactions(const BlobStore &store)
+{
+    std::string usage = store.Usage();
+    return strtoul(usage.c_str() + usage.rfind(',') + 1, nullptr, 10);
+}
+
+int main()
+{
+    Host::ResetStorage();
+    Host::ResizePartition("blobs", 2 * BANK_SIZE);
+
+    // Updates fill the bank until the live records are copied to the other one.
+    {
+        BlobStore store;
+        CHECK(store.Init());
+        CHECK(put(store, 1, 'a') == BlobStore::RESULT_OK);
+        unsigned long before = compactions(store);
+        for (int i = 0; i < 10; ++i)
+        {
+            CHECK(put(store, 2, static_cast<char>('b' + i)) == BlobStore::RESULT_OK);
+        }
+        CHECK(compactions(store) == before + 1);
+        CHECK(holds(store, 1, 'a') && holds(store, 2, 'k'));
+    }
+    // After a reboot the newer bank is active and holds the same records.
+    {
+        BlobStore store;
+        CHECK(store.Init());
+        CHECK(holds(store, 1, 'a') && holds(store, 2, 'k'));
+        CHECK(store.Count() == 2);
+    }
+
+    // A write torn by a power cut inside its header is skipped at boot, and the next write
+    // moves to a fresh bank instead of programming over the torn bytes.
+    {
+        BlobStore store;
+        CHECK(store.Init());
+        Host::CutPowerAfter(10);
+        CHECK(put(store, 3, 'c') == BlobStore::RESULT_FAILED);
+        Host::RestorePower();
+    }
+    {
+        BlobStore store;
+        CHECK(store.Init());
+        CHECK(!store.Contains(3, nullptr));
+        CHECK(holds(store, 1, 'a') && holds(store, 2, 'k'));
+        unsigned long before = compactions(store);
+        CHECK(put(store, 3, 'c') == BlobStore::RESULT_OK);
+        CHECK(compactions(store) == before + 1);
+        CHECK(holds(store, 1, 'a') && holds(store, 2, 'k') && holds(store, 3, 'c'));
+    }
+
+    // A view pins its bank: once the value's bank is the one to erase, compaction waits for it.
+    {
+        BlobStore store;
+        CHECK(store.Init());
+        BlobStore::View pinned;
+        CHECK(store.Get(1, pinned));
+        BlobStore::Result result = BlobStore::RESULT_OK;
+        for (int i = 0; i < 20 && result == BlobStore::RESULT_OK; ++i)
+        {
+            result = put(store, 2, static_cast<char>('d' + i % 10));
+        }
+        CHECK(result == BlobStore::RESULT_FULL);
+        CHECK(!store.CanClear());
+        CHECK(std::string(pinned.Data(), pinned.Size()) == std::string(VALUE, 'a'));
+        pinned.Reset();
+        CHECK(store.CanClear());
+        CHECK(put(store, 2, 'z') == BlobStore::RESULT_OK);
+        CHECK(holds(store, 1, 'a') && holds(store, 2, 'z') && holds(store, 3, 'c'));
+    }
+
+    // When the live records leave no room, the write fails without erasing a bank.
+    {
+        BlobStore store;
+        CHECK(store.Init());
+        CHECK(put(store, 4, 'e', 4000) == BlobStore::RESULT_OK);
+        uint32_t      erases = Host::SectorErases("blobs");
+        unsigned long before = compactions(store);
+        CHECK(put(store, 5, 'f', 3000) == BlobStore::RESULT_FULL);
+        CHECK(Host::SectorErases("blobs") == erases && compactions(store) == before);
+        CHECK(holds(store, 1, 'a') && holds(store, 4, 'e', 4000));
+    }
+
+    // A clear refused because of a pinned view deletes nothing in the other tiers either.
+    Host::ResetStorage();
+    Host::ResizePartition("blobs", 2 * BANK_SIZE);
+    FlashManager flash;
+    std::string  large(VALUE, 'g');
+    std::string  expiring(40, 'h');
+    CHECK(flash.HandleCommand("@") == "OK");
+    CHECK(flash.HandleCommand("20|" + large) == "OK");
+    BlobStore::View view;
+    CHECK(flash.HandleCommand("v20", &view).empty() && view.Valid());
+    // The first clear switches away from the value's bank; the next one would erase it.
+    CHECK(flash.HandleCommand("@") == "OK");
+    CHECK(flash.HandleCommand("10|small") == "OK");
+    CHECK(flash.HandleCommand("30:600|" + expiring) == "OK");
+    CHECK(flash.HandleCommand("@") == "OP_ERROR");
+    CHECK(flash.HandleCommand("10") == "small" && flash.HandleCommand("30") == expiring);
+    CHECK(std::string(view.Data(), view.Size()) == large);
+    view.Reset();
+    CHECK(flash.HandleCommand("@") == "OK");
+    CHECK(flash.HandleCommand("10") == "OP_ERROR" && flash.HandleCommand("30") == "OP_ERROR");
+
+    // A streamed value replaces the key only once it is complete and its CRC matches.
+    std::string streamed(3000, 's');
+    for (size_t i = 0; i < streamed.size(); i += 7)
+    {
+        streamed[i] = static_cast<char>('a' + i % 26);
+    }
+    char commit[48];
+    snprintf(commit, sizeof(commit), "k40,%zu,%lx", streamed.size(),
+             static_cast<unsigned long>(esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(streamed.data()), streamed.size())));
+    CHECK(flash.HandleCommand("40|old") == "OK");
+    CHECK(flash.HandleCommand("o40," + std::to_string(streamed.size())) == "OK");
+    CHECK(flash.HandleCommand("w40,0|" + streamed.substr(0, 1000)) == "OK");
+    CHECK(flash.HandleCommand("w40,2000|" + streamed.substr(2000)) == "OP_ERROR"); // Leaves a gap.
+    CHECK(flash.HandleCommand("w40,0|" + streamed.substr(0, 1000)) == "OK");        // Resent as written.
+    CHECK(flash.HandleCommand("w40,1000|" + streamed.substr(1000, 1000)) == "OK");
+    CHECK(flash.HandleCommand(commit) == "OP_ERROR" && flash.HandleCommand("40") == "old");
+    CHECK(flash.HandleCommand("w40,2000|" + streamed.substr(2000)) == "OK");
+    CHECK(flash.HandleCommand("k40,3000,0") == "OP_ERROR"); // Discards the stream.
+    CHECK(flash.HandleCommand(commit) == "OP_ERROR" && flash.HandleCommand("40") == "old");
+    CHECK(flash.HandleCommand("o40," + std::to_string(streamed.size())) == "OK");
+    CHECK(flash.HandleCommand("w40,0|" + streamed) == "OK");
+    CHECK(flash.HandleCommand(commit) == "OK");
+    CHECK(flash.HandleCommand("40") == streamed && flash.HandleCommand("r40,2990,20") == streamed.substr(2990));
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Captures traffic of both transports, then replays the export and compares the responses.
+#include "CaptureReplay.hpp"
+#include "Host.hpp"
+
+static constexpr uint16_t BLE_SESSION = 0x1234; ///< Needs the full 16 bits of the session field.
+
+int main()
+{
+    Host::ResetStorage();
+    CommandManager usb(CommandManager::TRANSPORT_USB);
+    CommandManager ble(CommandManager::TRANSPORT_BLE);
+    std::string    blob(600, 'b');
+
+    CHECK(usb.ProcessCommand("tr1") == "OK");
+    CHECK(usb.ProcessCommand("tf@") == "OK");
+    CHECK(usb.ProcessCommand("tf10|hello") == "OK");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(ble.ProcessCommand("tf10", BLE_SESSION) == "hello");
+    CHECK(ble.ProcessCommand("tf20|" + blob, BLE_SESSION) == "OK");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    BlobStore::View view;
+    ble.ProcessCommand("tfv20", BLE_SESSION, &view);
+    CHECK(view.Valid() && std::string(view.Data(), view.Size()) == blob);
+    view.Reset();
+    CHECK(usb.ProcessCommand("tf@10") == "OK");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::string missing = usb.ProcessCommand("tf10");
+    std::string hex     = usb.ProcessCommand("tre");
+    CHECK(usb.ProcessCommand("tr0") == "OK");
+
+    std::vector<CaptureRecord> records;
+    CHECK(ParseCapture(hex, records));
+    CHECK(records.size() == 14);
+    bool bleSeen = false;
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        CHECK(i == 0 || records[i].timestamp >= records[i - 1].timestamp);
+        bleSeen |= records[i].transport == CommandManager::TRANSPORT_BLE && records[i].session == BLE_SESSION;
+    }
+    CHECK(bleSeen);
+    CHECK(records.back().payload == missing);
+    CHECK(records[9].payload.size() == TrafficCapture::MAX_PAYLOAD); // The 600-byte view response.
+
+    // The write of the blob was truncated by the capture and is skipped, so its read differs.
+    ReplayResult result = ReplayCapture(records, 0, stdout);
+    CHECK(result.requests == 6 && result.skipped == 1 && result.diffs == 1);
+
+    // Replayed at four times the capture speed, without the blob write and read.
+    records.erase(records.begin() + 6, records.begin() + 10); // Blob write and read.
+    result = ReplayCapture(records, 4, stdout);
+    result.latency.Print("replay latency");
+    CHECK(result.requests == 5 && result.skipped == 0 && result.diffs == 0);
+    CHECK(result.elapsed >= static_cast<int64_t>(records[8].timestamp - records[0].timestamp) / 4);
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Compression ratio and codec cost of record values, by payload kind and size.
+//
+// The codec is first measured on its own: every payload must decode to itself, and the ratio is
+// the encoded size over the plain size, escaping included. The same JSON-like records are then
+// written through the data file, where a record is only stored compressed when that wins, and
+// the `z` statistics are checked against what was written.
+#include "FlashManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include "RecordCodec.hpp"
+#include <cstring>
+#include <string>
+
+static constexpr int    ROUNDS  = 50;
+static constexpr int    RECORDS = 64;
+static constexpr size_t SIZES[] = {64, 256, 1024, 4096};
+
+// Telemetry-like JSON objects, as clients store them.
+static std::string json(size_t size, unsigned seed)
+{
+    std::string out = "[";
+    for (unsigned i = 0; out.size() < size; ++i)
+    {
+        char item[96];
+        snprintf(item, sizeof(item), "{\"id\":%u,\"temp\":%u.%u,\"state\":\"%s\",\"ts\":%u},", seed + i, 20 + (seed + i) % 7, i % 10,
+                 (i % 3) ? "idle" : "active", 1700000000u + seed * 60 + i);
+        out += item;
+    }
+    out.resize(size);
+    return out;
+}
+
+// Printable bytes without structure, which the codec cannot shrink.
+static std::string noise(size_t size, unsigned seed)
+{
+    std::string out(size, ' ');
+    uint32_t    state = seed * 2654435761u + 1;
+    for (char &c : out)
+    {
+        state = state * 1664525u + 1013904223u;
+        c     = static_cast<char>(' ' + (state >> 24) % 95);
+    }
+    return out;
+}
+
+// Measures one payload kind and size, returns the ratio in percent.
+static unsigned measure(const char *kind, const std::string &value)
+{
+    RecordCodec::Workspace work;
+    std::string            encoded, decoded;
+    Latencies              compress, decompress;
+    bool                   packed = false;
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        compress.Add(TimeUs([&] { packed = RecordCodec::Compress(value, encoded, work); }));
+        if (packed)
+        {
+            decompress.Add(TimeUs([&] { CHECK(RecordCodec::Decompress(encoded.data(), encoded.size(), decoded, work)); }));
+            CHECK(decoded == value);
+        }
+    }
+    unsigned ratio = packed ? static_cast<unsigned>(encoded.size() * 100 / value.size()) : 100;
+    printf("%-5s %5zu bytes: %3u%%, compress p50=%lldus, decompress p50=%lldus\n", kind, value.size(), ratio,
+           static_cast<long long>(compress.Percentile(50)), static_cast<long long>(decompress.Percentile(50)));
+    return ratio;
+}
+
+int main()
+{
+    for (size_t size : SIZES)
+    {
+        unsigned structured = measure("json", json(size, 1));
+        unsigned random     = measure("noise", noise(size, 1));
+        CHECK(size < 256 || structured < 60);
+        CHECK(random == 100);
+    }
+
+    // Through the data file: the statistics count what was written.
+    Host::ResetStorage();
+    FlashManager flash;
+    CHECK(flash.HandleCommand("@") == "OK");
+    size_t raw = 0;
+    for (int i = 0; i < RECORDS; ++i)
+    {
+        std::string value = (i % 4 == 3) ? noise(200, i) : json(200, i);
+        char        cmd[16];
+        snprintf(cmd, sizeof(cmd), "%x|", 0x100 + i);
+        CHECK(flash.HandleCommand(cmd + value) == "OK");
+        cmd[strlen(cmd) - 1] = '\0';
+        CHECK(flash.HandleCommand(cmd) == value);
+        raw += value.size();
+    }
+    std::string stats = flash.HandleCommand("z");
+    printf("stats: %s\n", stats.c_str());
+    unsigned long compressed = 0, plain = 0, rawBytes = 0, storedBytes = 0;
+    CHECK(sscanf(stats.c_str(), "%lu,%lu,%lu,%lu", &compressed, &plain, &rawBytes, &storedBytes) == 4);
+    CHECK(compressed == RECORDS * 3 / 4 && plain == RECORDS / 4);
+    CHECK(rawBytes == raw * 3 / 4 && storedBytes < rawBytes * 7 / 10);
+    printf("data file: %lu of %zu value bytes stored compressed in %lu\n", rawBytes, raw, storedBytes);
+    return 0;
+}
@@ -0,0 +1,58 @@
+// The NVS tier lives in its own partition, so bonding data cannot crowd it out, and spills to the
+// data file when its partition is full.
+#include "FlashManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include "nvs_flash.h"
+#include <string>
+
+static constexpr int KEYS = 200;
+
+int main()
+{
+    Host::ResetStorage();
+
+    FlashManager flash;
+    CHECK(flash.HandleCommand("10|hello") == "OK");
+    CHECK(flash.HandleCommand("10") == "hello");
+
+    // Bonding data filling the default partition does not affect the tier.
+    size_t total;
+    CHECK(nvs_flash_init() == ESP_OK);
+    Host::NvsUsedEntries("nvs", &total);
+    Host::FillNvs("nvs", total);
+    CHECK(flash.HandleCommand("11|world") == "OK");
+    CHECK(flash.HandleCommand("s1").find("c$17;s2$world") != std::string::npos);
+
+    // Leave room for a few values only, then keep writing: the rest goes to the data file.
+    Host::NvsUsedEntries("storenvs", &total);
+    Host::FillNvs("storenvs", total - 16);
+    for (int i = 0; i < KEYS; ++i)
+    {
+        char cmd[32];
+        snprintf(cmd, sizeof(cmd), "%x|value-%d", 0x100 + i, i);
+        CHECK(flash.HandleCommand(cmd) == "OK");
+    }
+    for (int i = 0; i < KEYS; ++i)
+    {
+        char key[8], expected[16];
+        snprintf(key, sizeof(key), "%x", 0x100 + i);
+        snprintf(expected, sizeof(expected), "value-%d", i);
+        CHECK(flash.HandleCommand(key) == expected);
+    }
+    CHECK(Host::NvsUsedEntries("storenvs", &total) <= total);
+    unsigned long fileRecords = 0, nvsRecords = 0;
+    std::string   capacity    = flash.HandleCommand("q");
+    CHECK(sscanf(capacity.c_str(), "%lu,%*u,%*u,%*u,%*u,%*u,%*c,%*u,%*u,%lu", &fileRecords, &nvsRecords) == 2);
+    CHECK(nvsRecords > 2 && fileRecords > 0 && fileRecords + nvsRecords == KEYS + 2);
+    printf("%lu records in NVS, %lu in the data file\n", nvsRecords, fileRecords);
+
+    // A value of the full tier is deleted with its tombstone in the data file, so delta syncs
+    // still see the deletion, and a rewrite goes to the data file.
+    CHECK(flash.HandleCommand("@10") == "OK");
+    CHECK(flash.HandleCommand("10") == "OP_ERROR");
+    CHECK(flash.HandleCommand("s202").find("x$16;s203$") != std::string::npos);
+    CHECK(flash.HandleCommand("11|again") == "OK");
+    CHECK(flash.HandleCommand("11") == "again");
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Latency of well-behaved sessions next to BLE connections that flood writes.
+//
+// A USB reader and a BLE writer stay within their limits, first alone and then while two BLE
+// connections write back to back without waiting for the responses. The flooders go through the
+// same GATT writes and command task as the writer: once their budget is spent their writes are
+// answered BUSY on the BTC task, so they store no more than the configured rate and the p99
+// latency of the well-behaved commands stays close to the quiet baseline.
+#include "BleManager.hpp"
+#include "BleClient.hpp"
+#include "CommandManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+static constexpr int      DURATION_MS   = 3000;
+static constexpr int      PERIOD_MS     = 50;  ///< 20 commands and 2 KB per second, within the limits.
+static constexpr size_t   VALUE         = 100; ///< Data file tier, fits one write of the command characteristic.
+static constexpr int64_t  SLACK_US      = 10000;
+static constexpr uint32_t COMMAND_RATE  = CONFIG_APP_SCHED_COMMAND_RATE;
+static constexpr uint32_t COMMAND_BURST = CONFIG_APP_SCHED_COMMAND_BURST;
+static constexpr uint32_t WRITE_RATE    = CONFIG_APP_SCHED_WRITE_RATE;
+static constexpr uint32_t WRITE_BURST   = CONFIG_APP_SCHED_WRITE_BURST;
+
+/**
+ * @brief Commands of the USB console, sent at a fixed period.
+ */
+struct Reader
+{
+    uint16_t  session;
+    Latencies latencies;
+    int       busy;
+
+    void Run()
+    {
+        CommandManager manager(CommandManager::TRANSPORT_USB);
+        std::string    response;
+        for (int i = 0; i < DURATION_MS / PERIOD_MS; ++i)
+        {
+            latencies.Add(TimeUs([&] { manager.ProcessCommand("tf20", response, session); }));
+            busy += (response.rfind("BUSY,", 0) == 0) ? 1 : 0;
+            vTaskDelay(pdMS_TO_TICKS(PERIOD_MS));
+        }
+    }
+};
+
+/**
+ * @brief Writes of a BLE connection that waits for each response, sent at a fixed period.
+ */
+struct Writer
+{
+    BleClient client;
+    Latencies latencies;
+    int       busy;
+
+    void Run()
+    {
+        std::string value(VALUE, 'w');
+        std::string response;
+        for (int i = 0; i < DURATION_MS / PERIOD_MS; ++i)
+        {
+            std::string cmd = "tf" + std::to_string(21 + i % 8) + "|" + value;
+            latencies.Add(TimeUs([&] { response = client.Command(cmd); }));
+            CHECK(!response.empty());
+            busy += (response.rfind("BUSY,", 0) == 0) ? 1 : 0;
+            vTaskDelay(pdMS_TO_TICKS(PERIOD_MS));
+        }
+    }
+};
+
+/**
+ * @brief Writes of a BLE connection that ignores the responses and the retry hints.
+ */
+struct Flooder
+{
+    BleClient          client;
+    std::atomic<bool> *stop;
+    int                stored;
+    int                busy;
+
+    void Run()
+    {
+        std::string cmd = "tf" + std::to_string(0x100 + client.Id()) + "|" + std::string(VALUE, 'f');
+        std::string response;
+        while (!stop->load())
+        {
+            // A link delivers a few writes per connection event, so a write every tick is as fast as a central gets.
+            client.Send(cmd);
+            while (Host::BleReceive(client.Id(), response, 0))
+            {
+                Count(response);
+            }
+            vTaskDelay(1);
+        }
+        while (Host::BleReceive(client.Id(), response, 500))
+        {
+            Count(response);
+        }
+    }
+
+    void Count(const std::string &response)
+    {
+        stored += (response == "OK") ? 1 : 0;
+        busy += (response.rfind("BUSY,", 0) == 0) ? 1 : 0;
+    }
+};
+
+/**
+ * @brief p99 latencies of one run.
+ */
+struct Result
+{
+    int64_t reader;
+    int64_t writer;
+};
+
+// Runs a USB reader and a BLE writer, with two flooding connections when `flooded`.
+static Result run(uint16_t firstSession, bool flooded)
+{
+    Reader            reader = {firstSession, {}, 0};
+    Writer            writer = {{}, {}, 0};
+    std::atomic<bool> stop{false};
+    Flooder           flooders[2] = {{{}, &stop, 0, 0}, {{}, &stop, 0, 0}};
+
+    CHECK(writer.client.Connect(firstSession + 1));
+    Host::BleExchangeMtu(firstSession + 1);
+    for (int i = 0; flooded && i < 2; ++i)
+    {
+        CHECK(flooders[i].client.Connect(firstSession + 2 + i));
+        Host::BleExchangeMtu(firstSession + 2 + i);
+    }
+
+    int64_t     start = esp_timer_get_time();
+    std::thread noise[2];
+    for (int i = 0; flooded && i < 2; ++i)
+    {
+        noise[i] = std::thread([&flooders, i] { flooders[i].Run(); });
+    }
+    std::thread readerThread([&reader] { reader.Run(); });
+    writer.Run();
+    readerThread.join();
+    stop = true;
+    for (int i = 0; flooded && i < 2; ++i)
+    {
+        noise[i].join();
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    CHECK(reader.busy == 0 && writer.busy == 0);
+    for (int i = 0; flooded && i < 2; ++i)
+    {
+        const Flooder &flooder = flooders[i];
+        // Everything the flooder stored fits in its bursts plus the rates over the run.
+        uint64_t commands = COMMAND_BURST + COMMAND_RATE * static_cast<uint64_t>(elapsed) / 1000000 + 1;
+        uint64_t bytes    = WRITE_BURST + WRITE_RATE * static_cast<uint64_t>(elapsed) / 1000000 + VALUE;
+        printf("flooder %u: %d stored, %d busy\n", flooder.client.Id(), flooder.stored, flooder.busy);
+        CHECK(flooder.stored > 0 && flooder.busy > 0);
+        CHECK(static_cast<uint64_t>(flooder.stored) <= commands);
+        CHECK(static_cast<uint64_t>(flooder.stored) * VALUE <= bytes);
+        Host::BleDisconnect(flooder.client.Id());
+    }
+    Host::BleDisconnect(writer.client.Id());
+    Host::BleSync();
+
+    reader.latencies.Print("  reader");
+    writer.latencies.Print("  writer");
+    return {reader.latencies.Percentile(99), writer.latencies.Percentile(99)};
+}
+
+int main()
+{
+    Host::ResetStorage();
+    BleManager ble;
+    ble.Init();
+    BleClient::WaitForService();
+    CommandManager usb(CommandManager::TRANSPORT_USB);
+    CHECK(usb.ProcessCommand("tf@") == "OK");
+    CHECK(usb.ProcessCommand("tf20|" + std::string(VALUE, 'r')) == "OK");
+
+    printf("quiet:\n");
+    Result quiet = run(1, false);
+    printf("flooded:\n");
+    Result flooded = run(11, true);
+    printf("%s\n", usb.ProcessCommand("ta").c_str());
+
+    CHECK(flooded.reader <= quiet.reader + SLACK_US);
+    CHECK(flooded.writer <= quiet.writer + SLACK_US);
+    return 0;
+}
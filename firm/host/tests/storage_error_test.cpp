@@ -0,0 +1,46 @@
+// The storage error state follows failed mounts and reads as well as writes, and clears again
+// once storage works. A failed clear does not serve values of the deleted file from the cache.
+#include "FlashManager.hpp"
+#include "SystemEvents.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+
+static bool storageError()
+{
+    return (SystemEvents::Wait(0) & SystemEvents::STATE_STORAGE_ERROR) != 0;
+}
+
+int main()
+{
+    CHECK(SystemEvents::Init());
+    Host::ResetStorage();
+    FlashManager flash;
+
+    Host::FailMount(true);
+    CHECK(flash.HandleCommand("10") == "OP_ERROR");
+    CHECK(storageError());
+
+    // The next command mounts; a successful mount clears the state without a write.
+    Host::FailMount(false);
+    CHECK(flash.HandleCommand("10") == "OP_ERROR");
+    CHECK(!storageError());
+
+    // A TTL keeps the value in the data file; it is not cached until it is read.
+    CHECK(flash.HandleCommand("10:600|hello") == "OK");
+    Host::FailFileOpen(true);
+    CHECK(flash.HandleCommand("10") == "OP_ERROR");
+    CHECK(storageError());
+
+    Host::FailFileOpen(false);
+    CHECK(flash.HandleCommand("10") == "hello");
+    CHECK(!storageError());
+
+    // A clear that deletes the data file but fails to create the new one leaves no cached values behind.
+    Host::FailFileOpen(true);
+    CHECK(flash.HandleCommand("@") == "OP_ERROR");
+    CHECK(flash.HandleCommand("10") == "OP_ERROR");
+    Host::FailFileOpen(false);
+    CHECK(flash.HandleCommand("@") == "OK");
+    CHECK(flash.HandleCommand("10") == "OP_ERROR");
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Storage changes pushed to subscribed connections, and storage commands that do not wait for a
+// subscriber whose link is too slow to take the pushes.
+#include "BleManager.hpp"
+#include "BleClient.hpp"
+#include "CommandManager.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static constexpr int      WRITES   = 20;
+static constexpr size_t   VALUE    = 100;
+static constexpr uint16_t SLOW_INT = 0x0C80; ///< 4 s connection interval.
+static constexpr int64_t  MAX_US   = 500000;
+
+int main()
+{
+    Host::ResetStorage();
+    BleManager ble;
+    ble.Init();
+    BleClient::WaitForService();
+    CommandManager usb(CommandManager::TRANSPORT_USB);
+    CHECK(usb.ProcessCommand("tf@") == "OK");
+
+    // A subscriber receives writes and deletes of its keys in the record format of `#`.
+    BleClient fast;
+    CHECK(fast.Connect(1));
+    Host::BleExchangeMtu(fast.Id());
+    CHECK(fast.Command("ts100-1ff") == "OK");
+    std::string value(VALUE, 'v');
+    CHECK(usb.ProcessCommand("tf100|" + value) == "OK");
+    std::string pushed;
+    CHECK(Host::BleReceive(fast.Id(), pushed, 2000) && pushed == "c$256$" + value);
+    CHECK(usb.ProcessCommand("tf@100") == "OK");
+    CHECK(Host::BleReceive(fast.Id(), pushed, 2000) && pushed == "c$256$");
+    CHECK(usb.ProcessCommand("tf200|" + value) == "OK");
+    CHECK(!Host::BleReceive(fast.Id(), pushed, 200));
+
+    // A central on a 4 s interval congests after a few pushes; writes still complete without waiting for it.
+    Host::BleSetCentral({SLOW_INT, SLOW_INT, 27, 23});
+    BleClient slow;
+    CHECK(slow.Connect(2, SLOW_INT, 0, 3200));
+    CHECK(slow.Command("ts100-1ff", 10000) == "OK");
+    Latencies writes;
+    for (int i = 0; i < WRITES; ++i)
+    {
+        value.assign(VALUE, static_cast<char>('a' + i));
+        writes.Add(TimeUs([&] { CHECK(usb.ProcessCommand("tf100|" + value) == "OK"); }));
+    }
+    writes.Print("write");
+    CHECK(writes.Percentile(100) < MAX_US);
+    for (int i = 0; i < 100 && Host::BleStats(slow.Id()).congestions == 0; ++i)
+    {
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    CHECK(Host::BleStats(slow.Id()).congestions > 0);
+
+    // Once the slow central is gone the remaining pushes reach the other subscriber.
+    Host::BleDisconnect(slow.Id());
+    int received = 0;
+    while (Host::BleReceive(fast.Id(), pushed, 1000))
+    {
+        CHECK(pushed.rfind("c$256$", 0) == 0);
+        received++;
+    }
+    CHECK(received > 0);
+    Host::BleDisconnect(fast.Id());
+    Host::BleSync();
+    return 0;
+}
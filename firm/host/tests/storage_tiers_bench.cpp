@@ -0,0 +1,55 @@
+// Latency of small values in the NVS tier against the same values in the data file.
+//
+// A value written without a TTL goes to the NVS tier when it is short enough; a TTL keeps it in
+// the data file, so both paths are measured with identical keys and sizes. The host numbers
+// compare the work each path does (the data file is rewritten on every update), not flash timing.
+#include "FlashManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include <string>
+
+static constexpr int KEYS   = 32;
+static constexpr int ROUNDS = 8;
+
+int main()
+{
+    static_assert(CONFIG_APP_STORAGE_NVS_MAX_VALUE >= 17, "the NVS tier must hold the benchmark values");
+    Host::ResetStorage();
+    FlashManager flash;
+    CHECK(flash.HandleCommand("@") == "OK");
+
+    Latencies nvsWrite, nvsRead, fileWrite, fileRead;
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (int key = 0; key < KEYS; ++key)
+        {
+            char value[32]; // Fits any two ints; the values used here are 17 characters.
+            snprintf(value, sizeof(value), "value-%02d-%08d", key, round);
+
+            char nvsKey[8], fileKey[8];
+            snprintf(nvsKey, sizeof(nvsKey), "%x", 0x100 + key);
+            snprintf(fileKey, sizeof(fileKey), "%x", 0x200 + key);
+
+            std::string response;
+            nvsWrite.Add(TimeUs([&] { response = flash.HandleCommand(std::string(nvsKey) + "|" + value); }));
+            CHECK(response == "OK");
+            fileWrite.Add(TimeUs([&] { response = flash.HandleCommand(std::string(fileKey) + ":86400|" + value); }));
+            CHECK(response == "OK");
+
+            nvsRead.Add(TimeUs([&] { response = flash.HandleCommand(nvsKey); }));
+            CHECK(response == value);
+            fileRead.Add(TimeUs([&] { response = flash.HandleCommand(fileKey); }));
+            CHECK(response == value);
+        }
+    }
+
+    nvsWrite.Print("nvs write");
+    fileWrite.Print("file write");
+    nvsRead.Print("nvs read");
+    fileRead.Print("file read");
+    printf("tiers: %s\n", flash.HandleCommand("t").c_str());
+
+    // An NVS update is one entry write, a data file update rewrites the whole file.
+    CHECK(nvsWrite.Percentile(50) < fileWrite.Percentile(50));
+    return 0;
+}
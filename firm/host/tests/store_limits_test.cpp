@@ -0,0 +1,92 @@
+// Expiry across reboots and the byte limit of the data file.
+//
+// Expiry times are kept on the store clock, which resumes from the meta line after a reboot, so
+// a TTL neither restarts nor expires early when uptime starts over. A write is charged its real
+// line length, and one that cannot fit even after evicting every candidate fails up front
+// without evicting anything.
+#include "FlashManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include <cstring>
+#include <string>
+
+static constexpr int64_t SECOND = 1000000;
+
+// Printable bytes the codec cannot shrink, so line lengths are predictable.
+static std::string noise(size_t size, unsigned seed)
+{
+    std::string out(size, ' ');
+    uint32_t    state = seed * 2654435761u + 1;
+    for (char &c : out)
+    {
+        state = state * 1664525u + 1013904223u;
+        c     = static_cast<char>(' ' + (state >> 24) % 95);
+    }
+    return out;
+}
+
+// Reads a field of the `q` response.
+static unsigned long capacity(FlashManager &flash, int field)
+{
+    std::string response = flash.HandleCommand("q");
+    const char *p        = response.c_str();
+    for (int i = 0; i < field; ++i)
+    {
+        p = strchr(p, ',') + 1;
+    }
+    return strtoul(p, nullptr, 10);
+}
+
+int main()
+{
+    Host::ResetStorage();
+    Host::SetUptime(100 * SECOND);
+    {
+        FlashManager flash;
+        CHECK(flash.HandleCommand("@") == "OK");
+        CHECK(flash.HandleCommand("10:60|hello") == "OK");
+    }
+
+    // Uptime restarts at 0; the record has 60 s left on the store clock, not 160 s.
+    Host::SetUptime(0);
+    {
+        FlashManager flash;
+        CHECK(flash.HandleCommand("10") == "hello");
+        Host::SetUptime(59 * SECOND);
+        CHECK(flash.HandleCommand("10") == "hello");
+        Host::SetUptime(61 * SECOND);
+        CHECK(flash.HandleCommand("10") == "OP_ERROR");
+    }
+
+    Host::ResetStorage();
+    FlashManager flash;
+    CHECK(flash.HandleCommand("@") == "OK");
+    CHECK(flash.HandleCommand("q1,0,o") == "OK");
+    unsigned long limit = capacity(flash, 4);
+    CHECK(limit > 0);
+
+    // Writes are charged exactly, so the file never passes the limit while records are evicted.
+    for (int i = 0; i < 60; ++i)
+    {
+        char cmd[16];
+        snprintf(cmd, sizeof(cmd), "%x|", 0x100 + i);
+        CHECK(flash.HandleCommand(cmd + noise(400, i)) == "OK");
+        CHECK(capacity(flash, 1) <= limit);
+    }
+    unsigned long evicted = capacity(flash, 7);
+    unsigned long records = capacity(flash, 0);
+    CHECK(evicted > 0);
+
+    // A value larger than the limit evicts nothing.
+    CHECK(flash.HandleCommand("200|" + noise(limit, 0)) == "OP_ERROR");
+    CHECK(capacity(flash, 7) == evicted && capacity(flash, 0) == records);
+    CHECK(flash.HandleCommand("13b") == noise(400, 59));
+
+    // Without an eviction policy the write that does not fit fails and the file is unchanged.
+    CHECK(flash.HandleCommand("q1,0,n") == "OK");
+    unsigned long bytes = capacity(flash, 1);
+    CHECK(flash.HandleCommand("200|" + noise(400, 0)) == "OP_ERROR");
+    CHECK(capacity(flash, 1) == bytes && capacity(flash, 7) == evicted);
+    printf("limit %lu, %lu records in %lu bytes, %lu evicted\n", limit, records, bytes, evicted);
+    return 0;
+}
@@ -0,0 +1,123 @@
+// A full resync that spans several pages reaches the end even when live records are older than
+// the purged tombstones, and restarts only when more tombstones are purged while it is paged.
+#include "FlashManager.hpp"
+#include "Host.hpp"
+#include "HostTest.hpp"
+#include <cstring>
+#include <map>
+#include <string>
+
+static constexpr int RECORDS = 40;
+static constexpr int UPDATES = CONFIG_APP_STORAGE_TOMBSTONE_HORIZON + 44;
+
+/**
+ * @brief Header line of a page of `s<since>`.
+ */
+struct Page
+{
+    std::string next;
+    bool        more;
+    bool        reset;
+};
+
+static std::string value(int key, int version)
+{
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "key-%03x-version-%04d-", key, version);
+    std::string out = prefix;
+    out.resize(100, static_cast<char>('a' + key % 26));
+    return out;
+}
+
+// Applies one page to `mirror` and returns its header.
+static Page applyPage(const std::string &response, std::map<long, std::string> &mirror)
+{
+    Page        page = {};
+    size_t      end  = response.find('\n');
+    std::string head = response.substr(0, end);
+    char        next[32];
+    int         more = 0, reset = 0;
+    CHECK(sscanf(head.c_str(), "%*u,%31[^,],%d,%d", next, &more, &reset) == 3);
+    page.next  = next;
+    page.more  = more != 0;
+    page.reset = reset != 0;
+    if (page.reset)
+    {
+        mirror.clear();
+    }
+    while (end != std::string::npos)
+    {
+        size_t      start = end + 1;
+        end               = response.find('\n', start);
+        std::string line  = response.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        long        id    = strtol(line.c_str() + 2, nullptr, 10);
+        if (line[0] == 'x')
+        {
+            mirror.erase(id);
+        }
+        else
+        {
+            mirror[id] = line.substr(line.find('$', 2) + 1);
+        }
+    }
+    return page;
+}
+
+int main()
+{
+    Host::ResetStorage();
+    FlashManager flash;
+    CHECK(flash.HandleCommand("@") == "OK");
+
+    std::map<long, std::string> expected;
+    for (int i = 0; i < RECORDS; ++i)
+    {
+        char cmd[16];
+        snprintf(cmd, sizeof(cmd), "%x|", 0x100 + i);
+        CHECK(flash.HandleCommand(cmd + value(0x100 + i, 0)) == "OK");
+        expected[0x100 + i] = value(0x100 + i, 0);
+    }
+    CHECK(flash.HandleCommand("@100") == "OK");
+    expected.erase(0x100);
+
+    // Enough updates of one key to purge the tombstone, so the older records sit below the purge.
+    for (int i = 1; i <= UPDATES; ++i)
+    {
+        CHECK(flash.HandleCommand("101|" + value(0x101, i)) == "OK");
+    }
+    expected[0x101] = value(0x101, UPDATES);
+
+    std::map<long, std::string> mirror;
+    Page                        page  = applyPage(flash.HandleCommand("s0"), mirror);
+    int                         pages = 1;
+    CHECK(page.reset && page.more && page.next.find('r') != std::string::npos);
+    for (; page.more && pages < 100; ++pages)
+    {
+        page = applyPage(flash.HandleCommand("s" + page.next), mirror);
+        CHECK(!page.reset);
+    }
+    printf("resync of %zu records in %d pages\n", mirror.size(), pages);
+    CHECK(!page.more && pages > 2);
+    CHECK(mirror == expected);
+
+    // A tombstone purged while a resync is paged restarts it.
+    page = applyPage(flash.HandleCommand("s0"), mirror);
+    CHECK(flash.HandleCommand("@102") == "OK");
+    expected.erase(0x102);
+    for (int i = 1; i <= UPDATES; ++i)
+    {
+        CHECK(flash.HandleCommand("101|" + value(0x101, UPDATES + i)) == "OK");
+    }
+    expected[0x101] = value(0x101, 2 * UPDATES);
+    page = applyPage(flash.HandleCommand("s" + page.next), mirror);
+    CHECK(page.reset);
+    for (pages = 1; page.more && pages < 100; ++pages)
+    {
+        page = applyPage(flash.HandleCommand("s" + page.next), mirror);
+    }
+    CHECK(!page.more && mirror == expected);
+
+    // A plain cursor below the purged tombstones still resyncs.
+    CHECK(applyPage(flash.HandleCommand("s5"), mirror).reset);
+    return 0;
+}
@@ -0,0 +1,53 @@
+// Placement of the application tasks away from Bluedroid, and BLE commands answered by the command task.
+#include "BleManager.hpp"
+#include "LogTask.hpp"
+#include "TaskConfig.hpp"
+#include "BleClient.hpp"
+#include <cstring>
+
+int main()
+{
+    Host::ResetStorage();
+    LogTaskCreate();
+    BleManager ble;
+    ble.Init();
+    BleClient::WaitForService();
+
+    CHECK(Host::TaskCore("BTC_TASK") == CONFIG_BT_BLUEDROID_PINNED_TO_CORE);
+    for (int id = 0; id < TASK_COUNT; ++id)
+    {
+        const TaskConfig &config = TASK_CONFIGS[id];
+        if (id == TASK_USB)
+        {
+            continue; // Needs the UART driver, its table entry is checked by the static assertions.
+        }
+        CHECK(Host::TaskCore(config.name) == config.core);
+        CHECK(Host::TaskStackSize(config.name) == config.stack_size);
+    }
+    CHECK(Host::TaskCore("BleTask") == APP_CORE);
+    CHECK(APP_CORE != CONFIG_BT_BLUEDROID_PINNED_TO_CORE);
+
+    // Commands of several connections are answered, and the telemetry sees the command task on the application core.
+    BleClient clients[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        CHECK(clients[i].Connect(i + 1));
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        clients[i].Send("tc");
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        std::string response;
+        CHECK(Host::BleReceive(clients[i].Id(), response, 2000));
+        CHECK(response.rfind("0,", 0) == 0);
+    }
+    Host::BleExchangeMtu(clients[0].Id());
+    std::string report = clients[0].CommandAll("tm");
+    printf("%s\n", report.c_str());
+    char expected[32];
+    snprintf(expected, sizeof(expected), "\nBleTask,%d,", static_cast<int>(APP_CORE));
+    CHECK(report.find(expected) != std::string::npos);
+    return 0;
+}
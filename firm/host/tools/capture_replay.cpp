@@ -0,0 +1,45 @@
+// Replays a traffic capture against the host build and compares the responses.
+//
+//   capture_replay <export-file> [speed]
+//
+// The export file holds the output of `tre`. The replay starts from erased storage, so captures
+// should begin with `tf@` or otherwise rebuild the state their reads depend on. `speed` scales
+// the captured timing: 1 replays at the original pace, 10 ten times faster, 0 (the default)
+// without waiting. Prints the latency percentiles and every differing response; exits with 1
+// if any response differs.
+#include "CaptureReplay.hpp"
+#include "Host.hpp"
+#include <fstream>
+#include <sstream>
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s <export-file> [speed]\n", argv[0]);
+        return 2;
+    }
+    std::ifstream file(argv[1]);
+    if (!file)
+    {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 2;
+    }
+    std::stringstream hex;
+    hex << file.rdbuf();
+
+    std::vector<CaptureRecord> records;
+    if (!ParseCapture(hex.str(), records))
+    {
+        fprintf(stderr, "%s is not a capture export\n", argv[1]);
+        return 2;
+    }
+    double speed = (argc == 3) ? atof(argv[2]) : 0;
+
+    Host::ResetStorage();
+    ReplayResult result = ReplayCapture(records, speed, stdout);
+    result.latency.Print("latency");
+    printf("requests %zu, skipped %zu, diffs %zu, %lld ms\n", result.requests, result.skipped, result.diffs,
+           static_cast<long long>(result.elapsed / 1000));
+    return result.diffs == 0 ? 0 : 1;
+}
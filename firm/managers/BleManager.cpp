@@ -1,32 +1,43 @@
 #include "BleManager.hpp"
+#include "SystemEvents.hpp"
+#include "BootProfile.hpp"
+#include "Logger.hpp"
+#include "TaskConfig.hpp"
 #include "nvs_flash.h"
 #include "esp_bt.h"
 #include "esp_bt_main.h"
 #include "esp_gatt_common_api.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <cstring>
 
 BleManager *BleManager::instance = nullptr;
 
-const uint16_t BleManager::SERVICE_UUID                 = 0x00FF;
-const uint16_t BleManager::CHAR_UUID_WRITE              = 0xFF01;
-const uint16_t BleManager::CHAR_UUID_NOTIFY             = 0xFF02;
-const uint16_t BleManager::GATT_UUID_PRI_SERVICE        = 0x2800;
-const uint16_t BleManager::GATT_UUID_CHAR_DECLARE       = 0x2803;
-const uint16_t BleManager::GATT_UUID_CHAR_CLIENT_CONFIG = 0x2902;
-
 const uint16_t BleManager::INVALID_CONN_ID = 0xFFFF;
 const uint8_t  BleManager::PROFILE_APP_IDX = 0;
 const uint8_t  BleManager::SVC_INST_ID     = 0;
 
-uint8_t BleManager::char_prop_write  = ESP_GATT_CHAR_PROP_BIT_WRITE;
-uint8_t BleManager::char_prop_notify = ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+uint16_t BleManager::connection_ids[MAX_CONNECTIONS]             = {BleManager::INVALID_CONN_ID};
+bool     BleManager::notifications_enabled[MAX_CONNECTIONS]      = {false};
+bool     BleManager::bulk_notifications_enabled[MAX_CONNECTIONS] = {false};
+
+BleManager::KeyRange BleManager::subscriptions[MAX_CONNECTIONS][MAX_SUBSCRIPTIONS] = {};
+uint8_t              BleManager::subscription_count[MAX_CONNECTIONS]                = {0};
 
-uint16_t BleManager::connection_ids[MAX_CONNECTIONS]        = {BleManager::INVALID_CONN_ID};
-bool     BleManager::notifications_enabled[MAX_CONNECTIONS] = {false};
+esp_bd_addr_t         BleManager::connection_bdas[MAX_CONNECTIONS] = {};
+BleManager::LinkState BleManager::link_states[MAX_CONNECTIONS]     = {};
 
-static uint8_t  char_value_write[128]  = {0};
-static uint8_t  char_value_notify[128] = {0};
-static uint16_t ccc_value_notify       = 0x0000;
+const BleManager::ConnectionProfile BleManager::connection_profiles[PROFILE_COUNT] = {
+    {.min_int = 0x06, .max_int = 0x0C, .latency = 0, .timeout = 400, .tx_data_len = 251}, // Throughput: 7.5-15 ms, 4 s
+    {.min_int = 0x50, .max_int = 0xA0, .latency = 4, .timeout = 600, .tx_data_len = 27 }, // Low power: 100-200 ms, 6 s
+};
+uint8_t BleManager::default_profile = BleManager::PROFILE_THROUGHPUT;
+
+static const uint16_t LOCAL_MTU        = 247; ///< Fits one ATT packet in an extended 251-byte link layer PDU.
+static const uint16_t DEFAULT_DATA_LEN = 27;  ///< LE data length before extension.
+static const uint16_t DEFAULT_MTU      = 23;  ///< ATT MTU before the exchange.
+static const uint16_t NOTIFY_OVERHEAD  = 3;   ///< ATT opcode and handle bytes of a notification.
 
 uint8_t BleManager::adv_data[] = {0x02, 0x01, 0x06, 0x03, 0x03, 0xFF, 0x00, 0x0A, 0x09, 'E', 'S', 'P', '3', '2', '_', 'B', 'L', 'E'};
 
@@ -41,28 +52,9 @@ esp_ble_adv_params_t BleManager::adv_params = {
     .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 };
 
-esp_gatts_attr_db_t BleManager::gatt_db[] = {
-    {{ESP_GATT_AUTO_RSP},
-     {ESP_UUID_LEN_16, (uint8_t *)&BleManager::GATT_UUID_PRI_SERVICE, ESP_GATT_PERM_READ, sizeof(SERVICE_UUID), sizeof(SERVICE_UUID),
-     (uint8_t *)&SERVICE_UUID}                      },
-    {{ESP_GATT_AUTO_RSP},
-     {ESP_UUID_LEN_16, (uint8_t *)&BleManager::GATT_UUID_CHAR_DECLARE, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t),
-     (uint8_t *)&BleManager::char_prop_write}       },
-    {{ESP_GATT_AUTO_RSP},
-     {ESP_UUID_LEN_16, (uint8_t *)&BleManager::CHAR_UUID_WRITE, ESP_GATT_PERM_WRITE, sizeof(char_value_write), sizeof(char_value_write),
-     char_value_write}                              },
-    {{ESP_GATT_AUTO_RSP},
-     {ESP_UUID_LEN_16, (uint8_t *)&BleManager::GATT_UUID_CHAR_DECLARE, ESP_GATT_PERM_READ, sizeof(uint8_t), sizeof(uint8_t),
-     (uint8_t *)&BleManager::char_prop_notify}      },
-    {{ESP_GATT_AUTO_RSP},
-     {ESP_UUID_LEN_16, (uint8_t *)&BleManager::CHAR_UUID_NOTIFY, ESP_GATT_PERM_READ, sizeof(char_value_notify), sizeof(char_value_notify),
-     char_value_notify}                             },
-    {{ESP_GATT_AUTO_RSP},
-     {ESP_UUID_LEN_16, (uint8_t *)&BleManager::GATT_UUID_CHAR_CLIENT_CONFIG, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(uint16_t),
-     sizeof(uint16_t), (uint8_t *)&ccc_value_notify}},
-};
+const std::array<esp_gatts_attr_db_t, BleManager::GattService::ATTR_COUNT> BleManager::gatt_db = BleManager::GattService::Table();
 
-BleManager::BleManager() : notify_handle(0), gatts_if_global(0), notification_in_progress(false), resource_mutex(nullptr)
+BleManager::BleManager() : commandManager(CommandManager::TRANSPORT_BLE), attr_handles{0}, gatts_if_global(0), notification_in_progress(false), resource_mutex(nullptr), link_ready(nullptr), notify_mutexes{}, command_task(nullptr), change_head(0), change_count(0)
 {
     if (instance == nullptr)
     {
@@ -70,8 +62,11 @@ BleManager::BleManager() : notify_handle(0), gatts_if_global(0), notification_in
     }
     for (int i = 0; i < MAX_CONNECTIONS; ++i)
     {
-        connection_ids[i]        = INVALID_CONN_ID;
-        notifications_enabled[i] = false;
+        connection_ids[i]             = INVALID_CONN_ID;
+        notifications_enabled[i]      = false;
+        bulk_notifications_enabled[i] = false;
+        subscription_count[i]         = 0;
+        pending[i].waiting            = false;
     }
 }
 
@@ -82,6 +77,15 @@ BleManager::~BleManager()
         vSemaphoreDelete(resource_mutex);
         resource_mutex = nullptr;
     }
+    if (link_ready != nullptr)
+    {
+        for (int i = 0; i < MAX_CONNECTIONS; ++i)
+        {
+            vSemaphoreDelete(notify_mutexes[i]);
+        }
+        vEventGroupDelete(link_ready);
+        link_ready = nullptr;
+    }
     instance = nullptr;
 }
 
@@ -102,6 +106,7 @@ void BleManager::Init()
         {
             break;
         }
+        BootProfile::Mark(BootProfile::PHASE_NVS_READY);
 
         ret = esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT);
         if (ret != ESP_OK)
@@ -132,16 +137,41 @@ void BleManager::Init()
         {
             break;
         }
+        BootProfile::Mark(BootProfile::PHASE_BT_READY);
 
         if (resource_mutex == nullptr)
         {
-            resource_mutex = xSemaphoreCreateMutex();
+            resource_mutex = xSemaphoreCreateMutexStatic(&resource_mutex_buffer);
             if (resource_mutex == nullptr)
             {
                 break;
             }
         }
 
+        if (link_ready == nullptr)
+        {
+            link_ready = xEventGroupCreateStatic(&link_ready_buffer);
+            if (link_ready == nullptr)
+            {
+                break;
+            }
+            for (int i = 0; i < MAX_CONNECTIONS; ++i)
+            {
+                notify_mutexes[i] = xSemaphoreCreateMutexStatic(&notify_mutex_buffers[i]);
+            }
+        }
+
+        if (command_task == nullptr && TaskCreate(TASK_BLE, CommandTaskStatic, this, &command_task) != pdPASS)
+        {
+            break;
+        }
+
+        ret = esp_ble_gap_register_callback(GAPCallbackStatic);
+        if (ret != ESP_OK)
+        {
+            break;
+        }
+
         ret = esp_ble_gatts_register_callback(GATTSCallbackStatic);
         if (ret != ESP_OK)
         {
@@ -154,7 +184,15 @@ void BleManager::Init()
             break;
         }
 
+        ret = esp_ble_gatt_set_local_mtu(LOCAL_MTU);
+        if (ret != ESP_OK)
+        {
+            break;
+        }
+
         commandManager.Init();
+        commandManager.SetStorageListener(StorageChangedStatic, this);
+        commandManager.SetTransportHandler(TransportCommandStatic, this);
 
     } while (0);
 }
@@ -167,6 +205,45 @@ void BleManager::GATTSCallbackStatic(esp_gatts_cb_event_t event, esp_gatt_if_t g
     }
 }
 
+void BleManager::GAPCallbackStatic(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+    if (instance != nullptr)
+    {
+        instance->GAPCallback(event, param);
+    }
+}
+
+void BleManager::GAPCallback(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+    switch (event)
+    {
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+        {
+            int index = FindConnection(param->update_conn_params.bda);
+            if (index >= 0 && param->update_conn_params.status == ESP_BT_STATUS_SUCCESS)
+            {
+                link_states[index].interval = param->update_conn_params.conn_int;
+                link_states[index].latency  = param->update_conn_params.latency;
+                link_states[index].timeout  = param->update_conn_params.timeout;
+            }
+            break;
+        }
+
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+        {
+            int index = FindConnection(param->pkt_data_length_cmpl.remote_bd_addr);
+            if (index >= 0 && param->pkt_data_length_cmpl.status == ESP_BT_STATUS_SUCCESS)
+            {
+                link_states[index].tx_len = param->pkt_data_length_cmpl.params.tx_len;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
 void BleManager::GATTSCallback(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
 {
     switch (event)
@@ -174,25 +251,38 @@ void BleManager::GATTSCallback(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_i
         case ESP_GATTS_REG_EVT:
             esp_ble_gap_set_device_name("ESP32_BLE");
             esp_ble_gap_config_adv_data_raw(adv_data, sizeof(adv_data));
-            esp_ble_gatts_create_attr_tab(gatt_db, gatts_if, sizeof(gatt_db) / sizeof(gatt_db[0]), SVC_INST_ID);
+            esp_ble_gatts_create_attr_tab(gatt_db.data(), gatts_if, gatt_db.size(), SVC_INST_ID);
             gatts_if_global = gatts_if;
             break;
 
         case ESP_GATTS_CREAT_ATTR_TAB_EVT:
-            if (param->add_attr_tab.status == ESP_GATT_OK)
+            if (param->add_attr_tab.status == ESP_GATT_OK && param->add_attr_tab.num_handle == GattService::ATTR_COUNT)
             {
-                esp_ble_gatts_start_service(param->add_attr_tab.handles[0]);
-                notify_handle = param->add_attr_tab.handles[4];
+                memcpy(attr_handles, param->add_attr_tab.handles, sizeof(attr_handles));
+                esp_ble_gatts_start_service(attr_handles[IDX_SERVICE]);
                 esp_ble_gap_start_advertising(&adv_params);
+                BootProfile::Mark(BootProfile::PHASE_ADVERTISING);
             }
             break;
 
         case ESP_GATTS_CONNECT_EVT:
-            AddConnection(param->connect.conn_id);
+        {
+            Logger::Log(LOG_BLE_CONNECT, param->connect.conn_id);
+            int index = AddConnection(param->connect.conn_id, param->connect.remote_bda);
+            if (index >= 0)
+            {
+                // The link runs with the central's parameters until an update completes, or for good if it rejects the profile.
+                link_states[index].interval = param->connect.conn_params.interval;
+                link_states[index].latency  = param->connect.conn_params.latency;
+                link_states[index].timeout  = param->connect.conn_params.timeout;
+                RequestConnectionProfile(index);
+            }
             esp_ble_gap_start_advertising(&adv_params);
             break;
+        }
 
         case ESP_GATTS_DISCONNECT_EVT:
+            Logger::Log(LOG_BLE_DISCONNECT, param->disconnect.conn_id, param->disconnect.reason);
             RemoveConnection(param->disconnect.conn_id);
             esp_ble_gap_start_advertising(&adv_params);
             break;
@@ -201,6 +291,35 @@ void BleManager::GATTSCallback(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_i
             HandleWriteEvent(param->write);
             break;
 
+        case ESP_GATTS_MTU_EVT:
+        {
+            Logger::Log(LOG_BLE_MTU, param->mtu.conn_id, param->mtu.mtu);
+            int index = FindConnection(param->mtu.conn_id);
+            if (index >= 0)
+            {
+                link_states[index].mtu = param->mtu.mtu;
+            }
+            break;
+        }
+
+        case ESP_GATTS_CONGEST_EVT:
+        {
+            int index = FindConnection(param->congest.conn_id);
+            if (index >= 0)
+            {
+                link_states[index].congested = param->congest.congested;
+                if (param->congest.congested)
+                {
+                    xEventGroupClearBits(link_ready, 1 << index);
+                }
+                else
+                {
+                    xEventGroupSetBits(link_ready, 1 << index);
+                }
+            }
+            break;
+        }
+
         default:
             break;
     }
@@ -208,63 +327,481 @@ void BleManager::GATTSCallback(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_i
 
 void BleManager::HandleWriteEvent(const esp_ble_gatts_cb_param_t::gatts_write_evt_param &write)
 {
-    if (write.handle == (notify_handle + 1))
+    Logger::Log(LOG_BLE_WRITE, write.conn_id, write.handle, write.len);
+    if (write.handle == attr_handles[IDX_NOTIFY_CCCD])
+    {
+        UpdateNotificationState(write, notifications_enabled);
+    }
+    else if (write.handle == attr_handles[IDX_BULK_CCCD])
+    {
+        UpdateNotificationState(write, bulk_notifications_enabled);
+    }
+    else if ((write.handle == attr_handles[IDX_CMD_VALUE] || write.handle == attr_handles[IDX_BULK_VALUE]) && write.len <= COMMAND_MAX_LEN)
     {
-        if (write.len == 2)
+        // Commands run on the command task; the BTC task only admits them, copies them into the
+        // slot of their connection and goes back to the stack.
+        uint16_t                 attr_index = (write.handle == attr_handles[IDX_CMD_VALUE]) ? IDX_NOTIFY_VALUE : IDX_BULK_VALUE;
+        std::string_view         cmd(reinterpret_cast<const char *>(write.value), write.len);
+        CommandScheduler::Ticket ticket;
+        int                      index = FindConnection(write.conn_id);
+        do
         {
-            uint16_t ccc_value = (write.value[1] << 8) | write.value[0];
-            for (int i = 0; i < MAX_CONNECTIONS; ++i)
+            if (index < 0)
             {
-                if (connection_ids[i] == write.conn_id)
-                {
-                    notifications_enabled[i] = (ccc_value == 0x0001);
-                    break;
-                }
+                break;
             }
+            if (pending[index].waiting)
+            {
+                // Clients wait for each response, so only one that ignores them finds its slot taken.
+                char busy[16];
+                int  len = snprintf(busy, sizeof(busy), "BUSY,%u", static_cast<unsigned>(BUSY_RETRY_MS));
+                SendNotification(busy, len, write.conn_id, attr_index, false);
+                break;
+            }
+            if (!commandManager.AdmitCommand(cmd, write.conn_id, ticket, rejected))
+            {
+                SendNotification(rejected.data(), rejected.size(), write.conn_id, attr_index, false);
+                break;
+            }
+            if (xSemaphoreTake(resource_mutex, portMAX_DELAY) != pdTRUE)
+            {
+                break;
+            }
+            PendingCommand &slot = pending[index];
+            slot.conn_id         = write.conn_id;
+            slot.attr_index      = attr_index;
+            slot.len             = write.len;
+            slot.ticket          = ticket;
+            memcpy(slot.data, write.value, write.len);
+            slot.waiting = true;
+            xSemaphoreGive(resource_mutex);
+            xTaskNotifyGive(command_task);
+        } while (0);
+    }
+}
+
+void BleManager::CommandTaskStatic(void *param)
+{
+    static_cast<BleManager *>(param)->CommandTask();
+}
+
+void BleManager::CommandTask()
+{
+    // Reused for every command, so get and put commands leave the heap alone once it has grown.
+    response.reserve(COMMAND_MAX_LEN);
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bool pending = true;
+        while (pending)
+        {
+            pending = PushQueuedChange();
+            pending = RunQueuedCommand() || pending;
         }
     }
-    else if (write.handle == notify_handle - 2)
+}
+
+bool BleManager::RunQueuedCommand()
+{
+    if (xSemaphoreTake(resource_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return false;
+    }
+    // Same order as the scheduler gate, so a connection that sends a lot waits behind the others.
+    PendingCommand *next = nullptr;
+    for (PendingCommand &slot : pending)
+    {
+        if (slot.waiting && (next == nullptr || slot.ticket.tag < next->ticket.tag))
+        {
+            next = &slot;
+        }
+    }
+    if (next != nullptr)
+    {
+        current       = *next;
+        next->waiting = false;
+    }
+    xSemaphoreGive(resource_mutex);
+    if (next == nullptr)
+    {
+        return false;
+    }
+
+    BlobStore::View  view;
+    std::string_view cmd(current.data, current.len);
+    commandManager.RunCommand(cmd, current.ticket, response, current.conn_id, &view);
+    if (view.Valid() && view.Size() > VIEW_WINDOW)
+    {
+        if (cmd.substr(0, 3) == "tfr")
+        {
+            view.Slice(0, VIEW_WINDOW);
+        }
+        else
+        {
+            char tooLarge[24];
+            int  len = snprintf(tooLarge, sizeof(tooLarge), "TOO_LARGE,%u", static_cast<unsigned>(view.Size()));
+            view.Reset();
+            response.assign(tooLarge, len);
+        }
+    }
+    if (view.Valid())
+    {
+        // Notified straight from the flash mapping; the view is released once the stack has copied it.
+        SendNotification(view.Data(), view.Size(), current.conn_id, current.attr_index);
+    }
+    else
+    {
+        SendNotification(response.data(), response.size(), current.conn_id, current.attr_index);
+    }
+    return true;
+}
+
+bool BleManager::PushQueuedChange()
+{
+    uint16_t targets[MAX_CONNECTIONS];
+    int      target_count = 0;
+    if (xSemaphoreTake(resource_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return false;
+    }
+    bool found = change_count > 0;
+    if (found)
+    {
+        // Swapped out, so both buffers keep their capacity.
+        PendingChange &change = changes[change_head];
+        pushed.swap(change.update);
+        target_count = change.target_count;
+        std::copy(change.targets, change.targets + target_count, targets);
+        change_head = (change_head + 1) % CHANGE_QUEUE_LEN;
+        change_count--;
+    }
+    xSemaphoreGive(resource_mutex);
+
+    for (int i = 0; i < target_count; ++i)
+    {
+        SendNotification(pushed.data(), pushed.size(), targets[i], IDX_NOTIFY_VALUE);
+    }
+    return found;
+}
+
+bool BleManager::TransportCommandStatic(std::string_view cmd, std::string &response, uint16_t conn_id, void *context)
+{
+    return static_cast<BleManager *>(context)->TransportCommand(cmd, response, conn_id);
+}
+
+bool BleManager::TransportCommand(std::string_view cmd, std::string &response, uint16_t conn_id)
+{
+    if (cmd.substr(0, 2) == "ts" || cmd == "tu")
+    {
+        response.assign(HandleSubscriptionCommand(cmd, conn_id));
+        return true;
+    }
+    if (cmd.substr(0, 2) == "tp" || cmd == "tc")
     {
-        std::string input(reinterpret_cast<const char *>(write.value), write.len);
-        std::string response = commandManager.ProcessCommand(input);
-        SendNotification(response, write.conn_id);
+        response.assign(HandleProfileCommand(cmd, conn_id));
+        return true;
     }
+    return false;
 }
 
-void BleManager::SendNotification(const std::string &response, uint16_t conn_id)
+std::string BleManager::HandleSubscriptionCommand(std::string_view cmd, uint16_t conn_id)
 {
+    auto parseKey = [](std::string_view s, long &id)
+    {
+        if (s.empty() || s.find_first_not_of("0123456789abcdefABCDEF") != std::string_view::npos)
+        {
+            return false;
+        }
+        // Saturates like `strtol`.
+        unsigned long value = 0;
+        for (char c : s)
+        {
+            unsigned long digit = (c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10;
+            value               = (value > (LONG_MAX - digit) / 16) ? LONG_MAX : value * 16 + digit;
+        }
+        id = static_cast<long>(value);
+        return true;
+    };
+
+    std::string code = "SYNTAX_ERROR";
     do
     {
-        if (notify_handle == 0)
+        KeyRange range = {0, 0};
+        if (cmd != "tu")
         {
-            break;
+            std::string_view arg = cmd.substr(2);
+            size_t           pos = arg.find('-');
+            if (pos == std::string_view::npos)
+            {
+                if (!parseKey(arg, range.first))
+                {
+                    break;
+                }
+                range.last = range.first;
+            }
+            else if (!parseKey(arg.substr(0, pos), range.first) || !parseKey(arg.substr(pos + 1), range.last) || range.last < range.first)
+            {
+                break;
+            }
         }
 
         if (xSemaphoreTake(resource_mutex, portMAX_DELAY) != pdTRUE)
         {
+            code = "OP_ERROR";
             break;
         }
 
+        code = "OP_ERROR";
         for (int i = 0; i < MAX_CONNECTIONS; ++i)
         {
-            if (connection_ids[i] == conn_id && notifications_enabled[i])
+            if (connection_ids[i] != conn_id)
+            {
+                continue;
+            }
+            if (cmd == "tu")
+            {
+                subscription_count[i] = 0;
+                code                  = "OK";
+            }
+            else if (subscription_count[i] < MAX_SUBSCRIPTIONS)
+            {
+                subscriptions[i][subscription_count[i]++] = range;
+                code                                      = "OK";
+            }
+            break;
+        }
+        xSemaphoreGive(resource_mutex);
+    } while (0);
+    return code;
+}
+
+std::string BleManager::HandleProfileCommand(std::string_view cmd, uint16_t conn_id)
+{
+    std::string code = "SYNTAX_ERROR";
+    do
+    {
+        uint8_t profile = 0;
+        if (cmd != "tc")
+        {
+            if (cmd.size() != 3 || cmd[2] < '0' || cmd[2] >= '0' + PROFILE_COUNT)
+            {
+                break;
+            }
+            profile = cmd[2] - '0';
+        }
+
+        code = "OP_ERROR";
+        for (int i = 0; i < MAX_CONNECTIONS; ++i)
+        {
+            if (connection_ids[i] != conn_id)
+            {
+                continue;
+            }
+            if (cmd == "tc")
+            {
+                const LinkState &link = link_states[i];
+                code = std::to_string(link.profile) + "," + std::to_string(link.interval) + "," + std::to_string(link.latency) + "," +
+                       std::to_string(link.timeout) + "," + std::to_string(link.tx_len) + "," + std::to_string(link.mtu) + "," +
+                       std::to_string(link.congested ? 1 : 0);
+            }
+            else
+            {
+                link_states[i].profile = profile;
+                RequestConnectionProfile(i);
+                code = "OK";
+            }
+            break;
+        }
+    } while (0);
+    return code;
+}
+
+void BleManager::RequestConnectionProfile(int index)
+{
+    const ConnectionProfile &profile = connection_profiles[link_states[index].profile];
+
+    esp_ble_gap_set_pkt_data_len(connection_bdas[index], profile.tx_data_len);
+
+    esp_ble_conn_update_params_t conn_params = {};
+    memcpy(conn_params.bda, connection_bdas[index], sizeof(esp_bd_addr_t));
+    conn_params.min_int = profile.min_int;
+    conn_params.max_int = profile.max_int;
+    conn_params.latency = profile.latency;
+    conn_params.timeout = profile.timeout;
+    esp_ble_gap_update_conn_params(&conn_params);
+}
+
+int BleManager::FindConnection(const esp_bd_addr_t bda) const
+{
+    for (int i = 0; i < MAX_CONNECTIONS; ++i)
+    {
+        if (connection_ids[i] != INVALID_CONN_ID && memcmp(connection_bdas[i], bda, sizeof(esp_bd_addr_t)) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int BleManager::FindConnection(uint16_t conn_id) const
+{
+    for (int i = 0; i < MAX_CONNECTIONS; ++i)
+    {
+        if (connection_ids[i] == conn_id)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void BleManager::StorageChangedStatic(long id, const char *data, size_t size, void *context)
+{
+    static_cast<BleManager *>(context)->StorageChanged(id, data, size);
+}
+
+void BleManager::StorageChanged(long id, const char *data, size_t size)
+{
+    uint16_t targets[MAX_CONNECTIONS];
+    int      target_count = 0;
+
+    if (xSemaphoreTake(resource_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+    for (int i = 0; i < MAX_CONNECTIONS; ++i)
+    {
+        if (connection_ids[i] == INVALID_CONN_ID)
+        {
+            continue;
+        }
+        for (int j = 0; j < subscription_count[i]; ++j)
+        {
+            if (id == FlashManager::ALL_RECORDS || (id >= subscriptions[i][j].first && id <= subscriptions[i][j].last))
             {
-                uint16_t len  = response.size();
-                uint8_t *data = new uint8_t[len];
-                memcpy(data, response.c_str(), len);
+                targets[target_count++] = connection_ids[i];
+                break;
+            }
+        }
+    }
 
-                esp_ble_gatts_send_indicate(gatts_if_global, conn_id, notify_handle, len, data, false);
+    // Large values are only copied into a notification when someone is subscribed.
+    bool queued = target_count > 0 && change_count < CHANGE_QUEUE_LEN;
+    if (queued)
+    {
+        PendingChange &change = changes[(change_head + change_count) % CHANGE_QUEUE_LEN];
+        std::copy(targets, targets + target_count, change.targets);
+        change.target_count = target_count;
 
-                delete[] data;
+        // Pushed values use the record format of `#`; an empty value means the key was deleted and `@` means the store was cleared.
+        if (id == FlashManager::ALL_RECORDS)
+        {
+            change.update.assign("@");
+        }
+        else
+        {
+            char prefix[24];
+            int  len = snprintf(prefix, sizeof(prefix), "c$%ld$", id);
+            change.update.assign(prefix, len);
+        }
+        if (data != nullptr)
+        {
+            change.update.append(data, size);
+        }
+        change_count++;
+    }
+    else
+    {
+        for (int i = 0; i < target_count; ++i)
+        {
+            Logger::Log(LOG_BLE_NOTIFY_DROPPED, targets[i], size);
+        }
+    }
+    xSemaphoreGive(resource_mutex);
+
+    if (queued && command_task != nullptr)
+    {
+        xTaskNotifyGive(command_task);
+    }
+}
+
+void BleManager::UpdateNotificationState(const esp_ble_gatts_cb_param_t::gatts_write_evt_param &write, bool *enabled)
+{
+    if (write.len == 2)
+    {
+        uint16_t ccc_value = (write.value[1] << 8) | write.value[0];
+        for (int i = 0; i < MAX_CONNECTIONS; ++i)
+        {
+            if (connection_ids[i] == write.conn_id)
+            {
+                enabled[i] = (ccc_value == 0x0001);
                 break;
             }
         }
+    }
+}
+
+void BleManager::SendNotification(const char *response, size_t size, uint16_t conn_id, size_t attr_index, bool pace)
+{
+    do
+    {
+        uint16_t handle = attr_handles[attr_index];
+        if (handle == 0)
+        {
+            break;
+        }
+
+        const bool *enabled = (attr_index == IDX_BULK_VALUE) ? bulk_notifications_enabled : notifications_enabled;
+
+        if (xSemaphoreTake(resource_mutex, portMAX_DELAY) != pdTRUE)
+        {
+            break;
+        }
+
+        int      index = FindConnection(conn_id);
+        uint16_t chunk = (index >= 0) ? link_states[index].mtu - NOTIFY_OVERHEAD : 0;
+        bool     send  = index >= 0 && enabled[index];
         xSemaphoreGive(resource_mutex);
+        if (!send || xSemaphoreTake(notify_mutexes[index], pace ? portMAX_DELAY : 0) != pdTRUE)
+        {
+            break;
+        }
+
+        const EventBits_t ready    = 1 << index;
+        size_t            offset   = 0;
+        TickType_t        progress = xTaskGetTickCount();
+        do
+        {
+            // The stack copies the value before returning, so it is sent straight from the response.
+            uint16_t len  = std::min<size_t>(chunk, size - offset);
+            uint8_t *data = reinterpret_cast<uint8_t *>(const_cast<char *>(response + offset));
+
+            if (!link_states[index].congested && esp_ble_gatts_send_indicate(gatts_if_global, conn_id, handle, len, data, false) == ESP_OK)
+            {
+                offset += len;
+                progress = xTaskGetTickCount();
+                continue;
+            }
+            if (!pace || connection_ids[index] != conn_id || xTaskGetTickCount() - progress >= NOTIFY_STALL_TICKS)
+            {
+                Logger::Log(LOG_BLE_NOTIFY_DROPPED, conn_id, size - offset);
+                break;
+            }
+            // Refused without a congestion report, e.g. with the BTC queue full: the timeout is the back-off.
+            // Otherwise the bit is set again by the congestion event that ends it.
+            if (!link_states[index].congested)
+            {
+                xEventGroupClearBits(link_ready, ready);
+            }
+            xEventGroupWaitBits(link_ready, ready, pdFALSE, pdTRUE, NOTIFY_BACKOFF_TICKS);
+        } while (offset < size);
+        xSemaphoreGive(notify_mutexes[index]);
     } while (0);
 }
 
-void BleManager::AddConnection(uint16_t conn_id)
+int BleManager::AddConnection(uint16_t conn_id, const esp_bd_addr_t bda)
 {
+    int index = -1;
     do
     {
         if (conn_id == INVALID_CONN_ID)
@@ -277,10 +814,19 @@ void BleManager::AddConnection(uint16_t conn_id)
             if (connection_ids[i] == INVALID_CONN_ID)
             {
                 connection_ids[i] = conn_id;
+                memcpy(connection_bdas[i], bda, sizeof(esp_bd_addr_t));
+                link_states[i]         = {};
+                link_states[i].profile = default_profile;
+                link_states[i].tx_len  = DEFAULT_DATA_LEN;
+                link_states[i].mtu     = DEFAULT_MTU;
+                index                  = i;
+                xEventGroupSetBits(link_ready, 1 << i);
+                SystemEvents::SetState(SystemEvents::STATE_BLE_CONNECTED, true);
                 break;
             }
         }
     } while (0);
+    return index;
 }
 
 void BleManager::RemoveConnection(uint16_t conn_id)
@@ -289,9 +835,26 @@ void BleManager::RemoveConnection(uint16_t conn_id)
     {
         if (connection_ids[i] == conn_id)
         {
-            connection_ids[i]        = INVALID_CONN_ID;
-            notifications_enabled[i] = false;
+            connection_ids[i]             = INVALID_CONN_ID;
+            notifications_enabled[i]      = false;
+            bulk_notifications_enabled[i] = false;
+            subscription_count[i]         = 0;
+            link_states[i].congested      = false;
+            if (xSemaphoreTake(resource_mutex, portMAX_DELAY) == pdTRUE)
+            {
+                // A command left by the connection is dropped; its connection ID may be reused.
+                pending[i].waiting = false;
+                xSemaphoreGive(resource_mutex);
+            }
+            xEventGroupSetBits(link_ready, 1 << i); // Wakes a sender waiting on the link, which then gives up.
             break;
         }
     }
+
+    bool connected = false;
+    for (int i = 0; i < MAX_CONNECTIONS; ++i)
+    {
+        connected = connected || (connection_ids[i] != INVALID_CONN_ID);
+    }
+    SystemEvents::SetState(SystemEvents::STATE_BLE_CONNECTED, connected);
 }
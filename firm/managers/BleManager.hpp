@@ -1,10 +1,15 @@
 #ifndef BLE_MANAGER_HPP
 #define BLE_MANAGER_HPP
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include "CommandManager.hpp"
+#include "GattTable.hpp"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "esp_gatts_api.h"
 #include "esp_gap_ble_api.h"
 #include "esp_bt.h"
@@ -16,6 +21,15 @@
 class BleManager
 {
   public:
+    /**
+     * @brief Longest value a storage read sends from the blob partition.
+     *
+     * The command task serves every connection and the value's bank stays pinned while it is
+     * sent, so a read of a longer value is answered with `TOO_LARGE,<size>` and clients read it
+     * in slices with `tfr<key>,<offset>,<length>`; a `tfr` slice is cut to this length.
+     */
+    static constexpr size_t VIEW_WINDOW = 4096;
+
     /**
      * @brief Constructs a new BleManager object.
      */
@@ -40,6 +54,20 @@ class BleManager
      */
     static void GATTSCallbackStatic(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 
+    /**
+     * @brief Static GAP callback function.
+     * @param event The GAP event type.
+     * @param param Pointer to the event parameters.
+     */
+    static void GAPCallbackStatic(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+    /**
+     * @brief Instance GAP callback handler.
+     * @param event The GAP event type.
+     * @param param Pointer to the event parameters.
+     */
+    void GAPCallback(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
     /**
      * @brief Instance GATT Server callback handler.
      * @param event The GATT server event type.
@@ -54,17 +82,145 @@ class BleManager
      */
     void HandleWriteEvent(const esp_ble_gatts_cb_param_t::gatts_write_evt_param &write);
 
+    /**
+     * @brief Static entry point of the command task.
+     * @param param Pointer to the BleManager instance.
+     */
+    static void CommandTaskStatic(void *param);
+
+    /**
+     * @brief Runs the commands queued by `HandleWriteEvent` and pushes the storage changes queued
+     * by `StorageChanged`, taking turns between the two.
+     *
+     * Runs on `APP_CORE`, so command processing and storage never block the BTC task of Bluedroid.
+     */
+    void CommandTask();
+
+    /**
+     * @brief Runs the waiting command with the lowest virtual finish time and notifies its response.
+     * @return `false` if no command was waiting.
+     */
+    bool RunQueuedCommand();
+
+    /**
+     * @brief Pushes the oldest queued storage change to its subscribers.
+     * @return `false` if no change was queued.
+     */
+    bool PushQueuedChange();
+
+    /**
+     * @brief Static transport command callback of the command manager.
+     * @param cmd Trimmed command string.
+     * @param response Result code, set when the command is handled.
+     * @param conn_id The connection ID the command was received on.
+     * @param context Pointer to the BleManager instance.
+     * @return `true` if the command is a BLE command.
+     */
+    static bool TransportCommandStatic(std::string_view cmd, std::string &response, uint16_t conn_id, void *context);
+
+    /**
+     * @brief Handles the commands that concern the BLE connection itself.
+     * @param cmd Trimmed command string.
+     * @param response Result code, set when the command is handled.
+     * @param conn_id The connection ID the command was received on.
+     * @return `true` if the command is a BLE command, `false` for every other command.
+     *
+     * Called by the command manager, so these commands are rate limited and captured too:
+     * - `ts<key>`          : Subscribes to changes of the given key (hexadecimal).
+     * - `ts<first>-<last>` : Subscribes to changes of every key in the inclusive range.
+     * - `tu`               : Removes all subscriptions of the connection.
+     * - `tp<profile>`      : Selects the connection profile (0 throughput, 1 low power) and renegotiates the link.
+     * - `tc`               : Returns `<profile>,<interval>,<latency>,<timeout>,<tx_len>,<mtu>,<congested>` for the connection.
+     */
+    bool TransportCommand(std::string_view cmd, std::string &response, uint16_t conn_id);
+
+    /**
+     * @brief Handles a subscription command.
+     * @param cmd Command string without trailing line terminators.
+     * @param conn_id The connection ID the command was received on.
+     * @return Result code after processing the command.
+     */
+    std::string HandleSubscriptionCommand(std::string_view cmd, uint16_t conn_id);
+
+    /**
+     * @brief Handles a connection profile command.
+     * @param cmd Command string without trailing line terminators.
+     * @param conn_id The connection ID the command was received on.
+     * @return Result code or link status after processing the command.
+     */
+    std::string HandleProfileCommand(std::string_view cmd, uint16_t conn_id);
+
+    /**
+     * @brief Requests the data length and connection parameters of the connection profile.
+     * @param index Index of the connection in the connection list.
+     */
+    void RequestConnectionProfile(int index);
+
+    /**
+     * @brief Finds a connection by its remote address.
+     * @param bda The remote device address.
+     * @return Index in the connection list, or -1 if not found.
+     */
+    int FindConnection(const esp_bd_addr_t bda) const;
+
+    /**
+     * @brief Finds a connection by its connection ID.
+     * @param conn_id The connection ID.
+     * @return Index in the connection list, or -1 if not found.
+     */
+    int FindConnection(uint16_t conn_id) const;
+
+    /**
+     * @brief Static storage change callback.
+     * @param id Identifier of the changed record.
+     * @param data New record data, `nullptr` when deleted.
+     * @param size Length of `data`.
+     * @param context Pointer to the BleManager instance.
+     */
+    static void StorageChangedStatic(long id, const char *data, size_t size, void *context);
+
+    /**
+     * @brief Queues a storage change for every subscribed connection.
+     *
+     * Called with the store lock held, so the change is only copied here and the command task
+     * sends it; a slow subscriber cannot hold up storage commands. A change that finds the queue
+     * full is dropped and logged.
+     * @param id Identifier of the changed record.
+     * @param data New record data, `nullptr` when deleted.
+     * @param size Length of `data`.
+     */
+    void StorageChanged(long id, const char *data, size_t size);
+
+    /**
+     * @brief Updates the notification state of a connection from a CCCD write.
+     * @param write The parameters associated with the write event.
+     * @param enabled Per-connection notification states of the characteristic.
+     */
+    void UpdateNotificationState(const esp_ble_gatts_cb_param_t::gatts_write_evt_param &write, bool *enabled);
+
     /**
      * @brief Sends a notification to connected BLE clients.
-     * @param response The response string to send as a notification.
+     *
+     * Responses longer than the connection MTU allows are split into consecutive notifications.
+     * While the stack reports the link as congested, or refuses a notification, sending waits for
+     * the link to drain; the rest of the response is dropped if the link makes no progress for
+     * `NOTIFY_STALL_TICKS`.
+     * @param response First byte of the response to send as a notification.
+     * @param size Response length.
+     * @param conn_id The connection ID to notify.
+     * @param attr_index Table index of the characteristic value to notify on.
+     * @param pace `false` to give up on the first refusal instead of waiting; the BTC task must not
+     *             wait, since it delivers the events that end the congestion.
      */
-    void SendNotification(const std::string &response, uint16_t conn_id);
+    void SendNotification(const char *response, size_t size, uint16_t conn_id, size_t attr_index, bool pace = true);
 
     /**
      * @brief Adds a connection to the connection list.
      * @param conn_id The connection ID to add.
+     * @param bda The remote device address.
+     * @return Index in the connection list, or -1 if the list is full.
      */
-    void AddConnection(uint16_t conn_id);
+    int AddConnection(uint16_t conn_id, const esp_bd_addr_t bda);
 
     /**
      * @brief Removes a connection from the connection list.
@@ -76,39 +232,133 @@ class BleManager
 
     CommandManager commandManager; ///< Command manager for handling BLE commands.
 
-    // UUIDs
-    static const uint16_t SERVICE_UUID;
-    static const uint16_t CHAR_UUID_WRITE;
-    static const uint16_t CHAR_UUID_NOTIFY;
-    static const uint16_t GATT_UUID_PRI_SERVICE;
-    static const uint16_t GATT_UUID_CHAR_DECLARE;
-    static const uint16_t GATT_UUID_CHAR_CLIENT_CONFIG;
+    // GATT service description
+    using CommandChar = Gatt::Characteristic<0xFF01, ESP_GATT_CHAR_PROP_BIT_WRITE, ESP_GATT_PERM_WRITE, 128>;
+    using NotifyChar  = Gatt::Characteristic<0xFF02, ESP_GATT_CHAR_PROP_BIT_NOTIFY, ESP_GATT_PERM_READ, 128>;
+    using BulkChar    = Gatt::Characteristic<0xFF03, ESP_GATT_CHAR_PROP_BIT_WRITE_NR | ESP_GATT_CHAR_PROP_BIT_NOTIFY, ESP_GATT_PERM_WRITE, 244>;
+    using GattService = Gatt::Service<0x00FF, CommandChar, NotifyChar, BulkChar>;
+
+    // GATT attribute table indices
+    static constexpr size_t IDX_SERVICE      = GattService::SERVICE_INDEX;
+    static constexpr size_t IDX_CMD_VALUE    = GattService::ValueIndex<0>();
+    static constexpr size_t IDX_NOTIFY_VALUE = GattService::ValueIndex<1>();
+    static constexpr size_t IDX_NOTIFY_CCCD  = GattService::CccdIndex<1>();
+    static constexpr size_t IDX_BULK_VALUE   = GattService::ValueIndex<2>();
+    static constexpr size_t IDX_BULK_CCCD    = GattService::CccdIndex<2>();
 
     // BLE connection constants
     static const uint16_t INVALID_CONN_ID;
     static const uint8_t  PROFILE_APP_IDX;
     static const uint8_t  SVC_INST_ID;
 
-    // BLE characteristics properties
-    static uint8_t char_prop_write;
-    static uint8_t char_prop_notify;
+    /**
+     * @brief Inclusive range of keys a connection is subscribed to.
+     */
+    struct KeyRange
+    {
+        long first;
+        long last;
+    };
+
+    static constexpr size_t   COMMAND_MAX_LEN  = std::max(CommandChar::MAX_LEN, BulkChar::MAX_LEN); ///< Longest command write.
+    static constexpr uint32_t BUSY_RETRY_MS    = 20; ///< Retry hint sent when the connection already has a command waiting.
+    static constexpr size_t   CHANGE_QUEUE_LEN = 8;  ///< Storage changes waiting for the command task.
+
+    static constexpr TickType_t NOTIFY_BACKOFF_TICKS = pdMS_TO_TICKS(20);   ///< Wait after a refusal not reported as congestion.
+    static constexpr TickType_t NOTIFY_STALL_TICKS   = pdMS_TO_TICKS(2000); ///< Time without progress after which a response is dropped.
+
+    /**
+     * @brief Command written by a client, waiting for the command task.
+     */
+    struct PendingCommand
+    {
+        bool                     waiting;               ///< Set while the command waits for the command task.
+        uint16_t                 conn_id;               ///< Connection the command was written on.
+        uint16_t                 attr_index;            ///< Table index of the characteristic value to respond on.
+        uint16_t                 len;                   ///< Length of `data`.
+        char                     data[COMMAND_MAX_LEN]; ///< Command as written.
+        CommandScheduler::Ticket ticket;                ///< Admission of the command.
+    };
+
+    /**
+     * @brief Link settings requested on connect.
+     */
+    struct ConnectionProfile
+    {
+        uint16_t min_int;     ///< Minimum connection interval, in 1.25 ms units.
+        uint16_t max_int;     ///< Maximum connection interval, in 1.25 ms units.
+        uint16_t latency;     ///< Slave latency, in connection events.
+        uint16_t timeout;     ///< Supervision timeout, in 10 ms units.
+        uint16_t tx_data_len; ///< Requested LE data length, in bytes.
+    };
+
+    /**
+     * @brief Link settings negotiated for a connection.
+     */
+    struct LinkState
+    {
+        uint8_t  profile;   ///< Selected connection profile.
+        uint16_t interval;  ///< Current connection interval, in 1.25 ms units.
+        uint16_t latency;   ///< Current slave latency.
+        uint16_t timeout;   ///< Current supervision timeout, in 10 ms units.
+        uint16_t tx_len;    ///< Negotiated LE data length, 27 until extended.
+        uint16_t mtu;       ///< Negotiated ATT MTU, 23 until exchanged.
+        bool     congested; ///< Set while the stack reports the link as congested.
+    };
+
+    // Connection profiles
+    static const uint8_t           PROFILE_THROUGHPUT = 0;
+    static const uint8_t           PROFILE_LOW_POWER  = 1;
+    static const uint8_t           PROFILE_COUNT      = 2;
+    static const ConnectionProfile connection_profiles[PROFILE_COUNT];
+    static uint8_t                 default_profile; ///< Profile requested for new connections.
 
     // Maximum BLE connections
-    static const int MAX_CONNECTIONS = 9;
-    static uint16_t  connection_ids[MAX_CONNECTIONS];        ///< List of connection IDs.
-    static bool      notifications_enabled[MAX_CONNECTIONS]; ///< List of notification statuses.
+    static const int MAX_CONNECTIONS   = 9;
+    static const int MAX_SUBSCRIPTIONS = 4;                                 ///< Maximum key ranges per connection.
+    static uint16_t      connection_ids[MAX_CONNECTIONS];                   ///< List of connection IDs.
+    static bool          notifications_enabled[MAX_CONNECTIONS];            ///< List of notification statuses.
+    static bool          bulk_notifications_enabled[MAX_CONNECTIONS];       ///< List of bulk characteristic notification statuses.
+    static KeyRange      subscriptions[MAX_CONNECTIONS][MAX_SUBSCRIPTIONS]; ///< Key ranges subscribed by each connection.
+    static uint8_t       subscription_count[MAX_CONNECTIONS];               ///< Number of key ranges used by each connection.
+    static esp_bd_addr_t connection_bdas[MAX_CONNECTIONS];                  ///< Remote address of each connection.
+    static LinkState     link_states[MAX_CONNECTIONS];                      ///< Negotiated link settings of each connection.
+
+    /**
+     * @brief Storage change waiting for the command task.
+     */
+    struct PendingChange
+    {
+        std::string update;                   ///< Notification value, see `StorageChanged`.
+        uint16_t    targets[MAX_CONNECTIONS]; ///< Subscribed connections.
+        int         target_count;             ///< Entries used in `targets`.
+    };
 
     // BLE advertising data and parameters
     static uint8_t              adv_data[];
     static esp_ble_adv_params_t adv_params;
 
     // BLE GATT attributes
-    static esp_gatts_attr_db_t gatt_db[];
+    static const std::array<esp_gatts_attr_db_t, GattService::ATTR_COUNT> gatt_db;
 
-    uint16_t          notify_handle;            ///< Handle for notifications.
-    esp_gatt_if_t     gatts_if_global;          ///< Global GATT interface.
-    bool              notification_in_progress; ///< Indicates if a notification is in progress.
-    SemaphoreHandle_t resource_mutex;           ///< Mutex for protecting shared resources.
+    uint16_t           attr_handles[GattService::ATTR_COUNT];  ///< Attribute handles, indexed like `gatt_db`.
+    esp_gatt_if_t      gatts_if_global;                        ///< Global GATT interface.
+    bool               notification_in_progress;               ///< Indicates if a notification is in progress.
+    SemaphoreHandle_t  resource_mutex;                         ///< Mutex for protecting shared resources.
+    StaticSemaphore_t  resource_mutex_buffer;                  ///< Storage for `resource_mutex`.
+    EventGroupHandle_t link_ready;                             ///< Bit `i` is set while connection `i` is not congested.
+    StaticEventGroup_t link_ready_buffer;                      ///< Storage for `link_ready`.
+    SemaphoreHandle_t  notify_mutexes[MAX_CONNECTIONS];        ///< Keeps the notifications of one response together on a link.
+    StaticSemaphore_t  notify_mutex_buffers[MAX_CONNECTIONS];  ///< Storage for `notify_mutexes`.
+    PendingCommand     pending[MAX_CONNECTIONS];               ///< Command waiting on each connection, protected by `resource_mutex`.
+    PendingCommand     current;                                ///< Command being processed, only used by the command task.
+    std::string        response;                               ///< Response to `current`, reused for every command.
+    std::string        rejected;                               ///< Response to a command refused on the BTC task.
+    TaskHandle_t       command_task;                           ///< Woken for every queued command and change.
+    PendingChange      changes[CHANGE_QUEUE_LEN];              ///< Ring of queued storage changes, protected by `resource_mutex`.
+    size_t             change_head;                            ///< Index of the oldest change in `changes`.
+    size_t             change_count;                           ///< Changes queued in `changes`.
+    std::string        pushed;                                 ///< Change being pushed, only used by the command task.
 };
 
 #endif // BLE_MANAGER_HPP
@@ -0,0 +1,648 @@
+#include "BlobStore.hpp"
+#include "esp_rom_crc.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+BlobStore::View::View() : data(nullptr), size(0), pin(nullptr)
+{
+}
+
+BlobStore::View::~View()
+{
+    Reset();
+}
+
+BlobStore::View::View(View &&other) : data(other.data), size(other.size), pin(other.pin)
+{
+    other.data = nullptr;
+    other.size = 0;
+    other.pin  = nullptr;
+}
+
+BlobStore::View &BlobStore::View::operator=(View &&other)
+{
+    if (this != &other)
+    {
+        Reset();
+        data       = other.data;
+        size       = other.size;
+        pin        = other.pin;
+        other.data = nullptr;
+        other.size = 0;
+        other.pin  = nullptr;
+    }
+    return *this;
+}
+
+void BlobStore::View::Slice(size_t offset, size_t length)
+{
+    offset = std::min(offset, size);
+    data += offset;
+    size = std::min(length, size - offset);
+}
+
+void BlobStore::View::Reset()
+{
+    if (pin != nullptr)
+    {
+        pin->fetch_sub(1);
+    }
+    data = nullptr;
+    size = 0;
+    pin  = nullptr;
+}
+
+BlobStore::BlobStore() :
+    partition(nullptr), mapHandle(0), mapped(nullptr), bankSize(0), activeBank(0), generation(0), bankPurged(0), writeOffset(0), compactions(0),
+    liveBytes(0), streams{}, streamTick(0), pins{}, open(false)
+{
+}
+
+bool BlobStore::Init()
+{
+    if (open || MIN_VALUE == 0)
+    {
+        return open;
+    }
+
+    do
+    {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+        if (partition == nullptr)
+        {
+            break;
+        }
+        bankSize = (partition->size / BANK_COUNT) / partition->erase_size * partition->erase_size;
+        if (bankSize <= sizeof(BankHeader) + sizeof(RecordHeader))
+        {
+            break;
+        }
+
+        // The whole partition stays mapped; views are pointers into this mapping.
+        const void *ptr;
+        if (esp_partition_mmap(partition, 0, bankSize * BANK_COUNT, ESP_PARTITION_MMAP_DATA, &ptr, &mapHandle) != ESP_OK)
+        {
+            break;
+        }
+        mapped = static_cast<const uint8_t *>(ptr);
+
+        BankHeader header;
+        bool       found = false;
+        for (size_t bank = 0; bank < BANK_COUNT; ++bank)
+        {
+            if (readBank(bank, header) && (!found || header.generation > generation))
+            {
+                activeBank = bank;
+                generation = header.generation;
+                bankPurged = header.purged;
+                found      = true;
+            }
+        }
+
+        if (found)
+        {
+            scanBank();
+        }
+        else
+        {
+            // A blank partition starts with an empty first bank.
+            uint32_t purged = 0;
+            activeBank      = BANK_COUNT - 1;
+            if (switchBank(0, purged, false) != RESULT_OK)
+            {
+                esp_partition_munmap(mapHandle);
+                mapped = nullptr;
+                break;
+            }
+        }
+        open = true;
+    } while (0);
+
+    return open;
+}
+
+bool BlobStore::Accepts(size_t len) const
+{
+    return open && len >= MIN_VALUE && recordSize(len) <= bankSize - sizeof(BankHeader);
+}
+
+int BlobStore::findSlot(long id) const
+{
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        if (slots[i].id == id)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool BlobStore::Contains(long id, bool *deleted) const
+{
+    int index = findSlot(id);
+    if (index < 0)
+    {
+        return false;
+    }
+    if (deleted != nullptr)
+    {
+        *deleted = slots[index].deleted;
+    }
+    return true;
+}
+
+bool BlobStore::Get(long id, View &view) const
+{
+    int index = findSlot(id);
+    if (index < 0 || slots[index].deleted)
+    {
+        return false;
+    }
+    const Slot &slot = slots[index];
+    view.Reset();
+    view.data = reinterpret_cast<const char *>(mapped + slot.offset + sizeof(RecordHeader));
+    view.size = slot.length;
+    view.pin  = &pins[slot.offset / bankSize];
+    view.pin->fetch_add(1);
+    return true;
+}
+
+BlobStore::Result BlobStore::Put(long id, uint32_t sequence, std::string_view data, uint32_t &purged)
+{
+    return append(id, sequence, data.data(), data.size(), purged);
+}
+
+bool BlobStore::Remove(long id, uint32_t sequence, uint32_t &purged)
+{
+    int index = findSlot(id);
+    if (index < 0 || slots[index].deleted)
+    {
+        return false;
+    }
+    return append(id, sequence, nullptr, 0, purged) == RESULT_OK;
+}
+
+BlobStore::Result BlobStore::Open(long id, size_t length, uint32_t current, uint32_t &purged)
+{
+    if (!open)
+    {
+        return RESULT_FAILED;
+    }
+    if (length == 0 || recordSize(length) > bankSize - sizeof(BankHeader))
+    {
+        return RESULT_FULL;
+    }
+
+    // Reopening a key restarts its stream; the old region is left uncommitted and skipped.
+    Stream *stream = findStream(id);
+    if (stream == nullptr)
+    {
+        stream = &streams[0];
+        for (Stream &candidate : streams)
+        {
+            if (!candidate.used || (stream->used && candidate.lastUse < stream->lastUse))
+            {
+                stream = &candidate;
+            }
+        }
+    }
+    stream->used = false;
+
+    Result result = reserve(length, current, purged);
+    if (result != RESULT_OK)
+    {
+        return result;
+    }
+
+    // Sequence number and data CRC stay erased until the commit.
+    RecordHeader header = {};
+    header.magic        = RECORD_MAGIC;
+    header.state        = STATE_LIVE;
+    header.id           = static_cast<int32_t>(id);
+    header.length       = length;
+    header.flags        = 0;
+    header.headerCrc    = headerCrc(header);
+    header.sequence     = ERASED_WORD;
+    header.dataCrc      = ERASED_WORD;
+
+    uint32_t offset = activeBank * bankSize + writeOffset;
+    if (esp_partition_write(partition, offset, &header, sizeof(header)) != ESP_OK)
+    {
+        writeOffset = bankSize;
+        return RESULT_FAILED;
+    }
+    writeOffset += recordSize(length);
+
+    *stream = {true, false, id, offset, static_cast<uint32_t>(length), 0, 0, ++streamTick};
+    return RESULT_OK;
+}
+
+bool BlobStore::Write(long id, size_t offset, const char *data, size_t len)
+{
+    Stream *stream = findStream(id);
+    if (stream == nullptr || stream->verified || offset > stream->received || len > stream->length - offset)
+    {
+        return false;
+    }
+
+    // A resent chunk is accepted when it matches what was already programmed.
+    const uint8_t *value    = mapped + stream->offset + sizeof(RecordHeader);
+    size_t         repeated = std::min<size_t>(len, stream->received - offset);
+    if (repeated > 0 && memcmp(value + offset, data, repeated) != 0)
+    {
+        return false;
+    }
+    if (len > repeated &&
+        esp_partition_write(partition, stream->offset + sizeof(RecordHeader) + stream->received, data + repeated, len - repeated) != ESP_OK)
+    {
+        // The chunk may be partly programmed, so the stream cannot continue.
+        stream->used = false;
+        return false;
+    }
+    stream->received += len - repeated;
+    stream->lastUse = ++streamTick;
+    return true;
+}
+
+bool BlobStore::Verify(long id, size_t length, uint32_t crc)
+{
+    Stream *stream = findStream(id);
+    if (stream == nullptr || stream->received != stream->length || length != stream->length)
+    {
+        return false;
+    }
+    if (!stream->verified)
+    {
+        const uint8_t *value = mapped + stream->offset + sizeof(RecordHeader);
+        if (esp_rom_crc32_le(0, value, length) != crc)
+        {
+            // Programmed flash cannot be corrected in place, so the value has to be sent again.
+            stream->used = false;
+            return false;
+        }
+        stream->verified = true;
+        stream->crc      = crc;
+    }
+    return crc == stream->crc;
+}
+
+bool BlobStore::Commit(long id, uint32_t sequence)
+{
+    Stream *stream = findStream(id);
+    if (stream == nullptr || !stream->verified)
+    {
+        return false;
+    }
+    stream->used = false;
+
+    // These two words are what make the record valid at the next scan.
+    uint32_t tail[2] = {sequence, stream->crc};
+    if (esp_partition_write(partition, stream->offset + offsetof(RecordHeader, sequence), tail, sizeof(tail)) != ESP_OK)
+    {
+        return false;
+    }
+    publish({id, stream->offset, stream->length, sequence, false});
+    return true;
+}
+
+BlobStore::Stream *BlobStore::findStream(long id)
+{
+    for (Stream &stream : streams)
+    {
+        if (stream.used && stream.id == id)
+        {
+            return &stream;
+        }
+    }
+    return nullptr;
+}
+
+bool BlobStore::Erase(long id)
+{
+    int index = findSlot(id);
+    if (index < 0)
+    {
+        return true;
+    }
+    if (!supersede(slots[index].offset))
+    {
+        return false;
+    }
+    account(slots[index], false);
+    slots[index] = slots.back();
+    slots.pop_back();
+    return true;
+}
+
+bool BlobStore::CanClear() const
+{
+    return !open || pins[(activeBank + 1) % BANK_COUNT] == 0;
+}
+
+bool BlobStore::Clear(uint32_t purged)
+{
+    if (!open)
+    {
+        return true;
+    }
+    return switchBank(0, purged, false) == RESULT_OK;
+}
+
+void BlobStore::LoadCounters(uint32_t &sequence, uint32_t &purged) const
+{
+    for (const Slot &slot : slots)
+    {
+        sequence = std::max(sequence, slot.sequence);
+    }
+    purged = std::max(purged, bankPurged);
+}
+
+std::vector<NvsTier::Entry> BlobStore::List(uint32_t since, bool tombstones) const
+{
+    std::vector<NvsTier::Entry> entries;
+    for (const Slot &slot : slots)
+    {
+        if (slot.sequence <= since || (slot.deleted && !tombstones))
+        {
+            continue;
+        }
+        entries.push_back({slot.id, slot.sequence, slot.deleted, std::string()});
+    }
+    std::sort(entries.begin(), entries.end(), [](const NvsTier::Entry &a, const NvsTier::Entry &b) { return a.sequence < b.sequence; });
+    return entries;
+}
+
+size_t BlobStore::Count() const
+{
+    return std::count_if(slots.begin(), slots.end(), [](const Slot &slot) { return !slot.deleted; });
+}
+
+std::string BlobStore::Usage() const
+{
+    return std::to_string(Count()) + "," + std::to_string(open ? writeOffset : 0) + "," + std::to_string(bankSize) + "," + std::to_string(compactions);
+}
+
+bool BlobStore::readBank(size_t bank, BankHeader &header) const
+{
+    memcpy(&header, mapped + bank * bankSize, sizeof(header));
+    return header.magic == BANK_MAGIC && header.crc == bankCrc(header);
+}
+
+void BlobStore::scanBank()
+{
+    size_t base   = activeBank * bankSize;
+    size_t offset = sizeof(BankHeader);
+    slots.clear();
+    liveBytes = 0;
+
+    while (offset + sizeof(RecordHeader) <= bankSize)
+    {
+        RecordHeader header;
+        memcpy(&header, mapped + base + offset, sizeof(header));
+        if (header.magic == ERASED_WORD)
+        {
+            // Erased flash: the end of the log.
+            break;
+        }
+        if (header.magic != RECORD_MAGIC || header.headerCrc != headerCrc(header) || recordSize(header.length) > bankSize - offset)
+        {
+            // A header torn by a power loss; the rest of the bank cannot be trusted to be erased, so the next write switches banks.
+            offset = bankSize;
+            break;
+        }
+
+        const uint8_t *value  = mapped + base + offset + sizeof(RecordHeader);
+        uint32_t       crc    = (header.length > 0) ? esp_rom_crc32_le(0, value, header.length) : 0;
+        bool           intact = header.state == STATE_LIVE && header.sequence != ERASED_WORD && crc == header.dataCrc;
+        if (intact)
+        {
+            Slot slot  = {header.id, static_cast<uint32_t>(base + offset), header.length, header.sequence, (header.flags & FLAG_TOMBSTONE) != 0};
+            int  index = findSlot(header.id);
+            if (index < 0)
+            {
+                slots.push_back(slot);
+                account(slot, true);
+            }
+            else if (header.sequence > slots[index].sequence)
+            {
+                // Power was lost before the previous record was superseded; finish it now so it cannot come back.
+                supersede(slots[index].offset);
+                account(slots[index], false);
+                slots[index] = slot;
+                account(slot, true);
+            }
+            else
+            {
+                supersede(slot.offset);
+            }
+        }
+        offset += recordSize(header.length);
+    }
+    writeOffset = offset;
+}
+
+BlobStore::Result BlobStore::reserve(size_t len, uint32_t current, uint32_t &purged)
+{
+    if (writeOffset + recordSize(len) > bankSize)
+    {
+        // Compaction keeps the live records and the open streams; when they leave no room, the
+        // bank is not rewritten for nothing. Kept tombstones are small and checked afterwards.
+        size_t kept = sizeof(BankHeader) + liveBytes;
+        for (const Stream &stream : streams)
+        {
+            kept += stream.used ? recordSize(stream.length) : 0;
+        }
+        if (kept + recordSize(len) > bankSize)
+        {
+            return RESULT_FULL;
+        }
+        Result result = switchBank(current, purged, true);
+        if (result != RESULT_OK)
+        {
+            return result;
+        }
+        if (writeOffset + recordSize(len) > bankSize)
+        {
+            return RESULT_FULL;
+        }
+    }
+    return RESULT_OK;
+}
+
+void BlobStore::publish(const Slot &slot)
+{
+    int index = findSlot(slot.id);
+    if (index < 0)
+    {
+        slots.push_back(slot);
+    }
+    else
+    {
+        // If this fails, the newer sequence number still wins at the next scan.
+        supersede(slots[index].offset);
+        account(slots[index], false);
+        slots[index] = slot;
+    }
+    account(slot, true);
+}
+
+void BlobStore::account(const Slot &slot, bool added)
+{
+    if (slot.deleted)
+    {
+        return;
+    }
+    size_t size = recordSize(slot.length);
+    liveBytes   = added ? liveBytes + size : liveBytes - size;
+}
+
+bool BlobStore::copyRange(size_t from, size_t to, size_t size)
+{
+    uint8_t buf[COPY_BUF_SIZE];
+    for (size_t done = 0; done < size; done += COPY_BUF_SIZE)
+    {
+        size_t chunk = std::min(COPY_BUF_SIZE, size - done);
+        memcpy(buf, mapped + from + done, chunk);
+        if (esp_partition_write(partition, to + done, buf, chunk) != ESP_OK)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+BlobStore::Result BlobStore::append(long id, uint32_t sequence, const char *data, size_t len, uint32_t &purged)
+{
+    Result result = reserve(len, sequence, purged);
+    if (result != RESULT_OK)
+    {
+        return result;
+    }
+
+    RecordHeader header = {};
+    header.magic        = RECORD_MAGIC;
+    header.state        = STATE_LIVE;
+    header.id           = static_cast<int32_t>(id);
+    header.length       = len;
+    header.sequence     = sequence;
+    header.flags        = (data != nullptr) ? 0 : FLAG_TOMBSTONE;
+    header.dataCrc      = (len > 0) ? esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(data), len) : 0;
+    header.headerCrc    = headerCrc(header);
+
+    // The header goes first, so a value cut short by a power loss fails its CRC and is skipped.
+    uint32_t offset = activeBank * bankSize + writeOffset;
+    if (esp_partition_write(partition, offset, &header, sizeof(header)) != ESP_OK ||
+        (len > 0 && esp_partition_write(partition, offset + sizeof(header), data, len) != ESP_OK))
+    {
+        // The space may be partly programmed, so the rest of the bank is not used.
+        writeOffset = bankSize;
+        return RESULT_FAILED;
+    }
+    writeOffset += recordSize(len);
+
+    publish({id, offset, static_cast<uint32_t>(len), sequence, data == nullptr});
+    return RESULT_OK;
+}
+
+bool BlobStore::supersede(uint32_t offset)
+{
+    uint32_t state = STATE_SUPERSEDED;
+    return esp_partition_write(partition, offset + offsetof(RecordHeader, state), &state, sizeof(state)) == ESP_OK;
+}
+
+BlobStore::Result BlobStore::switchBank(uint32_t current, uint32_t &purged, bool keep)
+{
+    size_t target = (activeBank + 1) % BANK_COUNT;
+    if (pins[target] != 0)
+    {
+        // A view still points into the bank to be erased.
+        return RESULT_FULL;
+    }
+    size_t base = target * bankSize;
+    if (esp_partition_erase_range(partition, base, bankSize) != ESP_OK)
+    {
+        return RESULT_FAILED;
+    }
+
+    uint32_t streamOffsets[MAX_STREAMS] = {};
+    uint32_t newPurged                  = purged;
+    size_t   offset                     = sizeof(BankHeader);
+    size_t   live                       = 0;
+    spare.clear();
+    for (size_t i = 0; keep && i < slots.size(); ++i)
+    {
+        Slot slot = slots[i];
+        if (slot.deleted && slot.sequence + CONFIG_APP_STORAGE_TOMBSTONE_HORIZON < current)
+        {
+            newPurged = std::max(newPurged, slot.sequence);
+            continue;
+        }
+
+        size_t size = recordSize(slot.length);
+        if (!copyRange(slot.offset, base + offset, size))
+        {
+            return RESULT_FAILED;
+        }
+        slot.offset = base + offset;
+        spare.push_back(slot);
+        offset += size;
+        live += slot.deleted ? 0 : size;
+    }
+
+    // Open streams keep their received bytes and their whole reserved space.
+    for (size_t i = 0; keep && i < MAX_STREAMS; ++i)
+    {
+        const Stream &stream = streams[i];
+        if (!stream.used)
+        {
+            continue;
+        }
+        if (!copyRange(stream.offset, base + offset, sizeof(RecordHeader) + stream.received))
+        {
+            return RESULT_FAILED;
+        }
+        streamOffsets[i] = base + offset;
+        offset += recordSize(stream.length);
+    }
+
+    // The bank header is written last, so a bank cut short by a power loss is never chosen at boot.
+    BankHeader header = {BANK_MAGIC, generation + 1, newPurged, 0};
+    header.crc        = bankCrc(header);
+    if (esp_partition_write(partition, base, &header, sizeof(header)) != ESP_OK)
+    {
+        return RESULT_FAILED;
+    }
+
+    activeBank  = target;
+    generation  = header.generation;
+    bankPurged  = newPurged;
+    purged      = newPurged;
+    writeOffset = offset;
+    liveBytes   = live;
+    slots.swap(spare);
+    compactions++;
+    for (size_t i = 0; i < MAX_STREAMS; ++i)
+    {
+        streams[i].used   = keep && streams[i].used;
+        streams[i].offset = streams[i].used ? streamOffsets[i] : streams[i].offset;
+    }
+    return RESULT_OK;
+}
+
+size_t BlobStore::recordSize(size_t len)
+{
+    return (sizeof(RecordHeader) + len + 3) & ~static_cast<size_t>(3);
+}
+
+uint32_t BlobStore::bankCrc(const BankHeader &header)
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&header), offsetof(BankHeader, crc));
+}
+
+uint32_t BlobStore::headerCrc(const RecordHeader &header)
+{
+    const uint8_t *start = reinterpret_cast<const uint8_t *>(&header) + offsetof(RecordHeader, id);
+    return esp_rom_crc32_le(0, start, offsetof(RecordHeader, headerCrc) - offsetof(RecordHeader, id));
+}
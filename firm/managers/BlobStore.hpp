@@ -0,0 +1,442 @@
+#ifndef BLOB_STORE_HPP
+#define BLOB_STORE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "esp_partition.h"
+#include "sdkconfig.h"
+#include "NvsTier.hpp"
+
+/**
+ * @brief Large-value tier of the record store, kept in a raw data partition mapped into memory.
+ *
+ * The partition is split into two banks used as an append-only log: each record is a fixed
+ * header followed by its value, and an update appends a new record and clears the state word of
+ * the old one, which flash allows without an erase. When the active bank is full, the live
+ * records are copied to the other bank, which then becomes active. An index in RAM maps each key
+ * to its latest record, so a read is a lookup and a pointer into the mapping.
+ *
+ * A value can also be streamed in: `Open` reserves its space and writes the header, `Write`
+ * programs the chunks in place, and `Commit` writes the sequence number and CRC at the end of
+ * the header, which is what makes a record valid. A stream that is never committed is skipped
+ * by scans and dropped at the next compaction, so the value is never held in RAM.
+ *
+ * `esp_partition_write` and `esp_partition_erase_range` flush the cache lines of the mapped range
+ * they change, so the mapping stays coherent. What the tier must guarantee is that no `View`
+ * points into a bank while it is erased: every view pins its bank, and a pinned bank is never
+ * reused. Superseding a record only writes its header, so a view stays valid until released.
+ */
+class BlobStore
+{
+  public:
+    static constexpr size_t MIN_VALUE = CONFIG_APP_STORAGE_BLOB_MIN_VALUE; ///< Smallest value kept in this tier.
+
+    /**
+     * @brief Read-only view of a value in the mapped partition.
+     *
+     * Move-only; the bank stays pinned until the view is reset or destroyed, so release views
+     * once the value is sent.
+     */
+    class View
+    {
+      public:
+        View();
+        ~View();
+        View(View &&other);
+        View &operator=(View &&other);
+        View(const View &)            = delete;
+        View &operator=(const View &) = delete;
+
+        /**
+         * @brief Releases the bank and empties the view.
+         */
+        void Reset();
+
+        /**
+         * @brief Checks whether the view points to a value.
+         * @return `true` if the view is set, `false` otherwise.
+         */
+        bool Valid() const
+        {
+            return pin != nullptr;
+        }
+
+        /**
+         * @brief Narrows the view to a slice of the value.
+         * @param offset First byte of the slice, clamped to the value length.
+         * @param length Slice length, clamped to the bytes after `offset`.
+         */
+        void Slice(size_t offset, size_t length);
+
+        /**
+         * @brief Returns the first byte of the value.
+         */
+        const char *Data() const
+        {
+            return data;
+        }
+
+        /**
+         * @brief Returns the value length.
+         */
+        size_t Size() const
+        {
+            return size;
+        }
+
+      private:
+        friend class BlobStore;
+
+        const char            *data; ///< First byte of the value in the mapping.
+        size_t                 size; ///< Value length.
+        std::atomic<uint32_t> *pin;  ///< Pin count of the bank holding the value, `nullptr` if unset.
+    };
+
+    /**
+     * @brief Outcome of a write.
+     */
+    enum Result
+    {
+        RESULT_OK,     ///< Record stored.
+        RESULT_FULL,   ///< No room left after compaction.
+        RESULT_FAILED, ///< Flash error.
+    };
+
+    /**
+     * @brief Default constructor.
+     */
+    BlobStore();
+
+    /**
+     * @brief Maps the partition and rebuilds the index. Calling it again has no effect.
+     * @return `true` if the tier is usable, `false` otherwise.
+     */
+    bool Init();
+
+    /**
+     * @brief Checks whether a value belongs in this tier.
+     * @param len Value length.
+     * @return `true` if the tier is open and the value is large enough and fits a bank, `false` otherwise.
+     */
+    bool Accepts(size_t len) const;
+
+    /**
+     * @brief Looks up a key.
+     * @param id Record identifier.
+     * @param deleted Optional output, set to whether the key holds a tombstone.
+     * @return `true` if the key has a record or tombstone, `false` otherwise.
+     */
+    bool Contains(long id, bool *deleted) const;
+
+    /**
+     * @brief Reads a record without copying it.
+     * @param id Record identifier.
+     * @param view Output view; only set when `true` is returned.
+     * @return `true` if the key holds a record, `false` otherwise.
+     */
+    bool Get(long id, View &view) const;
+
+    /**
+     * @brief Stores a record.
+     * @param id Record identifier.
+     * @param sequence Sequence number of the mutation.
+     * @param data Record data.
+     * @param purged In: highest purged sequence number; out: updated with the tombstones a compaction dropped.
+     * @return Outcome of the write.
+     */
+    Result Put(long id, uint32_t sequence, std::string_view data, uint32_t &purged);
+
+    /**
+     * @brief Replaces a record with a tombstone.
+     * @param id Record identifier.
+     * @param sequence Sequence number of the mutation.
+     * @param purged In: highest purged sequence number; out: updated with the tombstones a compaction dropped.
+     * @return `true` on success, `false` otherwise.
+     */
+    bool Remove(long id, uint32_t sequence, uint32_t &purged);
+
+    /**
+     * @brief Starts streaming a value, replacing any stream of the same key.
+     * @param id Record identifier.
+     * @param length Total value length.
+     * @param current Current sequence number, for the tombstone horizon if the bank is compacted.
+     * @param purged In/out highest purged sequence number, updated if the bank is compacted.
+     * @return Outcome; `RESULT_FULL` if the value does not fit.
+     *
+     * Up to `MAX_STREAMS` streams can be open; opening another abandons the least recently used.
+     */
+    Result Open(long id, size_t length, uint32_t current, uint32_t &purged);
+
+    /**
+     * @brief Writes a chunk of a streamed value.
+     * @param id Record identifier.
+     * @param offset Offset of the chunk in the value.
+     * @param data Chunk bytes.
+     * @param len Chunk length.
+     * @return `true` on success; `false` if no stream is open for the key, the chunk leaves a gap
+     *         or overflows the value, or a resent chunk differs from what was written.
+     */
+    bool Write(long id, size_t offset, const char *data, size_t len);
+
+    /**
+     * @brief Checks that a stream is complete and intact.
+     * @param id Record identifier.
+     * @param length Expected value length.
+     * @param crc Expected CRC-32 of the value.
+     * @return `true` if the stream can be committed. A complete stream with another CRC is
+     *         abandoned; an incomplete one stays open for the missing chunks.
+     */
+    bool Verify(long id, size_t length, uint32_t crc);
+
+    /**
+     * @brief Makes a verified stream the record of its key.
+     * @param id Record identifier.
+     * @param sequence Sequence number of the mutation.
+     * @return `true` on success, `false` if the stream is not verified or the flash write failed.
+     */
+    bool Commit(long id, uint32_t sequence);
+
+    /**
+     * @brief Deletes a key without leaving a tombstone, when the record moves to another tier.
+     * @param id Record identifier.
+     * @return `true` if the key is gone, `false` otherwise.
+     */
+    bool Erase(long id);
+
+    /**
+     * @brief Checks whether `Clear` can switch banks, so callers can refuse a clear before
+     *        deleting anything elsewhere.
+     * @return `false` if a view still pins the bank `Clear` would erase.
+     */
+    bool CanClear() const;
+
+    /**
+     * @brief Deletes every record and tombstone by switching to an empty bank.
+     * @param purged Highest purged sequence number, saved in the new bank.
+     * @return `true` on success, `false` if the other bank is pinned or cannot be erased.
+     */
+    bool Clear(uint32_t purged);
+
+    /**
+     * @brief Reads the counters restored from the partition.
+     * @param sequence In: current sequence number; out: raised to the newest record.
+     * @param purged In: highest purged sequence number; out: raised to the one of the active bank.
+     */
+    void LoadCounters(uint32_t &sequence, uint32_t &purged) const;
+
+    /**
+     * @brief Lists the records and tombstones with a sequence number above a bound.
+     * @param since Lower bound, exclusive.
+     * @param tombstones Whether to include tombstones.
+     * @return Entries sorted by sequence number, in the small-value tier format so syncs merge both.
+     *         The data is left empty so listing copies no value; read it with `Get`.
+     */
+    std::vector<NvsTier::Entry> List(uint32_t since, bool tombstones) const;
+
+    /**
+     * @brief Counts the records held by the tier.
+     * @return Number of records, excluding tombstones.
+     */
+    size_t Count() const;
+
+    /**
+     * @brief Describes the bank usage.
+     * @return `<records>,<bank_used>,<bank_size>,<compactions>`.
+     */
+    std::string Usage() const;
+
+  private:
+    /**
+     * @brief Header of a bank.
+     */
+    struct BankHeader
+    {
+        uint32_t magic;      ///< `BANK_MAGIC` once the bank is complete.
+        uint32_t generation; ///< Incremented at every switch; the valid bank with the highest one is active.
+        uint32_t purged;     ///< Highest purged sequence number when the bank was started.
+        uint32_t crc;        ///< CRC of the fields above.
+    };
+
+    /**
+     * @brief Header of a record, followed by its value and padding to a word.
+     */
+    struct RecordHeader
+    {
+        uint32_t magic;     ///< `RECORD_MAGIC`.
+        uint32_t state;     ///< `STATE_LIVE`, cleared to `STATE_SUPERSEDED` in place.
+        int32_t  id;        ///< Record identifier.
+        uint32_t length;    ///< Value length, 0 for tombstones.
+        uint32_t flags;     ///< `FLAG_TOMBSTONE` or 0.
+        uint32_t headerCrc; ///< CRC of `id` to `flags`.
+        uint32_t sequence;  ///< Sequence number of the mutation; erased until a stream is committed.
+        uint32_t dataCrc;   ///< CRC of the value; erased until a stream is committed.
+    };
+
+    /**
+     * @brief Index entry of a key.
+     */
+    struct Slot
+    {
+        long     id;       ///< Record identifier.
+        uint32_t offset;   ///< Offset of the record header in the partition.
+        uint32_t length;   ///< Value length.
+        uint32_t sequence; ///< Sequence number of the record.
+        bool     deleted;  ///< Whether the record is a tombstone.
+    };
+
+    /**
+     * @brief Value being streamed into the active bank.
+     */
+    struct Stream
+    {
+        bool     used;     ///< Whether the stream is open.
+        bool     verified; ///< Whether `Verify` accepted the value.
+        long     id;       ///< Record identifier.
+        uint32_t offset;   ///< Offset of the record header in the partition.
+        uint32_t length;   ///< Total value length.
+        uint32_t received; ///< Bytes written so far, always a prefix of the value.
+        uint32_t crc;      ///< CRC of the value, once verified.
+        uint32_t lastUse;  ///< Value of `streamTick` at the last chunk, to reuse the oldest stream.
+    };
+
+    /**
+     * @brief Finds the open stream of a key.
+     * @param id Record identifier.
+     * @return Stream, or `nullptr` if none is open.
+     */
+    Stream *findStream(long id);
+
+    /**
+     * @brief Finds the index entry of a key.
+     * @param id Record identifier.
+     * @return Index in `slots`, or -1 if the key is not stored.
+     */
+    int findSlot(long id) const;
+
+    /**
+     * @brief Reads the header of a bank and checks it.
+     * @param bank Bank number.
+     * @param header Output header.
+     * @return `true` if the bank is complete, `false` otherwise.
+     */
+    bool readBank(size_t bank, BankHeader &header) const;
+
+    /**
+     * @brief Rebuilds the index from the records of the active bank.
+     */
+    void scanBank();
+
+    /**
+     * @brief Makes room at the end of the active bank, compacting it if needed.
+     * @param len Value length.
+     * @param current Current sequence number, for the tombstone horizon.
+     * @param purged In/out highest purged sequence number, updated if the bank is compacted.
+     * @return Outcome; `RESULT_FULL` if the record does not fit even after compaction, without
+     *         compacting when `liveBytes` already shows it.
+     */
+    Result reserve(size_t len, uint32_t current, uint32_t &purged);
+
+    /**
+     * @brief Points the index at a new record and supersedes the previous one of the key.
+     * @param slot Index entry of the new record.
+     */
+    void publish(const Slot &slot);
+
+    /**
+     * @brief Adds a record to `liveBytes` or takes it out; tombstones are not counted.
+     * @param slot Index entry of the record.
+     * @param added `true` when the record enters the index, `false` when it leaves.
+     */
+    void account(const Slot &slot, bool added);
+
+    /**
+     * @brief Copies a range of the partition through RAM, since the source is the flash being written.
+     * @param from Source offset in the partition.
+     * @param to Destination offset in the partition, erased.
+     * @param size Number of bytes.
+     * @return `true` on success, `false` otherwise.
+     */
+    bool copyRange(size_t from, size_t to, size_t size);
+
+    /**
+     * @brief Appends a record to the active bank and supersedes the previous one of the key.
+     * @param id Record identifier.
+     * @param sequence Sequence number of the mutation.
+     * @param data Value, or `nullptr` for a tombstone.
+     * @param len Length of `data`.
+     * @param purged In/out highest purged sequence number, updated if the bank is compacted.
+     * @return Outcome of the write.
+     */
+    Result append(long id, uint32_t sequence, const char *data, size_t len, uint32_t &purged);
+
+    /**
+     * @brief Clears the state word of a record so later scans skip it.
+     * @param offset Offset of the record header in the partition.
+     * @return `true` on success, `false` otherwise.
+     */
+    bool supersede(uint32_t offset);
+
+    /**
+     * @brief Copies the live records and open streams into the other bank and makes it active.
+     * @param current Current sequence number, for the tombstone horizon.
+     * @param purged In/out highest purged sequence number.
+     * @param keep Whether to copy the records and streams; `false` leaves the new bank empty.
+     * @return `RESULT_FULL` if the other bank is pinned, `RESULT_FAILED` on a flash error.
+     */
+    Result switchBank(uint32_t current, uint32_t &purged, bool keep);
+
+    /**
+     * @brief Computes the space a record takes in a bank.
+     * @param len Value length.
+     * @return Header and value length rounded up to a word.
+     */
+    static size_t recordSize(size_t len);
+
+    /**
+     * @brief Computes the CRC of a bank header.
+     * @param header Bank header.
+     * @return CRC of the fields before `crc`.
+     */
+    static uint32_t bankCrc(const BankHeader &header);
+
+    /**
+     * @brief Computes the CRC of a record header.
+     * @param header Record header.
+     * @return CRC of `id` to `flags`.
+     */
+    static uint32_t headerCrc(const RecordHeader &header);
+
+    static constexpr const char *PARTITION_LABEL  = "blobs";
+    static constexpr uint32_t    BANK_MAGIC       = 0x42414E4B; ///< "BANK".
+    static constexpr uint32_t    RECORD_MAGIC     = 0x424C4F42; ///< "BLOB".
+    static constexpr uint32_t    ERASED_WORD      = 0xFFFFFFFF; ///< Word of erased flash.
+    static constexpr uint32_t    STATE_LIVE       = ERASED_WORD;
+    static constexpr uint32_t    STATE_SUPERSEDED = 0;
+    static constexpr uint32_t    FLAG_TOMBSTONE   = 1;
+    static constexpr size_t      BANK_COUNT       = 2;
+    static constexpr size_t      COPY_BUF_SIZE    = 256; ///< Chunk size when copying between banks.
+    static constexpr size_t      MAX_STREAMS      = 4;   ///< Values that can be streamed at once.
+
+    const esp_partition_t      *partition;        ///< Blob partition, `nullptr` if absent.
+    esp_partition_mmap_handle_t mapHandle;        ///< Handle of the partition mapping.
+    const uint8_t              *mapped;           ///< Start of the partition mapping.
+    size_t                      bankSize;         ///< Size of each bank, a multiple of the sector size.
+    size_t                      activeBank;       ///< Bank records are appended to.
+    uint32_t                    generation;       ///< Generation of the active bank.
+    uint32_t                    bankPurged;       ///< Purged sequence number saved in the active bank.
+    size_t                      writeOffset;      ///< Next free byte in the active bank.
+    uint32_t                    compactions;      ///< Bank switches since boot.
+    size_t                      liveBytes;        ///< Space of the records in `slots` that a compaction keeps, tombstones aside.
+    std::vector<Slot>           slots;            ///< Latest record of each key.
+    std::vector<Slot>           spare;            ///< Built by `switchBank` and swapped with `slots`, so compaction reuses its capacity.
+    Stream                      streams[MAX_STREAMS]; ///< Values being streamed.
+    uint32_t                    streamTick;       ///< Stream chunk counter.
+    mutable std::atomic<uint32_t> pins[BANK_COUNT]; ///< Views open on each bank.
+    bool                        open;             ///< Whether the partition is mapped.
+};
+
+#endif // BLOB_STORE_HPP
@@ -0,0 +1,56 @@
+#include "BootProfile.hpp"
+#include "esp_timer.h"
+
+const char  *BootProfile::phases[MAX_PHASES] = {nullptr};
+int64_t      BootProfile::times[MAX_PHASES]  = {0};
+size_t       BootProfile::count              = 0;
+portMUX_TYPE BootProfile::lock               = portMUX_INITIALIZER_UNLOCKED;
+
+void BootProfile::Mark(const char *phase)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&lock);
+    bool known = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (phases[i] == phase)
+        {
+            known = true;
+            break;
+        }
+    }
+    if (!known && count < MAX_PHASES)
+    {
+        phases[count] = phase;
+        times[count]  = now;
+        count++;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+std::string BootProfile::Report()
+{
+    const char *snapshotPhases[MAX_PHASES];
+    int64_t     snapshotTimes[MAX_PHASES];
+
+    portENTER_CRITICAL(&lock);
+    size_t recorded = count;
+    for (size_t i = 0; i < recorded; ++i)
+    {
+        snapshotPhases[i] = phases[i];
+        snapshotTimes[i]  = times[i];
+    }
+    portEXIT_CRITICAL(&lock);
+
+    std::string result;
+    for (size_t i = 0; i < recorded; ++i)
+    {
+        if (!result.empty())
+        {
+            result += "\n";
+        }
+        result += std::string(snapshotPhases[i]) + "," + std::to_string(snapshotTimes[i]);
+    }
+    return result;
+}
@@ -0,0 +1,47 @@
+#ifndef BOOT_PROFILE_HPP
+#define BOOT_PROFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Records the time at which each boot phase completes.
+ *
+ * Phases are identified by string literals and only their first occurrence is kept,
+ * so a phase may be marked from a hot path without growing the table.
+ */
+class BootProfile
+{
+  public:
+    static constexpr size_t MAX_PHASES = 16; ///< Maximum number of phases recorded.
+
+    static constexpr const char *PHASE_APP_MAIN      = "app_main";      ///< Supervisor started.
+    static constexpr const char *PHASE_USB_READY     = "usb_ready";     ///< USB task accepts commands.
+    static constexpr const char *PHASE_NVS_READY     = "nvs_ready";     ///< NVS initialized.
+    static constexpr const char *PHASE_BT_READY      = "bt_ready";      ///< Controller and Bluedroid enabled.
+    static constexpr const char *PHASE_ADVERTISING   = "advertising";   ///< GATT table created and advertising started.
+    static constexpr const char *PHASE_STORAGE_READY = "storage_ready"; ///< SPIFFS mounted.
+    static constexpr const char *PHASE_FIRST_COMMAND = "first_command"; ///< First command processed.
+
+    /**
+     * @brief Records the completion of a phase, unless it was already recorded.
+     * @param phase Phase name; must point to static storage.
+     */
+    static void Mark(const char *phase);
+
+    /**
+     * @brief Describes the recorded phases in completion order.
+     * @return One `<phase>,<microseconds since boot>` line per phase.
+     */
+    static std::string Report();
+
+  private:
+    static const char  *phases[MAX_PHASES]; ///< Recorded phase names.
+    static int64_t      times[MAX_PHASES];  ///< Completion time of each phase.
+    static size_t       count;              ///< Number of recorded phases.
+    static portMUX_TYPE lock;               ///< Protects the table across tasks and cores.
+};
+
+#endif // BOOT_PROFILE_HPP
@@ -1,62 +1,235 @@
 #include "CommandManager.hpp"
-#include "FlashManager.hpp"
+#include "TrafficCapture.hpp"
+#include "CommandScheduler.hpp"
+#include "Telemetry.hpp"
+#include "SystemEvents.hpp"
+#include "BootProfile.hpp"
+#include "Logger.hpp"
 #include <algorithm>
 
-static FlashManager flashManager;
+static FlashManager     flashManager;
+static TrafficCapture   trafficCapture;
+static Telemetry        telemetry;
+static CommandScheduler scheduler;
 
-CommandManager::CommandManager()
+CommandManager::CommandManager(Transport transport) : transport(transport), transportHandler(nullptr), transportContext(nullptr)
 {
 }
 
 void CommandManager::Init()
 {
-    flashManager.Init();
+    // The storage mounts itself on the first storage command so it does not delay boot.
+    telemetry.Init();
 }
 
-std::string CommandManager::ProcessCommand(const std::string &cmdOriginal)
+void CommandManager::SetStorageListener(FlashManager::ChangeListener listener, void *context)
 {
-    std::string cmd  = cmdOriginal;
-    auto        trim = [](std::string &s)
+    flashManager.SetChangeListener(listener, context);
+}
+
+std::string CommandManager::ProcessCommand(std::string_view cmd, uint16_t session, BlobStore::View *view)
+{
+    std::string response;
+    ProcessCommand(cmd, response, session, view);
+    return response;
+}
+
+void CommandManager::SetTransportHandler(TransportHandler handler, void *context)
+{
+    transportHandler = handler;
+    transportContext = context;
+}
+
+void CommandManager::ProcessCommand(std::string_view cmdOriginal, std::string &response, uint16_t session, BlobStore::View *view)
+{
+    CommandScheduler::Ticket ticket;
+    if (AdmitCommand(cmdOriginal, session, ticket, response))
+    {
+        RunCommand(cmdOriginal, ticket, response, session, view);
+    }
+}
+
+bool CommandManager::AdmitCommand(std::string_view cmdOriginal, uint16_t session, CommandScheduler::Ticket &ticket, std::string &response)
+{
+    std::string_view cmd = Trim(cmdOriginal);
+
+    // Capture control commands are left out so exports do not record themselves, and the
+    // counters stay readable for a session that is over its limits.
+    if (cmd.substr(0, 2) == "tr" || cmd == "ta")
+    {
+        ticket.slot = -1;
+        ticket.tag  = 0;
+        return true;
+    }
+
+    trafficCapture.Record(transport, session, false, cmdOriginal.data(), cmdOriginal.size());
+
+    uint32_t retryMs;
+    if (!scheduler.Admit(transport, session, WriteBytes(cmd), ticket, retryMs))
     {
-        while (!s.empty() && (s.front() == ' ' || s.front() == '\n' || s.front() == '\r' || s.front() == '\t'))
+        char busy[16];
+        int  len = snprintf(busy, sizeof(busy), "BUSY,%lu", static_cast<unsigned long>(retryMs));
+        response.assign(busy, len);
+        trafficCapture.Record(transport, session, true, response);
+        return false;
+    }
+    return true;
+}
+
+void CommandManager::RunCommand(std::string_view cmdOriginal, CommandScheduler::Ticket &ticket, std::string &response, uint16_t session,
+                                BlobStore::View *view)
+{
+    std::string_view cmd = Trim(cmdOriginal);
+    if (ticket.slot < 0)
+    {
+        if (cmd == "ta")
         {
-            s.erase(s.begin());
+            response.assign(scheduler.Report());
         }
-        while (!s.empty() && (s.back() == ' ' || s.back() == '\n' || s.back() == '\r' || s.back() == '\t'))
+        else
         {
-            s.pop_back();
+            ExecuteCommand(cmd, response, nullptr);
         }
-    };
-    trim(cmd);
-    std::string code;
+        return;
+    }
 
-    if (cmd.empty())
+    scheduler.Acquire(ticket);
+    if (transportHandler == nullptr || !transportHandler(cmd, response, session, transportContext))
     {
-        code = "SYNTAX_ERROR";
-        return code;
+        ExecuteCommand(cmd, response, view);
     }
+    scheduler.Release(ticket);
+    if (view != nullptr && view->Valid())
+    {
+        trafficCapture.Record(transport, session, true, view->Data(), view->Size());
+    }
+    else
+    {
+        trafficCapture.Record(transport, session, true, response);
+    }
+    SystemEvents::Signal(SystemEvents::EVT_COMMAND);
+    BootProfile::Mark(BootProfile::PHASE_FIRST_COMMAND);
+}
 
-    if (cmd[0] == 't')
+std::string_view CommandManager::Trim(std::string_view cmd)
+{
+    auto isSpace = [](char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; };
+    while (!cmd.empty() && isSpace(cmd.front()))
+    {
+        cmd.remove_prefix(1);
+    }
+    while (!cmd.empty() && isSpace(cmd.back()))
     {
-        return CommandTests(cmd);
+        cmd.remove_suffix(1);
     }
+    return cmd;
+}
 
-    return "SYNTAX_ERROR";
+size_t CommandManager::WriteBytes(std::string_view cmd)
+{
+    if (cmd.substr(0, 2) != "tf")
+    {
+        return 0;
+    }
+    size_t pos = cmd.find('|');
+    return (pos != std::string_view::npos) ? cmd.size() - pos - 1 : 0;
 }
 
-std::string CommandManager::CommandTests(const std::string &cmd)
+void CommandManager::ExecuteCommand(std::string_view cmd, std::string &response, BlobStore::View *view)
+{
+    if (!cmd.empty() && cmd[0] == 't')
+    {
+        CommandTests(cmd, response, view);
+        return;
+    }
+    response.assign("SYNTAX_ERROR");
+}
+
+void CommandManager::CommandTests(std::string_view cmd, std::string &response, BlobStore::View *view)
 {
     if (cmd.size() < 2)
     {
-        return "SYNTAX_ERROR";
+        response.assign("SYNTAX_ERROR");
+        return;
     }
-    char        subCmd       = cmd[1];
-    std::string remainingCmd = cmd.substr(2);
+    char             subCmd       = cmd[1];
+    std::string_view remainingCmd = cmd.substr(2);
 
     if (subCmd == 'f')
     {
-        return flashManager.HandleCommand(remainingCmd);
+        flashManager.HandleCommand(remainingCmd, response, view);
+        return;
     }
+    if (subCmd == 'r')
+    {
+        CommandCapture(remainingCmd, response);
+        return;
+    }
+    if (subCmd == 'm')
+    {
+        CommandTelemetry(remainingCmd, response);
+        return;
+    }
+    if (subCmd == 'b' && remainingCmd.empty())
+    {
+        response.assign(BootProfile::Report());
+        return;
+    }
+    if (subCmd == 'l')
+    {
+        if (remainingCmd.empty())
+        {
+            response.assign(Logger::Report());
+            return;
+        }
+        if (remainingCmd == "r")
+        {
+            response.assign(Logger::Dump());
+            return;
+        }
+    }
+
+    response.assign("SYNTAX_ERROR");
+}
 
-    return "SYNTAX_ERROR";
+void CommandManager::CommandCapture(std::string_view cmd, std::string &response)
+{
+    if (cmd.empty())
+    {
+        response.assign(trafficCapture.Status());
+        return;
+    }
+    if (cmd == "1" || cmd == "0")
+    {
+        trafficCapture.SetEnabled(cmd == "1");
+        response.assign("OK");
+        return;
+    }
+    if (cmd == "c")
+    {
+        trafficCapture.Clear();
+        response.assign("OK");
+        return;
+    }
+    if (cmd == "e")
+    {
+        response.assign(trafficCapture.Export());
+        return;
+    }
+    response.assign("SYNTAX_ERROR");
+}
+
+void CommandManager::CommandTelemetry(std::string_view cmd, std::string &response)
+{
+    if (cmd.empty())
+    {
+        response.assign(telemetry.Report());
+        return;
+    }
+    if (cmd == "h")
+    {
+        response.assign(telemetry.History());
+        return;
+    }
+    response.assign("SYNTAX_ERROR");
 }
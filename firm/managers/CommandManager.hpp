@@ -1,7 +1,12 @@
 #ifndef COMMAND_MANAGER_HPP
 #define COMMAND_MANAGER_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include "FlashManager.hpp"
+#include "CommandScheduler.hpp"
 
 /**
  * @class CommandManager
@@ -11,9 +16,19 @@ class CommandManager
 {
   public:
     /**
-     * @brief Default constructor.
+     * @brief Transports commands can arrive on.
      */
-    CommandManager();
+    enum Transport : uint8_t
+    {
+        TRANSPORT_USB = 0,
+        TRANSPORT_BLE = 1,
+    };
+
+    /**
+     * @brief Constructs a command manager for a transport.
+     * @param transport Transport the commands of this instance arrive on.
+     */
+    explicit CommandManager(Transport transport);
 
     /**
      * @brief Initializes the CommandManager.
@@ -23,17 +38,135 @@ class CommandManager
     /**
      * @brief Processes a command string.
      * @param cmdOriginal Original command string.
-     * @return Result code after processing the command.
+     * @param response Result code after processing the command, or `BUSY,<retry_ms>` if the
+     *        session is over its rate limits, see `CommandScheduler`. It is assigned within its
+     *        capacity, so a transport that reuses one buffer makes get and put commands without
+     *        touching the heap.
+     * @param session Session within the transport, e.g. the BLE connection ID.
+     * @param view Optional output for zero-copy storage reads (`tfv<key>` and `tfr<key>,...`); when it is set on
+     *        return, the response is its value and the caller sends it, then releases the view.
+     *
+     * `ta` returns the scheduler counters and is never rate limited.
+     */
+    void ProcessCommand(std::string_view cmdOriginal, std::string &response, uint16_t session = 0, BlobStore::View *view = nullptr);
+
+    /**
+     * @brief Same as above, returning the response in a new string, for callers off the command path.
+     * @param cmdOriginal Original command string.
+     * @param session Session within the transport.
+     * @param view Optional output for zero-copy storage reads.
+     * @return Response after processing the command.
+     */
+    std::string ProcessCommand(std::string_view cmdOriginal, uint16_t session = 0, BlobStore::View *view = nullptr);
+
+    /**
+     * @brief Admits a command against the rate limits of its session, ahead of `RunCommand`.
+     *
+     * Transports that queue commands admit them as they arrive, so a session over its limits is
+     * answered before it takes a place in the queue. `ProcessCommand` does both steps at once.
+     * @param cmdOriginal Original command string.
+     * @param session Session within the transport.
+     * @param ticket Output admission, passed to `RunCommand`; its `tag` orders queued commands fairly.
+     * @param response Set to `BUSY,<retry_ms>` when `false` is returned; short enough not to allocate.
+     * @return `true` if the command may run.
      */
-    std::string ProcessCommand(const std::string &cmdOriginal);
+    bool AdmitCommand(std::string_view cmdOriginal, uint16_t session, CommandScheduler::Ticket &ticket, std::string &response);
+
+    /**
+     * @brief Runs an admitted command once the scheduler gives it its turn.
+     * @param cmdOriginal Original command string, as given to `AdmitCommand`.
+     * @param ticket Admission returned by `AdmitCommand`.
+     * @param response Result code after processing the command, see `ProcessCommand`.
+     * @param session Session within the transport.
+     * @param view Optional output for zero-copy storage reads.
+     */
+    void RunCommand(std::string_view cmdOriginal, CommandScheduler::Ticket &ticket, std::string &response, uint16_t session,
+                    BlobStore::View *view = nullptr);
+
+    /**
+     * @brief Handler of the commands a transport implements itself.
+     * @param cmd Trimmed command string.
+     * @param response Result code, set when the command is handled.
+     * @param session Session within the transport.
+     * @param context Opaque pointer given to `SetTransportHandler`.
+     * @return `true` if the command was handled, `false` to run it as a regular command.
+     */
+    using TransportHandler = bool (*)(std::string_view cmd, std::string &response, uint16_t session, void *context);
+
+    /**
+     * @brief Registers the handler of transport commands, which are admitted, scheduled and
+     * captured like every other command.
+     * @param handler Callback to invoke, or `nullptr` to remove the current handler.
+     * @param context Opaque pointer passed back to the handler.
+     */
+    void SetTransportHandler(TransportHandler handler, void *context);
+
+    /**
+     * @brief Registers a listener for changes applied to the storage.
+     * @param listener Callback to invoke, or `nullptr` to remove the current listener.
+     * @param context Opaque pointer passed back to the listener.
+     */
+    void SetStorageListener(FlashManager::ChangeListener listener, void *context);
 
   private:
+    /**
+     * @brief Strips leading and trailing whitespace and line terminators.
+     * @param cmd Command string.
+     * @return Trimmed command string.
+     */
+    static std::string_view Trim(std::string_view cmd);
+
+    /**
+     * @brief Measures the data a command stores, for the write rate limit.
+     * @param cmd Trimmed command string.
+     * @return Length of the data of a `tf<key>|<data>` write, 0 for other commands.
+     */
+    static size_t WriteBytes(std::string_view cmd);
+
+    /**
+     * @brief Executes a trimmed command string.
+     * @param cmd Command string.
+     * @param response Result code after processing the command.
+     * @param view Optional output for zero-copy storage reads.
+     */
+    void ExecuteCommand(std::string_view cmd, std::string &response, BlobStore::View *view);
+
+    /**
+     * @brief Processes traffic capture commands.
+     * @param cmd Command string following `tr`.
+     * @param response Result code or capture data.
+     *
+     * Commands:
+     * - (empty) : Returns `<enabled>,<records>,<bytes>,<dropped>`.
+     * - `1`     : Starts recording.
+     * - `0`     : Stops recording.
+     * - `c`     : Clears the recorded traffic.
+     * - `e`     : Exports the recorded traffic as hexadecimal.
+     */
+    void CommandCapture(std::string_view cmd, std::string &response);
+
+    /**
+     * @brief Processes telemetry commands.
+     * @param cmd Command string following `tm`.
+     * @param response Telemetry report.
+     *
+     * Commands:
+     * - (empty) : Returns the heap summary and per-task statistics.
+     * - `h`     : Returns the heap history.
+     */
+    void CommandTelemetry(std::string_view cmd, std::string &response);
+
     /**
      * @brief Processes test-related commands.
      * @param cmd Command string.
-     * @return Result code after processing the test command.
+     * @param response Result code after processing the test command.
+     * @param view Optional output for zero-copy storage reads.
      */
-    std::string CommandTests(const std::string &cmd);
+    void CommandTests(std::string_view cmd, std::string &response, BlobStore::View *view);
+
+    Transport        transport;        ///< Transport the commands of this instance arrive on.
+    TransportHandler transportHandler; ///< Handler of transport commands, see `SetTransportHandler`.
+    void            *transportContext; ///< Context passed to `transportHandler`.
 };
 
 #endif // COMMAND_MANAGER_HPP
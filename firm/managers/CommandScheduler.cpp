@@ -0,0 +1,228 @@
+#include "CommandScheduler.hpp"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include <algorithm>
+
+CommandScheduler::CommandScheduler() : sessions{}, waiters{}, gateHeld(false), virtualTime(0), useTick(0)
+{
+    mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+    for (Waiter &waiter : waiters)
+    {
+        waiter.wake = xSemaphoreCreateBinaryStatic(&waiter.buffer);
+    }
+}
+
+bool CommandScheduler::Admit(uint8_t transport, uint16_t session, size_t writeBytes, Ticket &ticket, uint32_t &retryMs)
+{
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+    {
+        retryMs = 1;
+        return false;
+    }
+
+    int      slot  = findSession(transport, session);
+    Session &entry = sessions[slot];
+    refill(entry, esp_timer_get_time());
+
+    // A write larger than the burst is charged the whole burst, so it gets through once the bucket is full.
+    uint64_t commandCost = MILLI;
+    uint64_t byteCost    = static_cast<uint64_t>(std::min<size_t>(writeBytes, WRITE_BURST)) * MILLI;
+    uint32_t shortfall   = std::max(shortfallMs(entry.command_level, commandCost, COMMAND_RATE),
+                                    (writeBytes > 0) ? shortfallMs(entry.byte_level, byteCost, WRITE_RATE) : 0);
+    bool     admitted    = shortfall == 0;
+
+    if (admitted)
+    {
+        if (COMMAND_RATE > 0)
+        {
+            entry.command_level -= commandCost;
+        }
+        if (WRITE_RATE > 0)
+        {
+            entry.byte_level -= byteCost;
+        }
+        entry.commands++;
+        entry.write_bytes += writeBytes;
+
+        // Start from the current virtual time, so an idle session does not bank credit.
+        uint32_t weight  = WEIGHTS[std::min<size_t>(transport, TRANSPORT_COUNT - 1)];
+        uint64_t cost    = 1 + writeBytes / COST_BYTES;
+        entry.finish     = std::max(entry.finish, virtualTime) + cost * WEIGHT_SCALE / weight;
+        ticket.slot      = slot;
+        ticket.transport = transport;
+        ticket.session   = session;
+        ticket.tag       = entry.finish;
+        ticket.wait_us   = 0;
+    }
+    else
+    {
+        entry.busy++;
+        retryMs = shortfall;
+    }
+
+    xSemaphoreGive(mutex);
+    return admitted;
+}
+
+void CommandScheduler::Acquire(Ticket &ticket)
+{
+    int64_t start = esp_timer_get_time();
+    while (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE)
+    {
+        // The gate is only free when nobody waits, since Release hands it over directly.
+        if (!gateHeld)
+        {
+            gateHeld    = true;
+            virtualTime = ticket.tag;
+            xSemaphoreGive(mutex);
+            break;
+        }
+
+        Waiter *waiter = nullptr;
+        for (Waiter &candidate : waiters)
+        {
+            if (candidate.state == WAITER_FREE)
+            {
+                waiter = &candidate;
+                break;
+            }
+        }
+        if (waiter == nullptr)
+        {
+            xSemaphoreGive(mutex);
+            vTaskDelay(1);
+            continue;
+        }
+
+        waiter->state = WAITER_WAITING;
+        waiter->tag   = ticket.tag;
+        xSemaphoreGive(mutex);
+
+        xSemaphoreTake(waiter->wake, portMAX_DELAY);
+        if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE)
+        {
+            waiter->state = WAITER_FREE;
+            xSemaphoreGive(mutex);
+        }
+        break;
+    }
+    ticket.wait_us = static_cast<uint32_t>(esp_timer_get_time() - start);
+}
+
+void CommandScheduler::Release(const Ticket &ticket)
+{
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+
+    // The slot may have been reassigned while the command ran.
+    Session &entry = sessions[ticket.slot];
+    if (entry.used && entry.transport == ticket.transport && entry.session == ticket.session)
+    {
+        entry.wait_us += ticket.wait_us;
+        entry.wait_max_us = std::max(entry.wait_max_us, ticket.wait_us);
+    }
+
+    Waiter *next = nullptr;
+    for (Waiter &waiter : waiters)
+    {
+        if (waiter.state == WAITER_WAITING && (next == nullptr || waiter.tag < next->tag))
+        {
+            next = &waiter;
+        }
+    }
+    if (next != nullptr)
+    {
+        next->state = WAITER_WOKEN;
+        virtualTime = next->tag;
+        xSemaphoreGive(next->wake);
+    }
+    else
+    {
+        gateHeld = false;
+    }
+
+    xSemaphoreGive(mutex);
+}
+
+int CommandScheduler::findSession(uint8_t transport, uint16_t session)
+{
+    int found  = -1;
+    int oldest = 0;
+    for (size_t i = 0; i < MAX_SESSIONS; ++i)
+    {
+        const Session &entry = sessions[i];
+        if (entry.used && entry.transport == transport && entry.session == session)
+        {
+            found = static_cast<int>(i);
+            break;
+        }
+        if (!entry.used || (sessions[oldest].used && entry.last_use < sessions[oldest].last_use))
+        {
+            oldest = static_cast<int>(i);
+        }
+    }
+
+    // Slots outlive BLE connections, so reconnecting with the same connection ID does not refill the buckets.
+    if (found < 0)
+    {
+        found          = oldest;
+        Session &entry = sessions[found];
+
+        entry               = {};
+        entry.used          = true;
+        entry.transport     = transport;
+        entry.session       = session;
+        entry.refilled_us   = esp_timer_get_time();
+        entry.command_level = static_cast<uint64_t>(COMMAND_BURST) * MILLI;
+        entry.byte_level    = static_cast<uint64_t>(WRITE_BURST) * MILLI;
+        entry.finish        = virtualTime;
+    }
+    sessions[found].last_use = ++useTick;
+    return found;
+}
+
+void CommandScheduler::refill(Session &entry, int64_t now_us)
+{
+    // Rates are tokens per second, so microseconds times rate is thousandths of a token.
+    uint64_t elapsed    = static_cast<uint64_t>(now_us - entry.refilled_us);
+    entry.refilled_us   = now_us;
+    entry.command_level = std::min<uint64_t>(entry.command_level + elapsed * COMMAND_RATE / 1000, static_cast<uint64_t>(COMMAND_BURST) * MILLI);
+    entry.byte_level    = std::min<uint64_t>(entry.byte_level + elapsed * WRITE_RATE / 1000, static_cast<uint64_t>(WRITE_BURST) * MILLI);
+}
+
+uint32_t CommandScheduler::shortfallMs(uint64_t level, uint64_t cost, uint32_t rate)
+{
+    if (rate == 0 || level >= cost)
+    {
+        return 0;
+    }
+    // The bucket gains `rate` thousandths of a token per millisecond.
+    return static_cast<uint32_t>((cost - level + rate - 1) / rate);
+}
+
+std::string CommandScheduler::Report() const
+{
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return "";
+    }
+
+    std::string result = "limits," + std::to_string(COMMAND_RATE) + "," + std::to_string(COMMAND_BURST) + "," + std::to_string(WRITE_RATE) + "," +
+                         std::to_string(WRITE_BURST);
+    for (const Session &entry : sessions)
+    {
+        if (!entry.used)
+        {
+            continue;
+        }
+        uint64_t average = (entry.commands > 0) ? entry.wait_us / entry.commands : 0;
+        result += "\n" + std::to_string(entry.transport) + "," + std::to_string(entry.session) + "," + std::to_string(entry.commands) + "," +
+                  std::to_string(entry.busy) + "," + std::to_string(entry.write_bytes) + "," + std::to_string(average) + "," +
+                  std::to_string(entry.wait_max_us);
+    }
+
+    xSemaphoreGive(mutex);
+    return result;
+}
@@ -0,0 +1,163 @@
+#ifndef COMMAND_SCHEDULER_HPP
+#define COMMAND_SCHEDULER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+/**
+ * @brief Admission control and fair ordering of the commands of every transport session.
+ *
+ * Each session (the USB console, or one BLE connection) has two token buckets: one for
+ * commands and one for stored data bytes. A command that finds either bucket short is
+ * rejected with a retry hint instead of being executed.
+ *
+ * Admitted commands then pass a gate that runs one command at a time. When several are
+ * waiting, the gate picks the lowest virtual finish time, where each command advances its
+ * session's finish time by its cost divided by the weight of the transport. A session that
+ * sends a lot therefore waits behind the others instead of delaying them.
+ */
+class CommandScheduler
+{
+  public:
+    static constexpr size_t MAX_SESSIONS = 10; ///< The USB console and nine BLE connections.
+
+    /**
+     * @brief Admission of one command, passed from `Admit` to `Acquire` and `Release`.
+     */
+    struct Ticket
+    {
+        int      slot;      ///< Session slot.
+        uint8_t  transport; ///< Transport of the session.
+        uint16_t session;   ///< Session within the transport.
+        uint64_t tag;       ///< Virtual finish time.
+        uint32_t wait_us;   ///< Time spent waiting at the gate.
+    };
+
+    /**
+     * @brief Default constructor.
+     */
+    CommandScheduler();
+
+    /**
+     * @brief Charges a command to its session.
+     * @param transport Transport the command arrived on.
+     * @param session Session within the transport.
+     * @param writeBytes Data bytes the command stores, 0 if it does not write.
+     * @param ticket Output ticket; only valid when `true` is returned.
+     * @param retryMs Output delay after which the command would be admitted; only set when `false` is returned.
+     * @return `true` if the command may run, `false` if the session is over its limits.
+     */
+    bool Admit(uint8_t transport, uint16_t session, size_t writeBytes, Ticket &ticket, uint32_t &retryMs);
+
+    /**
+     * @brief Waits until the command is the next one to run.
+     * @param ticket Ticket returned by `Admit`.
+     */
+    void Acquire(Ticket &ticket);
+
+    /**
+     * @brief Hands the gate to the next waiting command and accounts the wait.
+     * @param ticket Ticket passed to `Acquire`.
+     */
+    void Release(const Ticket &ticket);
+
+    /**
+     * @brief Describes the limits and the counters of each session.
+     * @return A `limits,<cmd_rate>,<cmd_burst>,<byte_rate>,<byte_burst>` line followed by one
+     *         `<transport>,<session>,<commands>,<busy>,<write_bytes>,<avg_wait_us>,<max_wait_us>` line per session.
+     */
+    std::string Report() const;
+
+  private:
+    static constexpr size_t   MAX_WAITERS  = 4;    ///< Tasks that can wait at the gate at once.
+    static constexpr uint32_t MILLI        = 1000; ///< Bucket levels are kept in thousandths of a token.
+    static constexpr size_t   COST_BYTES   = 256;  ///< Written bytes that cost as much as one command at the gate.
+    static constexpr uint32_t WEIGHT_SCALE = 16;   ///< Virtual time of one cost unit at weight 1.
+
+    /**
+     * @brief Buckets, fair-queuing state and counters of a session.
+     */
+    struct Session
+    {
+        bool     used;          ///< Whether the slot is assigned.
+        uint8_t  transport;     ///< Transport of the session.
+        uint16_t session;       ///< Session within the transport.
+        uint32_t last_use;      ///< Value of `useTick` at the last admission, to reuse the oldest slot.
+        int64_t  refilled_us;   ///< Time the buckets were last refilled.
+        uint64_t command_level; ///< Command bucket level.
+        uint64_t byte_level;    ///< Written-byte bucket level.
+        uint64_t finish;        ///< Virtual finish time of the last admitted command.
+        uint32_t commands;      ///< Commands admitted.
+        uint32_t busy;          ///< Commands rejected.
+        uint64_t write_bytes;   ///< Data bytes admitted.
+        uint64_t wait_us;       ///< Total time spent waiting at the gate.
+        uint32_t wait_max_us;   ///< Longest wait at the gate.
+    };
+
+    /**
+     * @brief State of a waiter slot.
+     */
+    enum WaiterState : uint8_t
+    {
+        WAITER_FREE,    ///< Unused.
+        WAITER_WAITING, ///< A task waits for the gate.
+        WAITER_WOKEN,   ///< The gate was handed to the task, which has not cleared the slot yet.
+    };
+
+    /**
+     * @brief Task waiting at the gate.
+     */
+    struct Waiter
+    {
+        WaiterState       state;  ///< Slot state.
+        uint64_t          tag;    ///< Virtual finish time of the waiting command.
+        SemaphoreHandle_t wake;   ///< Given when the gate is handed to the task.
+        StaticSemaphore_t buffer; ///< Storage for `wake`.
+    };
+
+    /**
+     * @brief Finds the slot of a session, assigning a free or the least recently used one.
+     * @param transport Transport of the session.
+     * @param session Session within the transport.
+     * @return Slot index.
+     */
+    int findSession(uint8_t transport, uint16_t session);
+
+    /**
+     * @brief Tops up the buckets of a session for the time elapsed since the last refill.
+     * @param entry Session to refill.
+     * @param now_us Current time.
+     */
+    static void refill(Session &entry, int64_t now_us);
+
+    /**
+     * @brief Computes how long a bucket needs to hold a cost.
+     * @param level Bucket level.
+     * @param cost Cost, in the same unit.
+     * @param rate Refill rate in tokens per second, 0 for unlimited.
+     * @return Delay in milliseconds, 0 if the cost can be paid now.
+     */
+    static uint32_t shortfallMs(uint64_t level, uint64_t cost, uint32_t rate);
+
+    Session           sessions[MAX_SESSIONS]; ///< Session slots.
+    Waiter            waiters[MAX_WAITERS];   ///< Tasks waiting at the gate.
+    bool              gateHeld;               ///< Whether a command is running.
+    uint64_t          virtualTime;            ///< Finish time of the command that last got the gate.
+    uint32_t          useTick;                ///< Admission counter.
+    SemaphoreHandle_t mutex;                  ///< Protects the sessions and the gate.
+    StaticSemaphore_t mutexBuffer;            ///< Storage for `mutex`.
+
+    static constexpr uint32_t COMMAND_RATE  = CONFIG_APP_SCHED_COMMAND_RATE;
+    static constexpr uint32_t COMMAND_BURST = CONFIG_APP_SCHED_COMMAND_BURST;
+    static constexpr uint32_t WRITE_RATE    = CONFIG_APP_SCHED_WRITE_RATE;
+    static constexpr uint32_t WRITE_BURST   = CONFIG_APP_SCHED_WRITE_BURST;
+
+    static constexpr size_t   TRANSPORT_COUNT          = 2;
+    static constexpr uint32_t WEIGHTS[TRANSPORT_COUNT] = {CONFIG_APP_SCHED_WEIGHT_USB, CONFIG_APP_SCHED_WEIGHT_BLE}; ///< Indexed by `CommandManager::Transport`.
+};
+
+#endif // COMMAND_SCHEDULER_HPP
@@ -1,7 +1,19 @@
 #include "FlashManager.hpp"
+#include "SystemEvents.hpp"
+#include "BootProfile.hpp"
+#include "Logger.hpp"
+#include "RecordCodec.hpp"
+#include "NvsTier.hpp"
+#include "BlobStore.hpp"
+#include "esp_timer.h"
+#include "sdkconfig.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cstdio>
 #include <cstring>
+#include <iterator>
 
 extern "C"
 {
@@ -10,82 +22,235 @@ extern "C"
 #include "esp_log.h"
 }
 
-#define DATA_FILE "data.txt"
+FlashManager::FlashManager() :
+    changeListener(nullptr), changeContext(nullptr), mounted(false), ready(false), codecStats{}, partitionTotal(0), recordCount(0), fileBytes(0),
+    highWaterPercent(CONFIG_APP_STORAGE_HIGH_WATER_PERCENT), maxRecords(CONFIG_APP_STORAGE_MAX_RECORDS), policy(DEFAULT_POLICY), evictedCount(0),
+    expiredCount(0), accessLog{}, accessTick(0), sequence(0), resetSequence(0), purgedSequence(0), clockBase(0), nvsRecords(0), tierStats{}
+{
+    initMutex  = xSemaphoreCreateMutexStatic(&initMutexBuffer);
+    storeMutex = xSemaphoreCreateMutexStatic(&storeMutexBuffer);
+}
 
-FlashManager::FlashManager()
+FlashManager::~FlashManager()
 {
+    vSemaphoreDelete(storeMutex);
+    vSemaphoreDelete(initMutex);
 }
 
 bool FlashManager::Init()
 {
-    esp_vfs_spiffs_conf_t conf = {.base_path = MOUNT_POINT, .partition_label = nullptr, .max_files = 5, .format_if_mount_failed = true};
-
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-    if (ret != ESP_OK)
+    if (ready)
+    {
+        return true;
+    }
+    if (xSemaphoreTake(initMutex, portMAX_DELAY) != pdTRUE)
     {
         return false;
     }
 
-    size_t total = 0, used = 0;
-    ret = esp_spiffs_info(nullptr, &total, &used);
+    do
+    {
+        if (!mounted)
+        {
+            esp_vfs_spiffs_conf_t conf = {.base_path = MOUNT_POINT, .partition_label = nullptr, .max_files = 5, .format_if_mount_failed = true};
+
+            esp_err_t ret = esp_vfs_spiffs_register(&conf);
+            if (ret != ESP_OK)
+            {
+                Logger::Log(LOG_STORAGE_MOUNT, static_cast<uint32_t>(ret));
+                SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, true);
+                break;
+            }
+            mounted = true;
+
+            size_t used = 0;
+            if (esp_spiffs_info(nullptr, &partitionTotal, &used) != ESP_OK)
+            {
+                partitionTotal = 0;
+            }
+        }
+
+        // The small-value tier is optional; without it every record goes to the data file.
+        if (nvsTier.Init())
+        {
+            nvsTier.LoadCounters(sequence, purgedSequence);
+            nvsRecords = nvsTier.Count();
+        }
+        if (blobStore.Init())
+        {
+            blobStore.LoadCounters(sequence, purgedSequence);
+        }
+
+        uint32_t unsequenced = 0;
+        if (!createFile() || !scanStore(&unsequenced) || (unsequenced > 0 && !sequenceRecords()))
+        {
+            SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, true);
+            break;
+        }
+
+        // A storage error from an earlier attempt ends with a successful mount and scan.
+        SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, false);
+        ready = true;
+        BootProfile::Mark(BootProfile::PHASE_STORAGE_READY);
+    } while (0);
+
+    xSemaphoreGive(initMutex);
+    return ready;
+}
+
+bool FlashManager::takeNumber(std::string_view &args, int base, unsigned long &value)
+{
+    size_t digits = 0;
+    value         = 0;
+    for (; digits < args.size(); ++digits)
+    {
+        char c     = args[digits];
+        int  digit = (c >= '0' && c <= '9') ? c - '0' : (base == 16 && c >= 'a' && c <= 'f') ? c - 'a' + 10 : (base == 16 && c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0)
+        {
+            break;
+        }
+        // Saturates like `strtoul`.
+        value = (value > (ULONG_MAX - digit) / base) ? ULONG_MAX : value * base + digit;
+    }
+    args.remove_prefix(digits);
+    return digits > 0;
+}
 
-    if (!createFile())
+bool FlashManager::takeKey(std::string_view &args, long &id)
+{
+    unsigned long value;
+    if (!takeNumber(args, 16, value))
     {
         return false;
     }
-
+    // Saturates like `strtol`, so no key maps to `ALL_RECORDS`.
+    id = (value > static_cast<unsigned long>(LONG_MAX)) ? LONG_MAX : static_cast<long>(value);
     return true;
 }
 
-bool FlashManager::isHex(const std::string &s) const
+bool FlashManager::takeChar(std::string_view &args, char c)
 {
-    if (s.empty())
-        return false;
-    for (char c : s)
+    if (args.empty() || args.front() != c)
     {
-        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
-        {
-            return false;
-        }
+        return false;
     }
+    args.remove_prefix(1);
     return true;
 }
 
-std::string FlashManager::HandleCommand(const std::string &cmdIn)
+std::string FlashManager::HandleCommand(std::string_view cmd, BlobStore::View *view)
+{
+    std::string response;
+    HandleCommand(cmd, response, view);
+    return response;
+}
+
+void FlashManager::HandleCommand(std::string_view cmd, std::string &response, BlobStore::View *view)
+{
+    if (!Init() || xSemaphoreTake(storeMutex, portMAX_DELAY) != pdTRUE)
+    {
+        response.assign("OP_ERROR");
+        return;
+    }
+    executeCommand(cmd, response, view);
+    xSemaphoreGive(storeMutex);
+}
+
+void FlashManager::executeCommand(std::string_view cmd, std::string &response, BlobStore::View *view)
 {
-    std::string cmd = cmdIn;
-    cmd.erase(cmd.find_last_not_of("\r\n") + 1);
-    std::string code = "SYNTAX_ERROR";
+    while (!cmd.empty() && (cmd.back() == '\r' || cmd.back() == '\n'))
+    {
+        cmd.remove_suffix(1);
+    }
+    response.assign("SYNTAX_ERROR");
     do
     {
         if (cmd.empty())
         {
             break;
         }
+        std::string_view args = cmd.substr(1);
         if (cmd[0] == '@')
         {
-            if (cmd.size() <= 1)
+            if (args.empty())
             {
-                if (deleteFile() && createFile())
+                // A view still being sent pins the blob bank the clear erases; nothing is deleted until it is released.
+                if (!blobStore.CanClear())
                 {
-                    code = "OK";
+                    response.assign("OP_ERROR");
                     break;
                 }
-                code = "OP_ERROR";
+                // Mirrors that synced before the clear must start over.
+                resetSequence = ++sequence;
+                if (!deleteFile())
+                {
+                    response.assign("OP_ERROR");
+                    break;
+                }
+                // The cached values left with the file, even if the rest of the clear fails.
+                readCache.Clear();
+                if (createFile() && scanStore(nullptr) && nvsTier.Clear(sequence, purgedSequence) && blobStore.Clear(purgedSequence))
+                {
+                    nvsRecords = 0;
+                    notifyChange(ALL_RECORDS, nullptr, 0);
+                    response.assign("OK");
+                    break;
+                }
+                response.assign("OP_ERROR");
+                break;
+            }
+            long id;
+            if (!takeKey(args, id) || !args.empty())
+            {
+                break;
+            }
+            if (removeRecord(id))
+            {
+                notifyChange(id, nullptr, 0);
+                response.assign("OK");
+                break;
+            }
+            response.assign("OP_ERROR");
+            break;
+        }
+        if (cmd == "z")
+        {
+            response.assign(CompressionStats());
+            break;
+        }
+        if (cmd == "t")
+        {
+            response.assign(TierStats());
+            break;
+        }
+        if (cmd == "h")
+        {
+            response.assign(readCache.Stats());
+            break;
+        }
+        if (cmd[0] == 'q')
+        {
+            if (args.empty())
+            {
+                response.assign(Capacity());
                 break;
             }
-            std::string keyHex = cmd.substr(1);
-            if (!isHex(keyHex))
+            if (!setLimits(args))
             {
                 break;
             }
-            long id = strtol(keyHex.c_str(), nullptr, 16);
-            if (deleteDataById(id))
+            response.assign("OK");
+            break;
+        }
+        if (cmd[0] == 's')
+        {
+            unsigned long since, purged = 0;
+            if (!takeNumber(args, 10, since) || (takeChar(args, 'r') && !takeNumber(args, 10, purged)) || !args.empty())
             {
-                code = "OK";
                 break;
             }
-            code = "OP_ERROR";
+            response.assign(readChanges(since, purged));
             break;
         }
         if (cmd == "#")
@@ -93,254 +258,1386 @@ std::string FlashManager::HandleCommand(const std::string &cmdIn)
             std::string all = readAllData();
             if (all.empty())
             {
-                code = "OP_ERROR";
+                response.assign("OP_ERROR");
                 break;
             }
-            code = all;
+            response.assign(all);
             break;
         }
-        size_t pos = cmd.find('|');
-        if (pos != std::string::npos)
+        if (cmd[0] == 'o')
+        {
+            long          id;
+            unsigned long length;
+            if (!takeKey(args, id) || !takeChar(args, ',') || !takeNumber(args, 10, length) || !args.empty())
+            {
+                break;
+            }
+            BlobStore::Result result = blobStore.Open(id, length, sequence + 1, purgedSequence);
+            if (result == BlobStore::RESULT_FULL)
+            {
+                Logger::Log(LOG_STORAGE_FULL, static_cast<uint32_t>(id), static_cast<uint32_t>(length));
+            }
+            response.assign((result == BlobStore::RESULT_OK) ? "OK" : "OP_ERROR");
+            break;
+        }
+        if (cmd[0] == 'w')
         {
-            std::string hexPart  = cmd.substr(0, pos);
-            std::string dataPart = cmd.substr(pos + 1);
-            if (!isHex(hexPart))
+            long          id;
+            unsigned long offset;
+            if (!takeKey(args, id) || !takeChar(args, ',') || !takeNumber(args, 10, offset) || !takeChar(args, '|') || args.empty())
             {
                 break;
             }
-            if (dataPart.empty())
+            response.assign(blobStore.Write(id, offset, args.data(), args.size()) ? "OK" : "OP_ERROR");
+            break;
+        }
+        if (cmd[0] == 'k')
+        {
+            long          id;
+            unsigned long length;
+            unsigned long crc;
+            if (!takeKey(args, id) || !takeChar(args, ',') || !takeNumber(args, 10, length) || !takeChar(args, ',') || !takeNumber(args, 16, crc) ||
+                !args.empty())
             {
                 break;
             }
-            long id = strtol(hexPart.c_str(), nullptr, 16);
-            if (writeData(id, dataPart))
+            int64_t start  = esp_timer_get_time();
+            bool    stored = commitStream(id, length, static_cast<uint32_t>(crc));
+            tierStats[TIER_BLOB].writes++;
+            tierStats[TIER_BLOB].write_us += esp_timer_get_time() - start;
+            if (!stored)
             {
-                code = "OK";
+                response.assign("OP_ERROR");
                 break;
             }
-            code = "OP_ERROR";
+            BlobStore::View value;
+            if (blobStore.Get(id, value))
+            {
+                notifyChange(id, value.Data(), value.Size());
+            }
+            response.assign("OK");
             break;
         }
-        if (!isHex(cmd))
+        if (cmd[0] == 'r')
         {
+            long          id;
+            unsigned long offset;
+            unsigned long length;
+            if (!takeKey(args, id) || !takeChar(args, ',') || !takeNumber(args, 10, offset) || !takeChar(args, ',') || !takeNumber(args, 10, length) ||
+                !args.empty())
+            {
+                break;
+            }
+            int64_t          start = esp_timer_get_time();
+            BlobStore::View  local;
+            BlobStore::View &slice = (view != nullptr) ? *view : local;
+            if (blobStore.Get(id, slice))
+            {
+                tierStats[TIER_BLOB].reads++;
+                tierStats[TIER_BLOB].read_us += esp_timer_get_time() - start;
+                if (offset >= slice.Size())
+                {
+                    slice.Reset();
+                    response.assign("OP_ERROR");
+                    break;
+                }
+                slice.Slice(offset, length);
+                if (view != nullptr)
+                {
+                    response.clear();
+                    break;
+                }
+                response.assign(slice.Data(), slice.Size());
+                break;
+            }
+            // Values of the other tiers are small enough to be read whole, and are cut in place.
+            if (!readValue(id, response) || offset >= response.size())
+            {
+                response.assign("OP_ERROR");
+                break;
+            }
+            response.erase(0, offset);
+            response.resize(std::min<size_t>(response.size(), length));
             break;
         }
-        long        id    = strtol(cmd.c_str(), nullptr, 16);
-        std::string found = readDataById(id);
-        if (found.empty())
+        size_t pos = cmd.find('|');
+        if (pos != std::string_view::npos)
         {
-            code = "OP_ERROR";
+            std::string_view key  = cmd.substr(0, pos);
+            std::string_view data = cmd.substr(pos + 1);
+            long             id;
+            unsigned long    ttl = 0;
+            if (!takeKey(key, id) || (takeChar(key, ':') && !takeNumber(key, 10, ttl)) || !key.empty() || data.empty())
+            {
+                break;
+            }
+            int64_t     start  = esp_timer_get_time();
+            Tier        tier   = TIER_FILE;
+            WriteResult result = writeData(id, data, (ttl > 0) ? now() + static_cast<uint32_t>(ttl) : 0, tier);
+            tierStats[tier].writes++;
+            tierStats[tier].write_us += esp_timer_get_time() - start;
+            if (result == WRITE_OK)
+            {
+                SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, false);
+                notifyChange(id, data.data(), data.size());
+                response.assign("OK");
+                break;
+            }
+            if (result == WRITE_FULL)
+            {
+                // A full store is a quota decision, not a storage fault.
+                Logger::Log(LOG_STORAGE_FULL, static_cast<uint32_t>(id), static_cast<uint32_t>(data.size()));
+                response.assign("OP_ERROR");
+                break;
+            }
+            Logger::Log(LOG_STORAGE_WRITE, static_cast<uint32_t>(id));
+            SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, true);
+            response.assign("OP_ERROR");
             break;
         }
-        code = found;
+        long id;
+        if (cmd[0] == 'v')
+        {
+            if (!takeKey(args, id) || !args.empty())
+            {
+                break;
+            }
+            int64_t start = esp_timer_get_time();
+            if (view != nullptr && blobStore.Get(id, *view))
+            {
+                // The transport sends the value from the mapping; values in other tiers are copied below.
+                tierStats[TIER_BLOB].reads++;
+                tierStats[TIER_BLOB].read_us += esp_timer_get_time() - start;
+                response.clear();
+                break;
+            }
+        }
+        else
+        {
+            args = cmd;
+            if (!takeKey(args, id) || !args.empty())
+            {
+                break;
+            }
+        }
+        if (!readValue(id, response))
+        {
+            response.assign("OP_ERROR");
+        }
     } while (0);
-    return code;
 }
 
-bool FlashManager::writeData(long id, const std::string &data)
+bool FlashManager::readValue(long id, std::string &value)
 {
-    FILE *f = fopen((std::string(MOUNT_POINT) + "/" + DATA_FILE).c_str(), "r");
-    if (!f)
+    bool            expired = false;
+    bool            deleted = false;
+    bool            found   = false;
+    int64_t         start   = esp_timer_get_time();
+    BlobStore::View blob;
+    Tier            tier = TIER_NVS;
+    if (nvsTier.Read(id, value, &deleted))
     {
-        return false;
+        // A key in the small-value tier is never in the data file.
+        found = !deleted;
     }
-
-    std::string content;
-    bool        found = false;
-    char        lineBuf[256];
-
-    while (fgets(lineBuf, sizeof(lineBuf), f))
+    else if (blobStore.Contains(id, &deleted))
     {
-        std::string line(lineBuf);
-        if (!line.empty() && line.back() == '\n')
-        {
-            line.pop_back();
-        }
-
-        std::string match = "c$" + std::to_string(id) + "$";
-        if (line.rfind(match, 0) == 0)
+        tier = TIER_BLOB;
+        if (!deleted && blobStore.Get(id, blob))
         {
-            content += match + data + "\n";
+            value.assign(blob.Data(), blob.Size());
             found = true;
         }
-        else
+    }
+    else
+    {
+        tier  = TIER_FILE;
+        found = readCache.Get(id, now(), value);
+        if (!found)
         {
-            content += line + "\n";
+            uint32_t expiry = 0;
+            found           = readDataById(id, value, &expired, &expiry);
+            if (found)
+            {
+                readCache.Put(id, value, expiry);
+            }
         }
     }
-    fclose(f);
-
-    if (!found)
+    tierStats[tier].reads++;
+    tierStats[tier].read_us += esp_timer_get_time() - start;
+    if (expired && deleteDataById(id))
     {
-        content += "c$" + std::to_string(id) + "$" + data + "\n";
+        // Expired records are removed lazily, when they are next accessed.
+        expiredCount++;
+        notifyChange(id, nullptr, 0);
     }
-
-    f = fopen((std::string(MOUNT_POINT) + "/" + DATA_FILE).c_str(), "w");
-    if (!f)
+    if (found && tier == TIER_FILE)
     {
-        return false;
+        touch(id);
     }
+    return found;
+}
+
+void FlashManager::SetChangeListener(ChangeListener listener, void *context)
+{
+    changeListener = listener;
+    changeContext  = context;
+}
 
-    if (fputs(content.c_str(), f) == EOF)
+void FlashManager::notifyChange(long id, const char *data, size_t size) const
+{
+    if (changeListener != nullptr)
     {
-        fclose(f);
-        return false;
+        changeListener(id, data, size, changeContext);
     }
+}
 
-    fclose(f);
-    return true;
+std::string FlashManager::CompressionStats() const
+{
+    return std::to_string(codecStats.compressed) + "," + std::to_string(codecStats.plain) + "," + std::to_string(codecStats.raw_bytes) + "," +
+           std::to_string(codecStats.stored_bytes) + "," + std::to_string(codecStats.compress_us) + "," + std::to_string(codecStats.reads) + "," +
+           std::to_string(codecStats.decompress_us);
 }
 
-std::string FlashManager::readAllData() const
+FlashManager::WriteResult FlashManager::writeData(long id, std::string_view data, uint32_t expiry, Tier &tier)
 {
-    FILE *f = fopen((std::string(MOUNT_POINT) + "/" + DATA_FILE).c_str(), "r");
-    if (!f)
-    {
-        return "";
-    }
+    // Dropped up front, since the value changes or moves to another tier even if the write fails part way.
+    readCache.Invalidate(id);
 
-    std::string result;
-    char        lineBuf[256];
+    bool nvsDeleted = false;
+    bool inNvs      = nvsTier.Contains(id, &nvsDeleted);
+    bool inBlob     = blobStore.Contains(id, nullptr);
 
-    while (fgets(lineBuf, sizeof(lineBuf), f))
+    // Records with a TTL need the expiry attribute, so only plain small values use NVS.
+    if (expiry == 0 && nvsTier.Accepts(data.size()))
     {
-        std::string line(lineBuf);
-        if (!line.empty() && line.back() == '\n')
+        tier = TIER_NVS;
+        if (!(inNvs || inBlob || recordLength(id) == 0 || deleteDataById(id)))
+        {
+            return WRITE_FAILED;
+        }
+        NvsTier::Result result = nvsTier.Put(id, sequence + 1, data);
+        if (result == NvsTier::RESULT_FAILED)
         {
-            line.pop_back();
+            return WRITE_FAILED;
         }
-        if (!line.empty())
+        if (result == NvsTier::RESULT_OK)
         {
-            result += line + "\n";
+            sequence++;
+            if (!inNvs || nvsDeleted)
+            {
+                nvsRecords++;
+            }
+            // The new value supersedes the old large one, so no tombstone is needed.
+            if (inBlob)
+            {
+                blobStore.Erase(id);
+            }
+            return WRITE_OK;
         }
+        // The NVS partition is full, so the value goes to the data file below.
+        tier = TIER_FILE;
     }
-    fclose(f);
 
-    if (!result.empty() && result.back() == '\n')
+    // Large values are not compressed, so reads can send them from the mapped partition as stored.
+    if (expiry == 0 && blobStore.Accepts(data.size()))
     {
-        result.pop_back();
+        tier = TIER_BLOB;
+        if (!(inNvs || inBlob || recordLength(id) == 0 || deleteDataById(id)))
+        {
+            return WRITE_FAILED;
+        }
+        BlobStore::Result result = blobStore.Put(id, sequence + 1, data, purgedSequence);
+        if (result != BlobStore::RESULT_OK)
+        {
+            return (result == BlobStore::RESULT_FULL) ? WRITE_FULL : WRITE_FAILED;
+        }
+        sequence++;
+        if (inNvs && nvsTier.Erase(id) && !nvsDeleted)
+        {
+            nvsRecords--;
+        }
+        return WRITE_OK;
     }
 
-    return result;
-}
-
-std::string FlashManager::readDataById(long id) const
-{
-    FILE *f = fopen((std::string(MOUNT_POINT) + "/" + DATA_FILE).c_str(), "r");
-    if (!f)
+    std::string_view stored = data;
+    char             tag    = RECORD_PLAIN;
+#if CONFIG_APP_STORAGE_COMPRESSION
+    int64_t start = esp_timer_get_time();
+    if (RecordCodec::Compress(data, encoded, codecWork))
     {
-        return "";
+        stored = encoded;
+        tag    = RECORD_COMPRESSED;
     }
+    codecStats.compress_us += esp_timer_get_time() - start;
+#endif
 
-    std::string match = "c$" + std::to_string(id) + "$";
-    char        lineBuf[256];
-    std::string found;
-
-    while (fgets(lineBuf, sizeof(lineBuf), f))
+    RecordHeader record = {};
+    record.tag          = tag;
+    record.id           = id;
+    record.expiry       = expiry;
+    record.sequence     = sequence + 1;
+    char headerBuf[HEADER_BUF_SIZE];
+    if (!makeRoom(id, formatHeader(headerBuf, record) + stored.size() + 1))
     {
-        std::string line(lineBuf);
-        if (!line.empty() && line.back() == '\n')
-        {
-            line.pop_back();
-        }
-
-        if (line.rfind(match, 0) == 0)
-        {
-            found = line.substr(match.size());
-            break;
-        }
+        return WRITE_FULL;
+    }
+    if (!rewriteRecord(id, stored.data(), stored.size(), tag, expiry))
+    {
+        return WRITE_FAILED;
+    }
+    // The file record supersedes the old value of the other tiers, so no tombstone is needed.
+    if (inNvs && nvsTier.Erase(id) && !nvsDeleted)
+    {
+        nvsRecords--;
+    }
+    if (inBlob)
+    {
+        blobStore.Erase(id);
     }
-    fclose(f);
 
-    if (!found.empty())
+    if (tag == RECORD_COMPRESSED)
     {
+        codecStats.compressed++;
+        codecStats.raw_bytes += data.size();
+        codecStats.stored_bytes += stored.size();
     }
     else
     {
+        codecStats.plain++;
     }
-
-    return found;
+    touch(id);
+    return WRITE_OK;
 }
 
-bool FlashManager::deleteFile()
+bool FlashManager::commitStream(long id, size_t length, uint32_t crc)
 {
-    std::string filePath = std::string(MOUNT_POINT) + "/" + DATA_FILE;
-    if (remove(filePath.c_str()) == 0)
+    // Verified first, so a corrupt stream does not delete the current value.
+    if (!blobStore.Verify(id, length, crc))
     {
-        return true;
+        return false;
     }
-    else
+
+    bool nvsDeleted = false;
+    bool inNvs      = nvsTier.Contains(id, &nvsDeleted);
+    bool inBlob     = blobStore.Contains(id, nullptr);
+    if (!(inNvs || inBlob || recordLength(id) == 0 || deleteDataById(id)))
     {
         return false;
     }
-}
-
-bool FlashManager::createFile()
-{
-    std::string filePath = std::string(MOUNT_POINT) + "/" + DATA_FILE;
-    FILE       *f        = fopen(filePath.c_str(), "r");
-    if (!f)
+    if (!blobStore.Commit(id, sequence + 1))
     {
-        f = fopen(filePath.c_str(), "w");
-        if (!f)
-        {
-            return false;
-        }
-        fclose(f);
+        return false;
     }
-    else
+    sequence++;
+    if (inNvs && nvsTier.Erase(id) && !nvsDeleted)
     {
-        fclose(f);
+        nvsRecords--;
     }
     return true;
 }
-bool FlashManager::deleteDataById(long id)
+
+bool FlashManager::decodeRecord(const char *in, size_t len, std::string &out) const
+{
+    int64_t start = esp_timer_get_time();
+    bool    ok    = RecordCodec::Decompress(in, len, out, codecWork);
+    codecStats.decompress_us += esp_timer_get_time() - start;
+    codecStats.reads++;
+    return ok;
+}
+
+std::string FlashManager::readAllData() const
 {
-    FILE *f = fopen((std::string(MOUNT_POINT) + "/" + DATA_FILE).c_str(), "r");
+    FILE *f = fopen(DATA_PATH, "r");
     if (!f)
     {
-        return false;
+        return "";
     }
 
-    std::string content;
-    std::string match = "c$" + std::to_string(id) + "$";
-    char        lineBuf[256];
-    bool        found = false;
+    std::string  result;
+    std::string  packed;
+    std::string  value;
+    char         lineBuf[LINE_BUF_SIZE];
+    RecordHeader header    = {};
+    bool         lineStart = true;
+    bool         valid     = false;
+    bool         skip      = false;
+    uint32_t     current   = now();
 
     while (fgets(lineBuf, sizeof(lineBuf), f))
     {
-        std::string line(lineBuf);
-        if (!line.empty() && line.back() == '\n')
+        size_t len     = strlen(lineBuf);
+        bool   lineEnd = (len > 0 && lineBuf[len - 1] == '\n');
+        size_t end     = lineEnd ? len - 1 : len;
+        size_t offset  = 0;
+
+        if (lineStart)
         {
-            line.pop_back();
+            valid = parseHeader(lineBuf, header);
+            skip  = valid && (!isData(header.tag) || isExpired(header.expiry, current));
+            if (valid && !skip)
+            {
+                // Records are returned in the plain `c$<id>$<data>` form, whatever their tag and attributes.
+                result += RECORD_PLAIN;
+                result += '$';
+                result += std::to_string(header.id);
+                result += '$';
+                offset = header.length;
+                packed.clear();
+            }
         }
 
-        if (line.rfind(match, 0) == 0)
+        if (!valid)
         {
-            found = true;
-            continue;
+            if (!(lineStart && lineBuf[0] == '\n'))
+            {
+                result += lineBuf;
+            }
         }
-        content += line + "\n";
-    }
-    fclose(f);
+        else if (!skip)
+        {
+            if (header.tag == RECORD_COMPRESSED)
+            {
+                packed.append(lineBuf + offset, end - offset);
+            }
+            else
+            {
+                result.append(lineBuf + offset, end - offset);
+            }
 
-    if (!found)
+            if (lineEnd)
+            {
+                if (header.tag == RECORD_COMPRESSED && decodeRecord(packed.data(), packed.size(), value))
+                {
+                    result += value;
+                }
+                result += '\n';
+            }
+        }
+        lineStart = lineEnd;
+    }
+    fclose(f);
+
+    for (const NvsTier::Entry &entry : nvsTier.List(0, false))
     {
-        return false;
+        result += RECORD_PLAIN;
+        result += '$';
+        result += std::to_string(entry.id);
+        result += '$';
+        result += entry.data;
+        result += '\n';
+    }
+    for (const NvsTier::Entry &entry : blobStore.List(0, false))
+    {
+        BlobStore::View blob;
+        if (!blobStore.Get(entry.id, blob))
+        {
+            continue;
+        }
+        result += RECORD_PLAIN;
+        result += '$';
+        result += std::to_string(entry.id);
+        result += '$';
+        result.append(blob.Data(), blob.Size());
+        result += '\n';
+    }
+
+    if (!result.empty() && result.back() == '\n')
+    {
+        result.pop_back();
+    }
+
+    return result;
+}
+
+std::string FlashManager::readChanges(uint32_t since, uint32_t purged) const
+{
+    // A mirror older than the last clear or than a purged tombstone cannot be patched. A resync
+    // cursor is older than the tombstones purged before it was issued, so for it only a purge
+    // that happened since counts.
+    bool reset = since < resetSequence || (since < purgedSequence && purgedSequence > purged);
+    if (reset)
+    {
+        since = 0;
+    }
+
+    FILE *f = fopen(DATA_PATH, "r");
+    if (!f)
+    {
+        return "";
+    }
+
+    std::string  changes;
+    std::string  packed;
+    std::string  value;
+    char         lineBuf[LINE_BUF_SIZE];
+    char         headerBuf[HEADER_BUF_SIZE];
+    RecordHeader header    = {};
+    uint32_t     last      = since;
+    bool         lineStart = true;
+    bool         skip      = true;
+    bool         more      = false;
+
+    // Changes of the other tiers are merged in by sequence number.
+    std::vector<NvsTier::Entry> others = nvsTier.List(since, since > 0);
+    std::vector<NvsTier::Entry> large  = blobStore.List(since, since > 0);
+    size_t                      split  = others.size();
+    others.insert(others.end(), std::make_move_iterator(large.begin()), std::make_move_iterator(large.end()));
+    std::inplace_merge(others.begin(), others.begin() + split, others.end(),
+                       [](const NvsTier::Entry &a, const NvsTier::Entry &b) { return a.sequence < b.sequence; });
+    size_t next       = 0;
+    auto   emitOthers = [&](uint32_t bound)
+    {
+        for (; next < others.size() && others[next].sequence < bound; ++next)
+        {
+            const NvsTier::Entry &entry = others[next];
+            if (changes.size() >= SYNC_CHUNK_BYTES && entry.sequence > last)
+            {
+                return false;
+            }
+            RecordHeader change = {};
+            change.tag          = entry.deleted ? RECORD_TOMBSTONE : RECORD_PLAIN;
+            change.id           = entry.id;
+            change.sequence     = entry.sequence;
+            formatHeader(headerBuf, change);
+            changes += '\n';
+            changes += headerBuf;
+            changes += entry.data;
+
+            // Large values are listed without data and copied from the mapping only when emitted.
+            BlobStore::View blob;
+            if (!entry.deleted && entry.data.empty() && blobStore.Get(entry.id, blob))
+            {
+                changes.append(blob.Data(), blob.Size());
+            }
+            last = entry.sequence;
+        }
+        return true;
+    };
+
+    // The file is in sequence order, so a page ends at the first record past the size budget.
+    while (fgets(lineBuf, sizeof(lineBuf), f))
+    {
+        size_t len     = strlen(lineBuf);
+        bool   lineEnd = (len > 0 && lineBuf[len - 1] == '\n');
+        size_t end     = lineEnd ? len - 1 : len;
+        size_t offset  = 0;
+
+        if (lineStart)
+        {
+            skip = !parseHeader(lineBuf, header) || header.tag == RECORD_META || (since > 0 && header.sequence <= since) ||
+                   (since == 0 && header.tag == RECORD_TOMBSTONE);
+            if (!skip)
+            {
+                if (!emitOthers(header.sequence) || (changes.size() >= SYNC_CHUNK_BYTES && header.sequence > last))
+                {
+                    more = true;
+                    break;
+                }
+                RecordHeader change = header;
+                change.tag          = isData(header.tag) ? RECORD_PLAIN : RECORD_TOMBSTONE;
+                formatHeader(headerBuf, change);
+                changes += '\n';
+                changes += headerBuf;
+                offset = header.length;
+                packed.clear();
+                if (header.sequence > last)
+                {
+                    last = header.sequence;
+                }
+            }
+        }
+
+        if (!skip)
+        {
+            if (header.tag == RECORD_COMPRESSED)
+            {
+                packed.append(lineBuf + offset, end - offset);
+                if (lineEnd && decodeRecord(packed.data(), packed.size(), value))
+                {
+                    changes += value;
+                }
+            }
+            else
+            {
+                changes.append(lineBuf + offset, end - offset);
+            }
+        }
+        lineStart = lineEnd;
+    }
+    fclose(f);
+
+    if (!more && !emitOthers(UINT32_MAX))
+    {
+        more = true;
     }
 
-    f = fopen((std::string(MOUNT_POINT) + "/" + DATA_FILE).c_str(), "w");
+    // A cursor below the purged tombstones carries the purge it was issued under.
+    std::string cursor = std::to_string(more ? last : sequence);
+    if (more && last < purgedSequence)
+    {
+        cursor += 'r' + std::to_string(purgedSequence);
+    }
+    return std::to_string(sequence) + "," + cursor + "," + (more ? "1" : "0") + "," + (reset ? "1" : "0") + changes;
+}
+
+bool FlashManager::readDataById(long id, std::string &value, bool *expired, uint32_t *expiry) const
+{
+    FILE *f = openFile(DATA_PATH, "r", readBuffer);
     if (!f)
+    {
+        // Unlike a missing key, an unreadable data file is a storage error.
+        SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, true);
+        return false;
+    }
+
+    char         match[PREFIX_BUF_SIZE];
+    size_t       matchLen = formatPrefix(match, id);
+    char         lineBuf[LINE_BUF_SIZE];
+    RecordHeader header    = {};
+    bool         lineStart = true;
+    std::string *found     = nullptr; // A compressed record is gathered in `encoded` and decoded into `value`.
+
+    while (fgets(lineBuf, sizeof(lineBuf), f))
+    {
+        size_t len     = strlen(lineBuf);
+        bool   lineEnd = (len > 0 && lineBuf[len - 1] == '\n');
+
+        if (found != nullptr)
+        {
+            // Continuation of a record longer than the line buffer.
+            found->append(lineBuf, lineEnd ? len - 1 : len);
+        }
+        else if (lineStart && isRecord(lineBuf, match, matchLen) && parseHeader(lineBuf, header))
+        {
+            found = (header.tag == RECORD_COMPRESSED) ? &encoded : &value;
+            found->assign(lineBuf + header.length, (lineEnd ? len - 1 : len) - header.length);
+        }
+
+        if (found != nullptr && lineEnd)
+        {
+            break;
+        }
+        lineStart = lineEnd;
+    }
+    bool failed = ferror(f) != 0;
+    fclose(f);
+    SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, failed);
+
+    if (failed || found == nullptr || header.tag == RECORD_TOMBSTONE)
+    {
+        return false;
+    }
+    if (isExpired(header.expiry, now()))
+    {
+        *expired = true;
+        return false;
+    }
+    *expiry = header.expiry;
+    if (header.tag == RECORD_COMPRESSED && !decodeRecord(encoded.data(), encoded.size(), value))
+    {
+        SystemEvents::SetState(SystemEvents::STATE_STORAGE_ERROR, true);
+        return false;
+    }
+    return true;
+}
+
+FILE *FlashManager::openFile(const char *path, const char *mode, char *buffer)
+{
+    FILE *f = fopen(path, mode);
+    if (f != nullptr)
+    {
+        setvbuf(f, buffer, _IOFBF, STDIO_BUF_SIZE);
+    }
+    return f;
+}
+
+bool FlashManager::deleteFile()
+{
+    // A file already gone, e.g. after a clear that failed to create the new one, counts as deleted.
+    if (remove(DATA_PATH) == 0 || errno == ENOENT)
+    {
+        return true;
+    }
+    else
     {
         return false;
     }
+}
 
-    if (fputs(content.c_str(), f) == EOF)
+bool FlashManager::createFile()
+{
+    FILE *f = fopen(DATA_PATH, "r");
+    if (!f)
+    {
+        // Finish a rewrite interrupted between removing the old file and renaming the new one.
+        if (rename(TEMP_PATH, DATA_PATH) == 0)
+        {
+            return true;
+        }
+        f = fopen(DATA_PATH, "w");
+        if (!f)
+        {
+            return false;
+        }
+        bool ok = writeRecord(f, metaHeader(sequence, purgedSequence), nullptr, 0) > 0;
+        if (fclose(f) != 0 || !ok)
+        {
+            return false;
+        }
+    }
+    else
     {
         fclose(f);
+    }
+    return true;
+}
+bool FlashManager::removeRecord(long id)
+{
+    bool deleted = false;
+    if (blobStore.Contains(id, &deleted))
+    {
+        if (deleted || !blobStore.Remove(id, sequence + 1, purgedSequence))
+        {
+            return false;
+        }
+        sequence++;
+        return true;
+    }
+
+    if (!nvsTier.Contains(id, &deleted))
+    {
+        return deleteDataById(id);
+    }
+    if (deleted)
+    {
+        return false;
+    }
+    NvsTier::Result result = nvsTier.Remove(id, sequence + 1, purgedSequence);
+    if (result == NvsTier::RESULT_FULL)
+    {
+        // The NVS partition has no room for the tombstone, so the data file keeps it instead.
+        if (!nvsTier.Erase(id) || !rewriteRecord(id, nullptr, 0, RECORD_TOMBSTONE, 0))
+        {
+            return false;
+        }
+        nvsRecords--;
+        return true;
+    }
+    if (result != NvsTier::RESULT_OK)
+    {
+        return false;
+    }
+    sequence++;
+    nvsRecords--;
+    return true;
+}
+
+bool FlashManager::deleteDataById(long id)
+{
+    readCache.Invalidate(id);
+    return rewriteRecord(id, nullptr, 0, RECORD_PLAIN, 0);
+}
+
+size_t FlashManager::formatPrefix(char *buf, long id)
+{
+    return snprintf(buf, PREFIX_BUF_SIZE, "%c$%ld", RECORD_PLAIN, id);
+}
+
+bool FlashManager::isRecord(const char *line, const char *prefix, size_t prefixLen)
+{
+    return (isData(line[0]) || line[0] == RECORD_TOMBSTONE) && strncmp(line + 1, prefix + 1, prefixLen - 1) == 0 &&
+           (line[prefixLen] == '$' || line[prefixLen] == ';');
+}
+
+bool FlashManager::isData(char tag)
+{
+    return tag == RECORD_PLAIN || tag == RECORD_COMPRESSED;
+}
+
+bool FlashManager::parseHeader(const char *line, RecordHeader &header)
+{
+    if ((!isData(line[0]) && line[0] != RECORD_TOMBSTONE && line[0] != RECORD_META) || line[1] != '$')
+    {
         return false;
     }
+    char *end;
+    header     = {};
+    header.tag = line[0];
+    header.id  = strtol(line + 2, &end, 10);
+    if (end == line + 2)
+    {
+        return false;
+    }
+    while (*end == ';' && end[1] != '\0')
+    {
+        char          attribute = end[1];
+        char         *value     = end + 2;
+        unsigned long number    = strtoul(value, &end, 10);
+        if (end == value)
+        {
+            return false;
+        }
+        if (attribute == ATTR_EXPIRY)
+        {
+            header.expiry = number;
+        }
+        else if (attribute == ATTR_SEQUENCE)
+        {
+            header.sequence = number;
+        }
+        else if (attribute == ATTR_RESET)
+        {
+            header.reset = number;
+        }
+        else if (attribute == ATTR_PURGED)
+        {
+            header.purged = number;
+        }
+        else if (attribute == ATTR_CLOCK)
+        {
+            header.clock = number;
+        }
+    }
+    if (*end != '$')
+    {
+        return false;
+    }
+    header.length = end + 1 - line;
+    return true;
+}
 
+size_t FlashManager::formatHeader(char *buf, const RecordHeader &header)
+{
+    int len = snprintf(buf, HEADER_BUF_SIZE, "%c$%ld", header.tag, header.id);
+    if (header.expiry != 0)
+    {
+        len += snprintf(buf + len, HEADER_BUF_SIZE - len, ";%c%lu", ATTR_EXPIRY, static_cast<unsigned long>(header.expiry));
+    }
+    if (header.sequence != 0)
+    {
+        len += snprintf(buf + len, HEADER_BUF_SIZE - len, ";%c%lu", ATTR_SEQUENCE, static_cast<unsigned long>(header.sequence));
+    }
+    if (header.reset != 0)
+    {
+        len += snprintf(buf + len, HEADER_BUF_SIZE - len, ";%c%lu", ATTR_RESET, static_cast<unsigned long>(header.reset));
+    }
+    if (header.purged != 0)
+    {
+        len += snprintf(buf + len, HEADER_BUF_SIZE - len, ";%c%lu", ATTR_PURGED, static_cast<unsigned long>(header.purged));
+    }
+    if (header.clock != 0)
+    {
+        len += snprintf(buf + len, HEADER_BUF_SIZE - len, ";%c%lu", ATTR_CLOCK, static_cast<unsigned long>(header.clock));
+    }
+    len += snprintf(buf + len, HEADER_BUF_SIZE - len, "$");
+    return len;
+}
+
+FlashManager::RecordHeader FlashManager::metaHeader(uint32_t current, uint32_t purged) const
+{
+    RecordHeader header = {};
+    header.tag          = RECORD_META;
+    header.sequence     = current;
+    header.reset        = resetSequence;
+    header.purged       = purged;
+    header.clock        = now();
+    return header;
+}
+
+size_t FlashManager::writeRecord(FILE *out, const RecordHeader &header, const char *data, size_t size)
+{
+    char   headerBuf[HEADER_BUF_SIZE];
+    size_t headerLen = formatHeader(headerBuf, header);
+    if (fputs(headerBuf, out) == EOF || (size > 0 && fwrite(data, 1, size, out) != size) || fputc('\n', out) == EOF)
+    {
+        return 0;
+    }
+    return headerLen + size + 1;
+}
+
+bool FlashManager::rewriteRecord(long id, const char *data, size_t size, char tag, uint32_t expiry)
+{
+    FILE *in = openFile(DATA_PATH, "r", readBuffer);
+    if (!in)
+    {
+        return false;
+    }
+    FILE *out = openFile(TEMP_PATH, "w", writeBuffer);
+    if (!out)
+    {
+        fclose(in);
+        return false;
+    }
+
+    char         lineBuf[LINE_BUF_SIZE];
+    RecordHeader header    = {};
+    uint32_t     next      = sequence + 1;
+    uint32_t     purged    = purgedSequence;
+    size_t       written   = 0;
+    bool         lineStart = true;
+    bool         skipping  = false;
+    bool         found     = false;
+    bool         ok        = true;
+
+    // Records are copied chunk by chunk, so the file is never held in RAM. The new version of a
+    // record goes to the end, which keeps the file in sequence order. The old version, a previous
+    // tombstone of the record, tombstones past the horizon and the meta line are dropped.
+    while (ok && fgets(lineBuf, sizeof(lineBuf), in))
+    {
+        size_t len     = strlen(lineBuf);
+        bool   lineEnd = (len > 0 && lineBuf[len - 1] == '\n');
+
+        if (lineStart)
+        {
+            skipping = false;
+            if (parseHeader(lineBuf, header))
+            {
+                if (header.tag == RECORD_META)
+                {
+                    skipping = true;
+                }
+                else if (header.tag == RECORD_TOMBSTONE)
+                {
+                    bool pastHorizon = header.sequence + CONFIG_APP_STORAGE_TOMBSTONE_HORIZON < next;
+                    skipping         = (header.id == id) || pastHorizon;
+                    if (header.id != id && pastHorizon && header.sequence > purged)
+                    {
+                        purged = header.sequence;
+                    }
+                }
+                else if (header.id == id)
+                {
+                    found    = true;
+                    skipping = true;
+                }
+            }
+        }
+
+        if (!skipping)
+        {
+            ok = fputs(lineBuf, out) != EOF;
+            written += len;
+        }
+        lineStart = lineEnd;
+    }
+    fclose(in);
+
+    if (ok && !lineStart)
+    {
+        ok = fputc('\n', out) != EOF;
+        written++;
+    }
+    if (ok && (data != nullptr || found || tag == RECORD_TOMBSTONE))
+    {
+        RecordHeader record = {};
+        record.tag          = (data != nullptr) ? tag : RECORD_TOMBSTONE;
+        record.id           = id;
+        record.expiry       = (data != nullptr) ? expiry : 0;
+        record.sequence     = next;
+        size_t len          = writeRecord(out, record, data, size);
+        ok                  = len > 0;
+        written += len;
+    }
+    if (ok)
+    {
+        size_t len = writeRecord(out, metaHeader(next, purged), nullptr, 0);
+        ok         = len > 0;
+        written += len;
+    }
+    ok = (fclose(out) == 0) && ok;
+
+    if (!ok || (!found && data == nullptr && tag != RECORD_TOMBSTONE))
+    {
+        remove(TEMP_PATH);
+        return false;
+    }
+
+    // SPIFFS cannot rename over an existing file; createFile() recovers if power is lost in between.
+    if (remove(DATA_PATH) != 0 || rename(TEMP_PATH, DATA_PATH) != 0)
+    {
+        return false;
+    }
+    sequence       = next;
+    purgedSequence = purged;
+    fileBytes      = written;
+    if (data == nullptr && found)
+    {
+        recordCount--;
+    }
+    else if (data != nullptr && !found)
+    {
+        recordCount++;
+    }
+    return true;
+}
+
+bool FlashManager::sequenceRecords()
+{
+    FILE *in = fopen(DATA_PATH, "r");
+    if (!in)
+    {
+        return false;
+    }
+    FILE *out = fopen(TEMP_PATH, "w");
+    if (!out)
+    {
+        fclose(in);
+        return false;
+    }
+
+    char         lineBuf[LINE_BUF_SIZE];
+    char         headerBuf[HEADER_BUF_SIZE];
+    RecordHeader header    = {};
+    uint32_t     next      = sequence;
+    bool         lineStart = true;
+    bool         skipping  = false;
+    bool         ok        = true;
+
+    // Records written before sequencing get consecutive numbers in file order.
+    while (ok && fgets(lineBuf, sizeof(lineBuf), in))
+    {
+        size_t len     = strlen(lineBuf);
+        bool   lineEnd = (len > 0 && lineBuf[len - 1] == '\n');
+        size_t offset  = 0;
+
+        if (lineStart)
+        {
+            skipping = false;
+            if (parseHeader(lineBuf, header))
+            {
+                if (header.tag == RECORD_META)
+                {
+                    skipping = true;
+                }
+                else if (header.sequence == 0)
+                {
+                    header.sequence = ++next;
+                    formatHeader(headerBuf, header);
+                    ok     = fputs(headerBuf, out) != EOF;
+                    offset = header.length;
+                }
+            }
+        }
+        if (ok && !skipping)
+        {
+            ok = fputs(lineBuf + offset, out) != EOF;
+        }
+        lineStart = lineEnd;
+    }
+    fclose(in);
+
+    if (ok && !lineStart)
+    {
+        ok = fputc('\n', out) != EOF;
+    }
+    ok = ok && writeRecord(out, metaHeader(next, purgedSequence), nullptr, 0) > 0;
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || remove(DATA_PATH) != 0 || rename(TEMP_PATH, DATA_PATH) != 0)
+    {
+        remove(TEMP_PATH);
+        return false;
+    }
+    sequence = next;
+    return scanStore(nullptr);
+}
+
+bool FlashManager::scanStore(uint32_t *unsequenced)
+{
+    FILE *f = fopen(DATA_PATH, "r");
+    if (!f)
+    {
+        return false;
+    }
+
+    char         lineBuf[LINE_BUF_SIZE];
+    RecordHeader header    = {};
+    bool         lineStart = true;
+    recordCount            = 0;
+    fileBytes              = 0;
+
+    while (fgets(lineBuf, sizeof(lineBuf), f))
+    {
+        size_t len = strlen(lineBuf);
+        if (lineStart && parseHeader(lineBuf, header))
+        {
+            if (header.tag == RECORD_META)
+            {
+                resetSequence  = header.reset;
+                purgedSequence = header.purged;
+                // After a reboot the clock resumes from the saved value; a rescan leaves it alone.
+                uint32_t current = now();
+                if (header.clock > current)
+                {
+                    clockBase += header.clock - current;
+                }
+            }
+            else if (isData(header.tag))
+            {
+                recordCount++;
+            }
+            // The meta line holds the last sequence, but a record may be newer if power was lost mid-rewrite.
+            if (header.sequence > sequence)
+            {
+                sequence = header.sequence;
+            }
+            if (header.tag != RECORD_META && header.sequence == 0 && unsequenced != nullptr)
+            {
+                (*unsequenced)++;
+            }
+        }
+        fileBytes += len;
+        lineStart = (len > 0 && lineBuf[len - 1] == '\n');
+    }
     fclose(f);
     return true;
 }
+
+size_t FlashManager::recordLength(long id) const
+{
+    FILE *f = openFile(DATA_PATH, "r", readBuffer);
+    if (!f)
+    {
+        return 0;
+    }
+
+    char   match[PREFIX_BUF_SIZE];
+    size_t matchLen = formatPrefix(match, id);
+    char   lineBuf[LINE_BUF_SIZE];
+    size_t length    = 0;
+    bool   lineStart = true;
+    bool   matched   = false;
+
+    while (fgets(lineBuf, sizeof(lineBuf), f))
+    {
+        size_t len     = strlen(lineBuf);
+        bool   lineEnd = (len > 0 && lineBuf[len - 1] == '\n');
+        if (matched || (lineStart && isRecord(lineBuf, match, matchLen) && lineBuf[0] != RECORD_TOMBSTONE))
+        {
+            matched = true;
+            length += len;
+            if (lineEnd)
+            {
+                break;
+            }
+        }
+        lineStart = lineEnd;
+    }
+    fclose(f);
+    return length;
+}
+
+size_t FlashManager::byteLimit() const
+{
+    return partitionTotal / 100 * highWaterPercent;
+}
+
+bool FlashManager::makeRoom(long id, size_t len)
+{
+    size_t limit    = byteLimit();
+    size_t existing = 0;
+    bool   checked  = false;
+
+    while (true)
+    {
+        bool overRecords = maxRecords > 0 && recordCount + (existing > 0 ? 0 : 1) > maxRecords;
+        bool overBytes   = limit > 0 && fileBytes - existing + len > limit;
+        if (!overRecords && !overBytes)
+        {
+            return true;
+        }
+        if (!checked)
+        {
+            // Replacing a record frees its current line, so find it only when a limit is close.
+            existing = recordLength(id);
+            checked  = true;
+            // Nothing is evicted when even evicting every candidate would not make the write fit.
+            if (limit > 0 && fileBytes - existing + len > limit + evictableBytes(id))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        long victim;
+        if (!selectVictim(id, victim) || !deleteDataById(victim))
+        {
+            return false;
+        }
+        evictedCount++;
+        Logger::Log(LOG_STORAGE_EVICT, static_cast<uint32_t>(victim));
+        notifyChange(victim, nullptr, 0);
+    }
+}
+
+size_t FlashManager::evictableBytes(long keep) const
+{
+    FILE *f = openFile(DATA_PATH, "r", readBuffer);
+    if (!f)
+    {
+        return 0;
+    }
+
+    char         lineBuf[LINE_BUF_SIZE];
+    char         headerBuf[HEADER_BUF_SIZE];
+    RecordHeader header     = {};
+    RecordHeader tombstone  = {};
+    bool         lineStart  = true;
+    bool         candidate  = false;
+    size_t       lineLength = 0;
+    size_t       total      = 0;
+    uint32_t     current    = now();
+    tombstone.tag           = RECORD_TOMBSTONE;
+    tombstone.sequence      = sequence + 1;
+
+    while (fgets(lineBuf, sizeof(lineBuf), f))
+    {
+        size_t len     = strlen(lineBuf);
+        bool   lineEnd = (len > 0 && lineBuf[len - 1] == '\n');
+        if (lineStart)
+        {
+            candidate = parseHeader(lineBuf, header) && isData(header.tag) && header.id != keep &&
+                        (policy != EVICT_NONE || isExpired(header.expiry, current));
+            lineLength = 0;
+        }
+        lineLength += len;
+        if (candidate && lineEnd)
+        {
+            // An evicted record leaves a tombstone behind.
+            tombstone.id     = header.id;
+            size_t remaining = formatHeader(headerBuf, tombstone) + 1;
+            total += (lineLength > remaining) ? lineLength - remaining : 0;
+        }
+        lineStart = lineEnd;
+    }
+    fclose(f);
+    return total;
+}
+
+bool FlashManager::selectVictim(long keep, long &victim) const
+{
+    FILE *f = openFile(DATA_PATH, "r", readBuffer);
+    if (!f)
+    {
+        return false;
+    }
+
+    char         lineBuf[LINE_BUF_SIZE];
+    RecordHeader header    = {};
+    bool         lineStart = true;
+    bool         found     = false;
+    uint32_t     bestTick  = UINT32_MAX;
+    uint32_t     current   = now();
+
+    // Expired records go first whatever the policy; otherwise the file order is the write order.
+    while (fgets(lineBuf, sizeof(lineBuf), f))
+    {
+        size_t len = strlen(lineBuf);
+        if (lineStart && parseHeader(lineBuf, header) && isData(header.tag) && header.id != keep)
+        {
+            if (isExpired(header.expiry, current))
+            {
+                victim = header.id;
+                found  = true;
+                break;
+            }
+            if (policy != EVICT_NONE)
+            {
+                uint32_t tick = (policy == EVICT_LRU) ? lastAccess(header.id) : 0;
+                if (tick < bestTick)
+                {
+                    victim   = header.id;
+                    bestTick = tick;
+                    found    = true;
+                }
+            }
+        }
+        lineStart = (len > 0 && lineBuf[len - 1] == '\n');
+    }
+    fclose(f);
+    return found;
+}
+
+void FlashManager::touch(long id)
+{
+    AccessEntry *slot = &accessLog[0];
+    for (AccessEntry &entry : accessLog)
+    {
+        if (entry.tick != 0 && entry.id == id)
+        {
+            slot = &entry;
+            break;
+        }
+        if (entry.tick < slot->tick)
+        {
+            slot = &entry;
+        }
+    }
+    slot->id   = id;
+    slot->tick = ++accessTick;
+}
+
+uint32_t FlashManager::lastAccess(long id) const
+{
+    for (const AccessEntry &entry : accessLog)
+    {
+        if (entry.tick != 0 && entry.id == id)
+        {
+            return entry.tick;
+        }
+    }
+    return 0;
+}
+
+uint32_t FlashManager::now() const
+{
+    return clockBase + static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+}
+
+bool FlashManager::isExpired(uint32_t expiry, uint32_t current)
+{
+    return expiry != 0 && current >= expiry;
+}
+
+std::string FlashManager::Capacity() const
+{
+    size_t total = 0, used = 0;
+    esp_spiffs_info(nullptr, &total, &used);
+    return std::to_string(recordCount) + "," + std::to_string(fileBytes) + "," + std::to_string(used) + "," + std::to_string(total) + "," +
+           std::to_string(byteLimit()) + "," + std::to_string(maxRecords) + "," + static_cast<char>(policy) + "," + std::to_string(evictedCount) +
+           "," + std::to_string(expiredCount) + "," + std::to_string(nvsRecords) + "," + blobStore.Usage();
+}
+
+std::string FlashManager::TierStats() const
+{
+    static const char *const NAMES[TIER_COUNT] = {"nvs", "file", "blob"};
+    std::string              result;
+    for (size_t i = 0; i < TIER_COUNT; ++i)
+    {
+        if (!result.empty())
+        {
+            result += "\n";
+        }
+        result += std::string(NAMES[i]) + "," + std::to_string(tierStats[i].writes) + "," + std::to_string(tierStats[i].write_us) + "," +
+                  std::to_string(tierStats[i].reads) + "," + std::to_string(tierStats[i].read_us);
+    }
+    return result;
+}
+
+bool FlashManager::setLimits(std::string_view args)
+{
+    unsigned long percent, records;
+    if (!takeNumber(args, 10, percent) || !takeChar(args, ',') || !takeNumber(args, 10, records) || !takeChar(args, ',') || args.size() != 1)
+    {
+        return false;
+    }
+    char mode = args[0];
+    if (percent < 1 || percent > MAX_HIGH_WATER_PERCENT || (mode != EVICT_NONE && mode != EVICT_OLDEST && mode != EVICT_LRU))
+    {
+        return false;
+    }
+    highWaterPercent = static_cast<uint8_t>(percent);
+    maxRecords       = records;
+    policy           = static_cast<EvictionPolicy>(mode);
+    return true;
+}
@@ -1,54 +1,306 @@
 #ifndef FLASH_MANAGER_HPP
 #define FLASH_MANAGER_HPP
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
 #include <string>
+#include <string_view>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include "NvsTier.hpp"
+#include "BlobStore.hpp"
+#include "ReadCache.hpp"
+#include "RecordCodec.hpp"
 
 /**
  * @brief Class responsible for managing SPIFFS filesystem operations on the ESP32.
+ *
+ * Records are stored one per line as `<tag>$<id>[;<attribute><value>...]$<data>`, where the tag
+ * tells whether the data is compressed and the optional attributes carry metadata such as the
+ * expiry time and sequence number.
+ *
+ * Values of up to `CONFIG_APP_STORAGE_NVS_MAX_VALUE` bytes without a TTL live in `NvsTier`
+ * instead, where an update does not rewrite the file, and values of at least
+ * `CONFIG_APP_STORAGE_BLOB_MIN_VALUE` bytes without a TTL live in `BlobStore`, where reads come
+ * straight from mapped flash. A key is in one tier at a time, and reads, `#` and delta syncs
+ * merge all of them. Large values can also be streamed into `BlobStore` in chunks, so they are
+ * never held in RAM whole.
+ *
+ * Every mutation takes the next sequence number. A deleted record leaves a tombstone line
+ * (`x$<id>;s<seq>$`) until it falls behind the tombstone horizon, and a trailing meta line
+ * (`m$0;s<seq>;r<reset>;p<purged>$`) keeps the counters across reboots. Since a written record
+ * always moves to the end, the file is in sequence order.
+ *
+ * Values read from the data file are kept in a `ReadCache`, which every write and delete of the
+ * key invalidates, so repeated reads of the same keys do not scan the file.
  */
 class FlashManager
 {
   public:
+    /**
+     * @brief Callback invoked after a record has been written or deleted.
+     * @param id Identifier of the changed record, or `ALL_RECORDS` when the whole store was cleared.
+     * @param data New record data, only valid during the call; `nullptr` when the record was deleted.
+     * @param size Length of `data`, 0 when the record was deleted.
+     * @param context Opaque pointer given to `SetChangeListener`.
+     */
+    using ChangeListener = void (*)(long id, const char *data, size_t size, void *context);
+
+    static constexpr long ALL_RECORDS = -1; ///< Identifier reported when every record is deleted.
+
     /**
      * @brief Default constructor.
      */
     FlashManager();
 
     /**
-     * @brief Initializes the SPIFFS filesystem.
+     * @brief Deletes the mutexes.
+     */
+    ~FlashManager();
+
+    /**
+     * @brief Mounts the SPIFFS filesystem and creates the data file.
      * @return `true` if initialization is successful, `false` otherwise.
+     *
+     * Safe to call repeatedly and from several tasks: the filesystem is mounted once, and
+     * `HandleCommand` calls it so the mount happens lazily on the first storage command.
      */
     bool Init();
 
     /**
      * @brief Processes a command and executes the corresponding action.
-     * @param cmdIn The input command.
-     * @return Response string after processing the command.
+     * @param cmd The input command.
+     * @param response Response after processing the command, assigned within its capacity so a
+     *        buffer reused across commands is not reallocated by get and put commands.
+     * @param view Optional output for `v<key>` and `r<key>`, set instead of copying the value into the response.
      *
      * Commands:
      * - `@`        : Deletes all stored data.
      * - `@<key>`   : Deletes data associated with the specified key (hexadecimal).
      * - `#`        : Returns all stored data.
      * - `<key>|<data>` : Stores or updates data for the given key.
+     * - `<key>:<ttl>|<data>` : Same, with the record expiring after `<ttl>` seconds (decimal) of
+     *   uptime, see `now()`.
      * - `<key>`    : Retrieves data associated with the specified key.
+     * - `v<key>`   : Same, but a value in the blob partition is returned through `view`, with an
+     *   empty response; the caller sends it from there and then releases the view.
+     * - `o<key>,<length>` : Opens a stream of `<length>` bytes (decimal) into the blob partition.
+     * - `w<key>,<offset>|<data>` : Writes a chunk of an open stream at `<offset>` (decimal). Chunks
+     *   must follow each other; a resent chunk is accepted if it matches what was written.
+     * - `k<key>,<length>,<crc>` : Commits a stream whose `<length>` bytes match the CRC-32 `<crc>`
+     *   (hexadecimal), replacing the value of the key in any tier. A CRC mismatch discards the stream.
+     * - `r<key>,<offset>,<length>` : Returns up to `<length>` bytes of the value from `<offset>`
+     *   (decimal); like `v<key>`, a value in the blob partition is returned through `view`.
+     * - `z`        : Returns the compression statistics, see `CompressionStats`.
+     * - `t`        : Returns the per-tier latency statistics, see `TierStats`.
+     * - `h`        : Returns the read cache counters, see `ReadCache::Stats`.
+     * - `q`        : Returns the capacity accounting, see `Capacity`.
+     * - `q<high_water%>,<max_records>,<policy>` : Sets the store limits; `<max_records>` 0 means
+     *   unlimited and `<policy>` is `n` (none), `o` (oldest written first) or `l` (least recently used).
+     * - `s<since>` : Returns the changes after sequence `<since>` (decimal), or after a `<next_since>`
+     *   cursor of an earlier page, see `readChanges`.
      */
-    std::string HandleCommand(const std::string &cmdIn);
+    void HandleCommand(std::string_view cmd, std::string &response, BlobStore::View *view = nullptr);
+
+    /**
+     * @brief Same as above, returning the response in a new string, for callers off the command path.
+     * @param cmd The input command.
+     * @param view Optional output for `v<key>` and `r<key>`.
+     * @return Response string after processing the command.
+     */
+    std::string HandleCommand(std::string_view cmd, BlobStore::View *view = nullptr);
+
+    /**
+     * @brief Describes the record compression statistics since boot.
+     * @return `<compressed_writes>,<plain_writes>,<raw_bytes>,<stored_bytes>,<compress_us>,<decompressions>,<decompress_us>`,
+     *         where the byte counts cover compressed writes only.
+     */
+    std::string CompressionStats() const;
+
+    /**
+     * @brief Describes the put and get latency of each storage tier since boot.
+     * @return One `<tier>,<writes>,<write_us>,<reads>,<read_us>` line each for `nvs`, `file` and `blob`.
+     */
+    std::string TierStats() const;
+
+    /**
+     * @brief Describes the store usage and limits.
+     * @return `<records>,<file_bytes>,<partition_used>,<partition_total>,<byte_limit>,<max_records>,<policy>,<evicted>,<expired>,<nvs_records>,`
+     *         followed by the blob partition usage, see `BlobStore::Usage`; `<records>` and the limits cover the data file only.
+     */
+    std::string Capacity() const;
+
+    /**
+     * @brief Registers the listener notified of every applied write or delete.
+     * @param listener Callback to invoke, or `nullptr` to remove the current listener.
+     * @param context Opaque pointer passed back to the listener.
+     */
+    void SetChangeListener(ChangeListener listener, void *context);
 
   private:
+    static constexpr size_t  ACCESS_LOG_SIZE        = 32;  ///< Records tracked for the LRU policy.
+    static constexpr uint8_t MAX_HIGH_WATER_PERCENT = 50;  ///< Rewrites copy the data file, so it must fit twice.
+    static constexpr size_t  STDIO_BUF_SIZE         = 256; ///< Size of `readBuffer` and `writeBuffer`.
+
+    /**
+     * @brief What happens when a write would exceed the store limits.
+     */
+    enum EvictionPolicy : char
+    {
+        EVICT_NONE   = 'n', ///< Reject the write; only expired records are removed.
+        EVICT_OLDEST = 'o', ///< Remove the least recently written records.
+        EVICT_LRU    = 'l', ///< Remove the least recently read or written records.
+    };
+
+    /**
+     * @brief Storage tiers.
+     */
+    enum Tier
+    {
+        TIER_NVS,   ///< Small values in `NvsTier`.
+        TIER_FILE,  ///< Data file.
+        TIER_BLOB,  ///< Large values in `BlobStore`.
+        TIER_COUNT,
+    };
+
+    /**
+     * @brief Latency counters of a tier.
+     */
+    struct TierCounters
+    {
+        uint32_t writes;   ///< Writes handled.
+        uint64_t write_us; ///< Time spent writing.
+        uint32_t reads;    ///< Reads handled.
+        uint64_t read_us;  ///< Time spent reading.
+    };
+
+    /**
+     * @brief Outcome of a write.
+     */
+    enum WriteResult
+    {
+        WRITE_OK,     ///< Record stored.
+        WRITE_FULL,   ///< Rejected by the store limits.
+        WRITE_FAILED, ///< Filesystem error.
+    };
+
+    /**
+     * @brief Parsed start of a record line.
+     */
+    struct RecordHeader
+    {
+        char     tag;      ///< One of the `RECORD_*` tags.
+        long     id;       ///< Record identifier.
+        uint32_t expiry;   ///< Expiry time in seconds, 0 if the record does not expire.
+        uint32_t sequence; ///< Sequence number of the last mutation, 0 for records written before sequencing.
+        uint32_t reset;    ///< Meta line only: sequence number of the last clear.
+        uint32_t purged;   ///< Meta line only: highest sequence number of a purged tombstone.
+        uint32_t clock;    ///< Meta line only: store clock when the line was written, see `now()`.
+        size_t   length;   ///< Length of the header, up to and including the `$` before the data.
+    };
+
     /**
-     * @brief Checks if a string consists only of hexadecimal characters.
-     * @param s The string to be checked.
-     * @return `true` if the string is hexadecimal, `false` otherwise.
+     * @brief Last access of a record, for the LRU policy.
      */
-    bool isHex(const std::string &s) const;
+    struct AccessEntry
+    {
+        long     id;   ///< Record identifier.
+        uint32_t tick; ///< Value of `accessTick` at the last access, 0 if the entry is unused.
+    };
 
     /**
-     * @brief Writes or updates data in the SPIFFS file.
+     * @brief Compression counters.
+     */
+    struct CodecStats
+    {
+        uint32_t compressed;    ///< Records written compressed.
+        uint32_t plain;         ///< Records written uncompressed.
+        uint64_t raw_bytes;     ///< Original size of the compressed records.
+        uint64_t stored_bytes;  ///< Encoded size of the compressed records.
+        uint64_t compress_us;   ///< Time spent compressing, including attempts that did not pay off.
+        uint32_t reads;         ///< Records decompressed.
+        uint64_t decompress_us; ///< Time spent decompressing.
+    };
+
+    /**
+     * @brief Executes a command with the store locked.
+     * @param cmd The input command.
+     * @param response Response after processing the command.
+     * @param view Optional output for `v<key>` and `r<key>`.
+     */
+    void executeCommand(std::string_view cmd, std::string &response, BlobStore::View *view);
+
+    /**
+     * @brief Reads a value from whichever tier holds it, removing it if it has expired.
+     * @param id Numeric identifier.
+     * @param value Output value, assigned within its capacity; left unspecified when not found.
+     * @return `true` if found, `false` otherwise.
+     */
+    bool readValue(long id, std::string &value);
+
+    /**
+     * @brief Notifies the registered listener of a change.
+     * @param id Identifier of the changed record.
+     * @param data New record data, `nullptr` when deleted.
+     * @param size Length of `data`.
+     */
+    void notifyChange(long id, const char *data, size_t size) const;
+
+    /**
+     * @brief Consumes an unsigned number from the front of a command argument.
+     * @param args Argument text, advanced past the number.
+     * @param base 10 or 16.
+     * @param value Parsed number, saturated at `ULONG_MAX` like `strtoul`.
+     * @return `true` if at least one digit was consumed, `false` otherwise.
+     */
+    static bool takeNumber(std::string_view &args, int base, unsigned long &value);
+
+    /**
+     * @brief Consumes a hexadecimal key from the front of a command argument.
+     * @param args Argument text, advanced past the key.
+     * @param id Parsed key, saturated at `LONG_MAX` like `strtol`.
+     * @return `true` if at least one digit was consumed, `false` otherwise.
+     */
+    static bool takeKey(std::string_view &args, long &id);
+
+    /**
+     * @brief Consumes a separator from the front of a command argument.
+     * @param args Argument text, advanced past the separator.
+     * @param c Expected separator.
+     * @return `true` if `args` started with `c`, `false` otherwise.
+     */
+    static bool takeChar(std::string_view &args, char c);
+
+    /**
+     * @brief Writes or updates a record in the tier its size calls for, moving it out of the
+     *        other tiers. File writes evict records if the limits require it.
      * @param id Numeric identifier.
      * @param data Data string to be written.
-     * @return `true` if the operation is successful, `false` otherwise.
+     * @param expiry Expiry time in seconds, 0 if the record does not expire.
+     * @param tier Output tier the record was written to.
+     * @return Outcome of the write.
+     */
+    WriteResult writeData(long id, std::string_view data, uint32_t expiry, Tier &tier);
+
+    /**
+     * @brief Makes a streamed value the record of its key, moving it out of the other tiers.
+     * @param id Numeric identifier.
+     * @param length Expected value length.
+     * @param crc Expected CRC-32 of the value.
+     * @return `true` on success, `false` if the stream is incomplete, corrupt or could not be written.
+     */
+    bool commitStream(long id, size_t length, uint32_t crc);
+
+    /**
+     * @brief Decompresses a stored value and accounts for the time spent.
+     * @param in Encoded value.
+     * @param len Length of the encoded value.
+     * @param out Decompressed value.
+     * @return `true` on success, `false` if the value is corrupt.
      */
-    bool writeData(long id, const std::string &data);
+    bool decodeRecord(const char *in, size_t len, std::string &out) const;
 
     /**
      * @brief Reads the entire content of the SPIFFS file.
@@ -56,23 +308,57 @@ class FlashManager
      */
     std::string readAllData() const;
 
+    /**
+     * @brief Reads one page of the changes after a sequence number.
+     * @param since Sequence number the caller is synced to, 0 for everything.
+     * @param purged Purged sequence of a `<since>r<purged>` cursor, 0 for a plain sequence number.
+     * @return A `<current_seq>,<next_since>,<more>,<reset>` line, then one `c$<id>;s<seq>$<data>` line per
+     *         written record and one `x$<id>;s<seq>$` line per deleted record, in sequence order. When
+     *         `<reset>` is 1 the caller's copy predates a clear or a purged tombstone and must be
+     *         replaced by the returned records. When `<more>` is 1, call again with `<next_since>`,
+     *         which is `<seq>r<purged>` while a resync is still below the purged tombstones.
+     */
+    std::string readChanges(uint32_t since, uint32_t purged) const;
+
     /**
      * @brief Reads data corresponding to a specific ID.
      * @param id Numeric identifier.
-     * @return Found data as a string or an empty string if not found.
+     * @param value Output data, assigned within its capacity; left unspecified when not found.
+     * @param expired Set to `true` if the record exists but has expired.
+     * @param expiry Set to the expiry time of the record when found, 0 if it does not expire.
+     * @return `true` if found, `false` if not found, expired or unreadable.
+     */
+    bool readDataById(long id, std::string &value, bool *expired, uint32_t *expiry) const;
+
+    /**
+     * @brief Deletes a record from whichever tier holds it.
+     * @param id Numeric identifier.
+     * @return `true` if the operation is successful, `false` otherwise or if the record does not exist.
      */
-    std::string readDataById(long id) const;
+    bool removeRecord(long id);
 
     /**
-     * @brief Deletes data associated with a specific ID.
+     * @brief Deletes data associated with a specific ID from the data file.
      * @param id Numeric identifier.
      * @return `true` if the operation is successful, `false` otherwise.
      */
     bool deleteDataById(long id);
 
+    /**
+     * @brief Opens a file with a buffer of the manager instead of one from the heap.
+     * @param path File path.
+     * @param mode `fopen` mode.
+     * @param buffer Buffer of `STDIO_BUF_SIZE` bytes, used by no other open file.
+     * @return File, or `nullptr` on failure.
+     *
+     * Used on the get and put paths, where the buffer newlib would allocate and free on every
+     * open is the only heap use left.
+     */
+    static FILE *openFile(const char *path, const char *mode, char *buffer);
+
     /**
      * @brief Deletes the SPIFFS file.
-     * @return `true` if the operation is successful, `false` otherwise.
+     * @return `true` if the file is deleted or did not exist, `false` otherwise.
      */
     bool deleteFile();
 
@@ -82,7 +368,236 @@ class FlashManager
      */
     bool createFile();
 
-    static constexpr const char *MOUNT_POINT = "/spiffs";
+    /**
+     * @brief Formats the line prefix of a record.
+     * @param buf Destination buffer of `PREFIX_BUF_SIZE` bytes.
+     * @param id Numeric identifier.
+     * @return Length of the prefix.
+     */
+    static size_t formatPrefix(char *buf, long id);
+
+    /**
+     * @brief Parses the header of a record line.
+     * @param line Line read from the data file.
+     * @param header Parsed header; only valid when `true` is returned.
+     * @return `true` if the line starts a record, `false` otherwise.
+     */
+    static bool parseHeader(const char *line, RecordHeader &header);
+
+    /**
+     * @brief Formats a record header.
+     * @param buf Destination buffer of `HEADER_BUF_SIZE` bytes.
+     * @param header Header to format; attributes that are 0 are omitted.
+     * @return Length of the header.
+     */
+    static size_t formatHeader(char *buf, const RecordHeader &header);
+
+    /**
+     * @brief Builds the meta line header.
+     * @param current Current sequence number.
+     * @param purged Highest sequence number of a purged tombstone.
+     * @return Meta header.
+     */
+    RecordHeader metaHeader(uint32_t current, uint32_t purged) const;
+
+    /**
+     * @brief Checks whether a tag marks a line holding record data.
+     * @param tag Line tag.
+     * @return `true` for `RECORD_PLAIN` and `RECORD_COMPRESSED`, `false` otherwise.
+     */
+    static bool isData(char tag);
+
+    /**
+     * @brief Checks whether a line starts the record of a prefix, whichever its tag.
+     * @param line Line read from the data file.
+     * @param prefix Prefix built by `formatPrefix`.
+     * @param prefixLen Length of the prefix.
+     * @return `true` if the line belongs to the record, `false` otherwise.
+     */
+    static bool isRecord(const char *line, const char *prefix, size_t prefixLen);
+
+    /**
+     * @brief Writes one record line.
+     * @param out Destination file.
+     * @param header Record header.
+     * @param data Stored record data, or `nullptr` for tombstones and the meta line.
+     * @param size Length of `data`.
+     * @return Number of bytes written, 0 on failure.
+     */
+    static size_t writeRecord(FILE *out, const RecordHeader &header, const char *data, size_t size);
+
+    /**
+     * @brief Rewrites the data file with one record replaced, appended or replaced by a tombstone.
+     * @param id Numeric identifier.
+     * @param data New record data as stored, or `nullptr` to remove the record.
+     * @param size Length of `data`.
+     * @param tag Tag of the new record, `RECORD_PLAIN` or `RECORD_COMPRESSED`. With `data` `nullptr`,
+     *        `RECORD_TOMBSTONE` writes the tombstone even if the file holds no record of the key,
+     *        for a record deleted from another tier that has no room for it.
+     * @param expiry Expiry time of the new record in seconds, 0 if it does not expire.
+     * @return `true` if the operation is successful, `false` otherwise or if the record to remove does not exist.
+     *
+     * The file is streamed into a temporary file that then replaces it, so memory use does not
+     * depend on the store size. Takes the next sequence number and updates the record count and
+     * file size.
+     */
+    bool rewriteRecord(long id, const char *data, size_t size, char tag, uint32_t expiry);
+
+    /**
+     * @brief Counts the records and bytes of the data file and restores the sequence counters.
+     * @param unsequenced Optional output, incremented for each record without a sequence number.
+     * @return `true` if the operation is successful, `false` otherwise.
+     */
+    bool scanStore(uint32_t *unsequenced);
+
+    /**
+     * @brief Numbers the records written before sequencing, in file order.
+     * @return `true` if the operation is successful, `false` otherwise.
+     */
+    bool sequenceRecords();
+
+    /**
+     * @brief Measures the stored line of a record.
+     * @param id Numeric identifier.
+     * @return Length of the record in the data file, 0 if it does not exist.
+     */
+    size_t recordLength(long id) const;
+
+    /**
+     * @brief Computes the data file size allowed by the high-water mark.
+     * @return Byte limit, 0 if the partition size is unknown.
+     */
+    size_t byteLimit() const;
+
+    /**
+     * @brief Evicts records until a write fits the store limits.
+     * @param id Identifier of the record about to be written; never evicted.
+     * @param len Length of the line of the new record, header and newline included.
+     * @return `true` if the write fits, `false` if the policy does not allow enough eviction, in
+     *         which case nothing was evicted if the shortfall was known up front.
+     */
+    bool makeRoom(long id, size_t len);
+
+    /**
+     * @brief Computes how far evicting every candidate of the policy could shrink the data file.
+     * @param keep Identifier that is not a candidate.
+     * @return Bytes of the candidate lines, less the tombstone each eviction leaves.
+     */
+    size_t evictableBytes(long keep) const;
+
+    /**
+     * @brief Chooses the record to evict: an expired one if any, otherwise per the policy.
+     * @param keep Identifier that must not be chosen.
+     * @param victim Chosen identifier; only valid when `true` is returned.
+     * @return `true` if a record can be evicted, `false` otherwise.
+     */
+    bool selectVictim(long keep, long &victim) const;
+
+    /**
+     * @brief Records an access to a data file record for the LRU policy.
+     *
+     * Only data file records are evicted, so NVS and blob accesses would just push them out of the log.
+     * @param id Numeric identifier.
+     */
+    void touch(long id);
+
+    /**
+     * @brief Finds the last access of a record.
+     * @param id Numeric identifier.
+     * @return Access tick, 0 if the record was not accessed recently.
+     */
+    uint32_t lastAccess(long id) const;
+
+    /**
+     * @brief Reads the store clock, which expiry times are kept in.
+     *
+     * Nothing sets the wall clock on this device, so `time()` restarts at power-up. The store
+     * clock instead counts seconds of uptime on top of the clock saved in the meta line, which
+     * every rewrite of the data file updates and `scanStore` resumes from. It never goes back,
+     * even across a clear; time spent powered off, and since the last rewrite before a reset, is
+     * not counted, so a record may outlive its TTL but never expires early.
+     * @return Seconds on the store clock.
+     */
+    uint32_t now() const;
+
+    /**
+     * @brief Checks whether an expiry time has passed.
+     * @param expiry Expiry time in seconds, 0 if the record does not expire.
+     * @param current Current time in seconds.
+     * @return `true` if the record has expired, `false` otherwise.
+     */
+    static bool isExpired(uint32_t expiry, uint32_t current);
+
+    /**
+     * @brief Applies a `q` limits command.
+     * @param args `<high_water%>,<max_records>,<policy>`.
+     * @return `true` if the arguments are valid, `false` otherwise.
+     */
+    bool setLimits(std::string_view args);
+
+    ChangeListener changeListener; ///< Listener notified of applied changes.
+    void          *changeContext;  ///< Context passed to the change listener.
+
+    SemaphoreHandle_t initMutex;       ///< Serializes the lazy mount.
+    StaticSemaphore_t initMutexBuffer; ///< Storage for `initMutex`.
+    bool              mounted;         ///< Whether the SPIFFS partition is registered.
+    std::atomic<bool> ready;           ///< Whether the storage is ready for commands.
+
+    SemaphoreHandle_t storeMutex;       ///< Serializes commands, which share the data file.
+    StaticSemaphore_t storeMutexBuffer; ///< Storage for `storeMutex`.
+
+    mutable CodecStats             codecStats; ///< Compression counters.
+    mutable RecordCodec::Workspace codecWork;  ///< Scratch space and match table of the codec, guarded by `storeMutex`.
+    mutable std::string            encoded;    ///< Compressed form of the record being written or read.
+
+    mutable char readBuffer[STDIO_BUF_SIZE];  ///< stdio buffer of the data file on the get and put paths.
+    char         writeBuffer[STDIO_BUF_SIZE]; ///< stdio buffer of the temporary file of `rewriteRecord`.
+
+    size_t         partitionTotal;             ///< Partition size reported at mount.
+    uint32_t       recordCount;                ///< Records in the data file.
+    size_t         fileBytes;                  ///< Size of the data file.
+    uint8_t        highWaterPercent;           ///< Data file limit, in percent of the partition.
+    uint32_t       maxRecords;                 ///< Record limit, 0 for none.
+    EvictionPolicy policy;                     ///< Eviction policy.
+    uint32_t       evictedCount;               ///< Records evicted since boot.
+    uint32_t       expiredCount;               ///< Expired records removed since boot.
+    AccessEntry    accessLog[ACCESS_LOG_SIZE]; ///< Recently accessed records.
+    uint32_t       accessTick;                 ///< Access counter.
+    uint32_t       sequence;                   ///< Sequence number of the last mutation.
+    uint32_t       resetSequence;              ///< Sequence number of the last clear.
+    uint32_t       purgedSequence;             ///< Highest sequence number of a purged tombstone.
+    uint32_t       clockBase;                  ///< Store clock at zero uptime, see `now()`.
+    NvsTier        nvsTier;                    ///< Small-value tier.
+    BlobStore      blobStore;                  ///< Large-value tier.
+    ReadCache      readCache;                  ///< Recently read values of the data file.
+    size_t         nvsRecords;                 ///< Records in the small-value tier.
+    TierCounters   tierStats[TIER_COUNT];      ///< Latency counters, indexed by `Tier`.
+
+    static constexpr const char *MOUNT_POINT      = "/spiffs";
+    static constexpr const char *DATA_PATH        = "/spiffs/data.txt";
+    static constexpr const char *TEMP_PATH        = "/spiffs/data.tmp";
+    static constexpr size_t      LINE_BUF_SIZE    = 256;
+    static constexpr size_t      PREFIX_BUF_SIZE  = 24;
+    static constexpr size_t      HEADER_BUF_SIZE  = 80;
+    static constexpr size_t      SYNC_CHUNK_BYTES = 2048; ///< Size after which a page of changes ends.
+
+    static constexpr char RECORD_PLAIN      = 'c'; ///< Tag of records stored as given.
+    static constexpr char RECORD_COMPRESSED = 'z'; ///< Tag of records stored by `RecordCodec`.
+    static constexpr char RECORD_TOMBSTONE  = 'x'; ///< Tag of deleted records.
+    static constexpr char RECORD_META       = 'm'; ///< Tag of the meta line.
+    static constexpr char ATTR_EXPIRY       = 'e'; ///< Attribute holding the expiry time.
+    static constexpr char ATTR_SEQUENCE     = 's'; ///< Attribute holding the sequence number.
+    static constexpr char ATTR_RESET        = 'r'; ///< Meta attribute holding the sequence number of the last clear.
+    static constexpr char ATTR_PURGED       = 'p'; ///< Meta attribute holding the highest purged tombstone.
+    static constexpr char ATTR_CLOCK        = 't'; ///< Meta attribute holding the store clock.
+
+#if CONFIG_APP_STORAGE_EVICT_LRU
+    static constexpr EvictionPolicy DEFAULT_POLICY = EVICT_LRU;
+#elif CONFIG_APP_STORAGE_EVICT_OLDEST
+    static constexpr EvictionPolicy DEFAULT_POLICY = EVICT_OLDEST;
+#else
+    static constexpr EvictionPolicy DEFAULT_POLICY = EVICT_NONE;
+#endif
 };
 
 #endif // FLASH_MANAGER_HPP
@@ -0,0 +1,148 @@
+#ifndef GATT_TABLE_HPP
+#define GATT_TABLE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "esp_gatt_defs.h"
+
+/**
+ * @brief Compile-time description of a GATT service and its attribute table.
+ *
+ * A service is declared as a list of characteristics. The attribute table passed to
+ * `esp_ble_gatts_create_attr_tab` and the index of every attribute inside it are computed
+ * from that list, so handles are looked up by name instead of by offset arithmetic.
+ */
+namespace Gatt
+{
+    /**
+     * @brief Little-endian storage for a 16-bit UUID.
+     * @tparam Uuid The 16-bit UUID value.
+     */
+    template <uint16_t Uuid>
+    struct Uuid16
+    {
+        static constexpr uint8_t bytes[ESP_UUID_LEN_16] = {static_cast<uint8_t>(Uuid & 0xFF), static_cast<uint8_t>(Uuid >> 8)};
+    };
+
+    /**
+     * @brief Declares one characteristic of a service.
+     * @tparam Uuid 16-bit characteristic UUID.
+     * @tparam Properties Characteristic properties (`ESP_GATT_CHAR_PROP_BIT_*`).
+     * @tparam Permissions Value attribute permissions (`ESP_GATT_PERM_*`).
+     * @tparam MaxLen Maximum length of the characteristic value.
+     *
+     * A Client Characteristic Configuration descriptor is added automatically when the
+     * characteristic can notify or indicate.
+     */
+    template <uint16_t Uuid, uint8_t Properties, uint16_t Permissions, uint16_t MaxLen>
+    struct Characteristic
+    {
+        static constexpr bool   HAS_CCCD   = (Properties & (ESP_GATT_CHAR_PROP_BIT_NOTIFY | ESP_GATT_CHAR_PROP_BIT_INDICATE)) != 0;
+        static constexpr size_t ATTR_COUNT = HAS_CCCD ? 3 : 2;
+        static constexpr size_t MAX_LEN    = MaxLen;
+
+        static constexpr uint8_t properties = Properties;
+
+        inline static uint8_t value[MaxLen]           = {0};
+        inline static uint8_t cccd[sizeof(uint16_t)] = {0};
+
+        /**
+         * @brief Writes the attributes of this characteristic into a table.
+         * @param table Destination attribute table.
+         * @param index Index of the characteristic declaration inside the table.
+         */
+        static constexpr void Fill(esp_gatts_attr_db_t *table, size_t index)
+        {
+            table[index] = {
+                {ESP_GATT_AUTO_RSP},
+                {ESP_UUID_LEN_16, const_cast<uint8_t *>(Uuid16<ESP_GATT_UUID_CHAR_DECLARE>::bytes), ESP_GATT_PERM_READ, sizeof(uint8_t),
+                 sizeof(uint8_t), const_cast<uint8_t *>(&properties)}
+            };
+            table[index + 1] = {
+                {ESP_GATT_AUTO_RSP},
+                {ESP_UUID_LEN_16, const_cast<uint8_t *>(Uuid16<Uuid>::bytes), Permissions, MaxLen, MaxLen, value}
+            };
+            if (HAS_CCCD)
+            {
+                table[index + 2] = {
+                    {ESP_GATT_AUTO_RSP},
+                    {ESP_UUID_LEN_16, const_cast<uint8_t *>(Uuid16<ESP_GATT_UUID_CHAR_CLIENT_CONFIG>::bytes),
+                     ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, sizeof(cccd), sizeof(cccd), cccd}
+                };
+            }
+        }
+    };
+
+    /**
+     * @brief Declares a primary service made of the given characteristics.
+     * @tparam Uuid 16-bit service UUID.
+     * @tparam Chars Characteristic descriptions, in table order.
+     */
+    template <uint16_t Uuid, class... Chars>
+    struct Service
+    {
+        static constexpr size_t ATTR_COUNT = 1 + (Chars::ATTR_COUNT + ... + 0);
+        static constexpr size_t CHAR_COUNT = sizeof...(Chars);
+
+        /**
+         * @brief Index of the service declaration attribute.
+         */
+        static constexpr size_t SERVICE_INDEX = 0;
+
+        /**
+         * @brief Index of the declaration attribute of characteristic `I`.
+         */
+        template <size_t I>
+        static constexpr size_t DeclIndex()
+        {
+            static_assert(I < CHAR_COUNT, "Characteristic index out of range");
+            constexpr size_t counts[] = {Chars::ATTR_COUNT...};
+            size_t           index    = 1;
+            for (size_t i = 0; i < I; ++i)
+            {
+                index += counts[i];
+            }
+            return index;
+        }
+
+        /**
+         * @brief Index of the value attribute of characteristic `I`.
+         */
+        template <size_t I>
+        static constexpr size_t ValueIndex()
+        {
+            return DeclIndex<I>() + 1;
+        }
+
+        /**
+         * @brief Index of the CCCD attribute of characteristic `I`.
+         */
+        template <size_t I>
+        static constexpr size_t CccdIndex()
+        {
+            constexpr bool has_cccd[] = {Chars::HAS_CCCD...};
+            static_assert(has_cccd[I], "Characteristic has no CCCD");
+            return DeclIndex<I>() + 2;
+        }
+
+        /**
+         * @brief Builds the attribute table for the service.
+         * @return Attribute table ready for `esp_ble_gatts_create_attr_tab`.
+         */
+        static constexpr std::array<esp_gatts_attr_db_t, ATTR_COUNT> Table()
+        {
+            std::array<esp_gatts_attr_db_t, ATTR_COUNT> table{};
+            table[SERVICE_INDEX] = {
+                {ESP_GATT_AUTO_RSP},
+                {ESP_UUID_LEN_16, const_cast<uint8_t *>(Uuid16<ESP_GATT_UUID_PRI_SERVICE>::bytes), ESP_GATT_PERM_READ, ESP_UUID_LEN_16,
+                 ESP_UUID_LEN_16, const_cast<uint8_t *>(Uuid16<Uuid>::bytes)}
+            };
+            size_t index = 1;
+            ((Chars::Fill(table.data(), index), index += Chars::ATTR_COUNT), ...);
+            return table;
+        }
+    };
+}
+
+#endif // GATT_TABLE_HPP
@@ -0,0 +1,68 @@
+#include "LedManager.hpp"
+
+LedManager::LedManager(gpio_num_t pin) : pin(pin), timer(nullptr), pattern(PATTERN_IDLE), restart(false), step(0)
+{
+}
+
+bool LedManager::Init()
+{
+    if (gpio_reset_pin(pin) != ESP_OK || gpio_set_direction(pin, GPIO_MODE_OUTPUT) != ESP_OK)
+    {
+        return false;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback                = StepStatic;
+    args.arg                     = this;
+    args.dispatch_method         = ESP_TIMER_TASK;
+    args.name                    = "status_led";
+
+    if (esp_timer_create(&args, &timer) != ESP_OK)
+    {
+        timer = nullptr;
+        return false;
+    }
+
+    Step();
+    return true;
+}
+
+void LedManager::SetPattern(Pattern newPattern)
+{
+    if (timer == nullptr || pattern.exchange(newPattern) == newPattern)
+    {
+        return;
+    }
+
+    // If the callback re-arms the timer between these calls the restart fails, and the
+    // new pattern is picked up at the next level change instead.
+    restart = true;
+    esp_timer_stop(timer);
+    esp_timer_start_once(timer, 0);
+}
+
+void LedManager::StepStatic(void *arg)
+{
+    static_cast<LedManager *>(arg)->Step();
+}
+
+void LedManager::Step()
+{
+    if (restart.exchange(false))
+    {
+        step = 0;
+    }
+
+    uint16_t bits  = pattern;
+    bool     level = (bits >> step) & 1;
+    gpio_set_level(pin, level);
+
+    int run = 1;
+    while (run < STEPS && (((bits >> ((step + run) % STEPS)) & 1) == level))
+    {
+        run++;
+    }
+    step = (step + run) % STEPS;
+
+    esp_timer_start_once(timer, run * STEP_US);
+}
@@ -0,0 +1,70 @@
+#ifndef LED_MANAGER_HPP
+#define LED_MANAGER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include "driver/gpio.h"
+#include "esp_timer.h"
+
+/**
+ * @brief Drives the status LED from a one-shot `esp_timer` instead of a dedicated task.
+ *
+ * A pattern is 16 steps of `STEP_US`, bit `i` giving the LED level during step `i`. The
+ * timer is only armed for the next level change, so a steady pattern costs a couple of
+ * wake-ups per cycle.
+ */
+class LedManager
+{
+  public:
+    /**
+     * @brief LED patterns, one per system state.
+     */
+    enum Pattern : uint16_t
+    {
+        PATTERN_IDLE          = 0x00FF, ///< 1 s on, 1 s off.
+        PATTERN_BLE_CONNECTED = 0x7FFF, ///< On with a short blink off every cycle.
+        PATTERN_BUSY          = 0x5555, ///< Fast flicker while commands are processed.
+        PATTERN_STORAGE_ERROR = 0x0033, ///< Double blink then pause.
+    };
+
+    static constexpr uint64_t STEP_US = 125000; ///< Duration of one pattern step.
+    static constexpr int      STEPS   = 16;     ///< Steps per pattern cycle.
+
+    /**
+     * @brief Constructs a LED manager for a GPIO.
+     * @param pin GPIO the LED is connected to.
+     */
+    explicit LedManager(gpio_num_t pin);
+
+    /**
+     * @brief Configures the GPIO and starts the idle pattern.
+     * @return `true` if successful, `false` otherwise.
+     */
+    bool Init();
+
+    /**
+     * @brief Switches to a new pattern, starting from its first step.
+     * @param pattern Pattern to show.
+     */
+    void SetPattern(Pattern pattern);
+
+  private:
+    /**
+     * @brief Timer callback.
+     * @param arg Pointer to the LedManager instance.
+     */
+    static void StepStatic(void *arg);
+
+    /**
+     * @brief Applies the current step and arms the timer for the next level change.
+     */
+    void Step();
+
+    gpio_num_t            pin;     ///< LED GPIO.
+    esp_timer_handle_t    timer;   ///< Step timer.
+    std::atomic<uint16_t> pattern; ///< Pattern being shown.
+    std::atomic<bool>     restart; ///< Set when the pattern changed and must restart at step 0.
+    int                   step;    ///< Current step, only touched by the timer callback.
+};
+
+#endif // LED_MANAGER_HPP
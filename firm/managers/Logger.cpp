@@ -0,0 +1,182 @@
+#include "Logger.hpp"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <cstdio>
+
+// Slot sequences are stored relative to the slot index, so the zero-initialised ring is
+// valid before Init() runs and early boot code can log.
+Logger::Slot              Logger::slots[CAPACITY];
+std::atomic<uint32_t>     Logger::head{0};
+uint32_t                  Logger::tail = 0;
+std::atomic<uint32_t>     Logger::dropped{0};
+std::atomic<TaskHandle_t> Logger::drainTask{nullptr};
+Logger::Entry             Logger::retained[RETAINED];
+size_t                    Logger::retainedHead  = 0;
+size_t                    Logger::retainedCount = 0;
+SemaphoreHandle_t         Logger::retainedMutex = nullptr;
+StaticSemaphore_t         Logger::retainedMutexBuffer;
+
+static_assert((Logger::CAPACITY & (Logger::CAPACITY - 1)) == 0, "Logger capacity must be a power of two");
+
+void Logger::Log(LogId id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint32_t pos  = head.load(std::memory_order_relaxed);
+    Slot    *slot = nullptr;
+
+    // Bounded multi-producer queue: a slot is free for position `pos` when its sequence equals
+    // `pos`, and holds an entry for the consumer when it equals `pos + 1`.
+    while (true)
+    {
+        size_t  index = pos & (CAPACITY - 1);
+        int32_t diff  = static_cast<int32_t>(slots[index].sequence.load(std::memory_order_acquire) + index - pos);
+        if (diff == 0)
+        {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot = &slots[index];
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->entry = {static_cast<uint32_t>(esp_timer_get_time()), id, 0, {a0, a1, a2, a3}};
+    slot->sequence.store(pos + 1 - (pos & (CAPACITY - 1)), std::memory_order_release);
+
+    TaskHandle_t task = drainTask.load(std::memory_order_acquire);
+    if (task == nullptr)
+    {
+        return;
+    }
+    if (xPortInIsrContext())
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+    else
+    {
+        xTaskNotifyGive(task);
+    }
+}
+
+bool Logger::Init(TaskHandle_t task)
+{
+    if (retainedMutex == nullptr)
+    {
+        retainedMutex = xSemaphoreCreateMutexStatic(&retainedMutexBuffer);
+        if (retainedMutex == nullptr)
+        {
+            return false;
+        }
+    }
+    drainTask.store(task, std::memory_order_release);
+    return true;
+}
+
+void Logger::Drain()
+{
+    while (true)
+    {
+        size_t index = tail & (CAPACITY - 1);
+        Slot  &slot  = slots[index];
+        if (slot.sequence.load(std::memory_order_acquire) + index != tail + 1)
+        {
+            break;
+        }
+
+        Entry entry = slot.entry;
+        slot.sequence.store(tail + CAPACITY - index, std::memory_order_release);
+        tail++;
+
+#if CONFIG_APP_LOG_TO_CONSOLE
+        std::string line;
+        format(line, entry);
+        printf("%s\n", line.c_str());
+#endif
+
+        if (xSemaphoreTake(retainedMutex, portMAX_DELAY) == pdTRUE)
+        {
+            retained[retainedHead] = entry;
+            retainedHead           = (retainedHead + 1) % RETAINED;
+            if (retainedCount < RETAINED)
+            {
+                retainedCount++;
+            }
+            xSemaphoreGive(retainedMutex);
+        }
+    }
+}
+
+void Logger::format(std::string &out, const Entry &entry)
+{
+    char line[96];
+    int  len = snprintf(line, sizeof(line), "%lu ", static_cast<unsigned long>(entry.timestamp));
+    if (len < 0 || len >= static_cast<int>(sizeof(line)))
+    {
+        return;
+    }
+    if (entry.id < LOG_COUNT)
+    {
+        snprintf(line + len, sizeof(line) - len, FORMATS[entry.id], static_cast<unsigned long>(entry.args[0]),
+                 static_cast<unsigned long>(entry.args[1]), static_cast<unsigned long>(entry.args[2]),
+                 static_cast<unsigned long>(entry.args[3]));
+    }
+    else
+    {
+        snprintf(line + len, sizeof(line) - len, "unknown %u", entry.id);
+    }
+    out += line;
+}
+
+std::string Logger::Report()
+{
+    std::string result = "dropped," + std::to_string(dropped.load(std::memory_order_relaxed));
+    if (retainedMutex == nullptr || xSemaphoreTake(retainedMutex, portMAX_DELAY) != pdTRUE)
+    {
+        return result;
+    }
+
+    size_t start = (retainedHead + RETAINED - retainedCount) % RETAINED;
+    for (size_t i = 0; i < retainedCount; ++i)
+    {
+        result += "\n";
+        format(result, retained[(start + i) % RETAINED]);
+    }
+
+    xSemaphoreGive(retainedMutex);
+    return result;
+}
+
+std::string Logger::Dump()
+{
+    static const char HEX[] = "0123456789ABCDEF";
+    std::string       result;
+    if (retainedMutex == nullptr || xSemaphoreTake(retainedMutex, portMAX_DELAY) != pdTRUE)
+    {
+        return result;
+    }
+
+    result.reserve(retainedCount * sizeof(Entry) * 2);
+    size_t start = (retainedHead + RETAINED - retainedCount) % RETAINED;
+    for (size_t i = 0; i < retainedCount; ++i)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&retained[(start + i) % RETAINED]);
+        for (size_t b = 0; b < sizeof(Entry); ++b)
+        {
+            result.push_back(HEX[bytes[b] >> 4]);
+            result.push_back(HEX[bytes[b] & 0x0F]);
+        }
+    }
+
+    xSemaphoreGive(retainedMutex);
+    return result;
+}
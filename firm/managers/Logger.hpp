@@ -0,0 +1,138 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Identifies a log message; the value is the index in `Logger::FORMATS`.
+ */
+enum LogId : uint16_t
+{
+    LOG_UART_CONFIG_FAILED, ///< UART parameter configuration failed.
+    LOG_UART_QUEUE_INVALID, ///< UsbTask started without a UART queue.
+    LOG_BLE_CONNECT,        ///< BLE client connected.
+    LOG_BLE_DISCONNECT,     ///< BLE client disconnected.
+    LOG_BLE_WRITE,          ///< BLE write received.
+    LOG_BLE_MTU,            ///< BLE MTU exchanged.
+    LOG_STORAGE_MOUNT,      ///< SPIFFS mount failed.
+    LOG_STORAGE_WRITE,      ///< Record write failed.
+    LOG_STORAGE_FULL,       ///< Write rejected by the store limits.
+    LOG_STORAGE_EVICT,      ///< Record evicted to make room.
+    LOG_BLE_NOTIFY_DROPPED, ///< Notification abandoned on a stalled link.
+    LOG_COUNT
+};
+
+/**
+ * @brief Deferred binary logger.
+ *
+ * `Log` stores a format ID, up to four integer arguments and a timestamp in a lock-free
+ * ring, so it can be called from any task, callback or ISR without blocking or touching
+ * the UART. A low-priority drain task moves the entries into a retained history from
+ * which `tl` formats them and `tlr` dumps them raw.
+ *
+ * A raw dump is a sequence of 24-byte little-endian entries: `uint32_t` timestamp in
+ * microseconds, `uint16_t` log ID, two padding bytes and four `uint32_t` arguments.
+ */
+class Logger
+{
+  public:
+    static constexpr size_t CAPACITY = 64; ///< Pending entries; must be a power of two.
+    static constexpr size_t RETAINED = 32; ///< Entries kept in the history.
+    static constexpr size_t MAX_ARGS = 4;  ///< Maximum arguments per entry.
+
+    /**
+     * @brief Format string of each log ID. Arguments are passed as `unsigned long`.
+     */
+    static constexpr const char *FORMATS[LOG_COUNT] = {
+        "UART config failed: err %lu",
+        "UART queue handle invalid",
+        "BLE connect: conn %lu",
+        "BLE disconnect: conn %lu reason 0x%lx",
+        "BLE write: conn %lu handle %lu len %lu",
+        "BLE MTU: conn %lu mtu %lu",
+        "Storage mount failed: err %lu",
+        "Storage write failed: id %lx",
+        "Storage full: id %lx len %lu",
+        "Storage evicted: id %lx",
+        "BLE notify dropped: conn %lu bytes %lu",
+    };
+
+    /**
+     * @brief Records a log entry. Never blocks; the entry is dropped if the ring is full.
+     * @param id Message ID.
+     * @param a0..a3 Message arguments.
+     */
+    static void Log(LogId id, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, uint32_t a3 = 0);
+
+    /**
+     * @brief Prepares the history and registers the drain task.
+     * @param task Task woken when entries are pending; it must call `Drain`.
+     * @return `true` on success, `false` otherwise.
+     */
+    static bool Init(TaskHandle_t task);
+
+    /**
+     * @brief Moves pending entries into the history, printing them if console output is enabled.
+     */
+    static void Drain();
+
+    /**
+     * @brief Formats the retained history, oldest first.
+     * @return A `dropped,<count>` line followed by one `<timestamp_us> <message>` line per entry.
+     */
+    static std::string Report();
+
+    /**
+     * @brief Dumps the retained history for decoding on the host.
+     * @return Raw entries encoded as uppercase hexadecimal.
+     */
+    static std::string Dump();
+
+  private:
+    /**
+     * @brief Log entry as stored and dumped.
+     */
+    struct Entry
+    {
+        uint32_t timestamp;      ///< Microseconds since boot.
+        uint16_t id;             ///< Message ID.
+        uint16_t reserved;       ///< Padding, always zero.
+        uint32_t args[MAX_ARGS]; ///< Message arguments.
+    };
+    static_assert(sizeof(Entry) == 24, "Log entry layout is part of the dump format");
+
+    /**
+     * @brief Slot of the pending ring.
+     */
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence; ///< Slot state relative to its index, see `Log` and `Drain`.
+        Entry                 entry;    ///< Stored entry.
+    };
+
+    /**
+     * @brief Appends a formatted entry to a string.
+     * @param out Destination.
+     * @param entry Entry to format.
+     */
+    static void format(std::string &out, const Entry &entry);
+
+    static Slot                      slots[CAPACITY];     ///< Pending ring.
+    static std::atomic<uint32_t>     head;                ///< Next position to reserve.
+    static uint32_t                  tail;                ///< Next position to drain.
+    static std::atomic<uint32_t>     dropped;             ///< Entries lost because the ring was full.
+    static std::atomic<TaskHandle_t> drainTask;           ///< Drain task to wake, once running.
+    static Entry                     retained[RETAINED];  ///< History of drained entries.
+    static size_t                    retainedHead;        ///< Next history slot to write.
+    static size_t                    retainedCount;       ///< Number of valid history entries.
+    static SemaphoreHandle_t         retainedMutex;       ///< Protects the history.
+    static StaticSemaphore_t         retainedMutexBuffer; ///< Storage for `retainedMutex`.
+};
+
+#endif // LOGGER_HPP
@@ -0,0 +1,256 @@
+#include "NvsTier.hpp"
+#include "nvs_flash.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+NvsTier::NvsTier() : handle(0), open(false)
+{
+}
+
+bool NvsTier::Init()
+{
+    if (open || MAX_VALUE == 0)
+    {
+        return open;
+    }
+    // The partition only holds this tier, so it can be erased when its layout is not readable.
+    esp_err_t ret = nvs_flash_init_partition(PARTITION);
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ret = nvs_flash_erase_partition(PARTITION);
+        if (ret == ESP_OK)
+        {
+            ret = nvs_flash_init_partition(PARTITION);
+        }
+    }
+    if (ret != ESP_OK)
+    {
+        return false;
+    }
+    open = (nvs_open_from_partition(PARTITION, NAMESPACE, NVS_READWRITE, &handle) == ESP_OK);
+    return open;
+}
+
+bool NvsTier::Accepts(size_t len) const
+{
+    return open && len <= MAX_VALUE;
+}
+
+void NvsTier::formatKey(char *key, long id)
+{
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%lx", static_cast<unsigned long>(id));
+}
+
+bool NvsTier::parseValue(const char *value, Entry &entry)
+{
+    char *end;
+    entry.sequence = strtoul(value, &end, 10);
+    if (end == value)
+    {
+        return false;
+    }
+    if (*end == 'x' && end[1] == '\0')
+    {
+        entry.deleted = true;
+        entry.data.clear();
+        return true;
+    }
+    if (*end != '$')
+    {
+        return false;
+    }
+    entry.deleted = false;
+    entry.data.assign(end + 1);
+    return true;
+}
+
+bool NvsTier::load(long id, char *value) const
+{
+    if (!open)
+    {
+        return false;
+    }
+    char   key[NVS_KEY_NAME_MAX_SIZE];
+    size_t len = VALUE_BUF_SIZE;
+    formatKey(key, id);
+    return nvs_get_str(handle, key, value, &len) == ESP_OK;
+}
+
+bool NvsTier::Get(long id, Entry &entry) const
+{
+    char value[VALUE_BUF_SIZE];
+    if (!load(id, value))
+    {
+        return false;
+    }
+    entry.id = id;
+    return parseValue(value, entry);
+}
+
+bool NvsTier::Contains(long id, bool *deleted) const
+{
+    char value[VALUE_BUF_SIZE];
+    if (!load(id, value))
+    {
+        return false;
+    }
+    if (deleted != nullptr)
+    {
+        *deleted = (strchr(value, '$') == nullptr);
+    }
+    return true;
+}
+
+bool NvsTier::Read(long id, std::string &data, bool *deleted) const
+{
+    char value[VALUE_BUF_SIZE];
+    if (!load(id, value))
+    {
+        return false;
+    }
+    const char *start = strchr(value, '$');
+    *deleted          = (start == nullptr);
+    if (start != nullptr)
+    {
+        data.assign(start + 1);
+    }
+    return true;
+}
+
+esp_err_t NvsTier::store(const char *key, const char *value, uint32_t sequence)
+{
+    esp_err_t err = nvs_set_str(handle, key, value);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_u32(handle, KEY_SEQUENCE, sequence);
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    return err;
+}
+
+NvsTier::Result NvsTier::Put(long id, uint32_t sequence, std::string_view data)
+{
+    if (!Accepts(data.size()))
+    {
+        return RESULT_FAILED;
+    }
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    char value[VALUE_BUF_SIZE];
+    formatKey(key, id);
+    int len = snprintf(value, sizeof(value), "%lu$", static_cast<unsigned long>(sequence));
+    memcpy(value + len, data.data(), data.size());
+    value[len + data.size()] = '\0';
+    esp_err_t err            = store(key, value, sequence);
+    if (err == ESP_ERR_NVS_NOT_ENOUGH_SPACE)
+    {
+        return RESULT_FULL;
+    }
+    return (err == ESP_OK) ? RESULT_OK : RESULT_FAILED;
+}
+
+NvsTier::Result NvsTier::Remove(long id, uint32_t sequence, uint32_t &purged)
+{
+    if (!open)
+    {
+        return RESULT_FAILED;
+    }
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    char value[VALUE_BUF_SIZE];
+    formatKey(key, id);
+    snprintf(value, sizeof(value), "%lux", static_cast<unsigned long>(sequence));
+    esp_err_t err = store(key, value, sequence);
+    if (err != ESP_OK)
+    {
+        return (err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) ? RESULT_FULL : RESULT_FAILED;
+    }
+
+    uint32_t previous = purged;
+    for (const Entry &entry : List(0, true))
+    {
+        if (entry.deleted && entry.sequence + CONFIG_APP_STORAGE_TOMBSTONE_HORIZON < sequence && Erase(entry.id))
+        {
+            purged = std::max(purged, entry.sequence);
+        }
+    }
+    if (purged != previous)
+    {
+        nvs_set_u32(handle, KEY_PURGED, purged);
+        nvs_commit(handle);
+    }
+    return RESULT_OK;
+}
+
+bool NvsTier::Erase(long id)
+{
+    if (!open)
+    {
+        return false;
+    }
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    formatKey(key, id);
+    esp_err_t err = nvs_erase_key(handle, key);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        return true;
+    }
+    return err == ESP_OK && nvs_commit(handle) == ESP_OK;
+}
+
+bool NvsTier::Clear(uint32_t sequence, uint32_t purged)
+{
+    if (!open)
+    {
+        return true;
+    }
+    return nvs_erase_all(handle) == ESP_OK && nvs_set_u32(handle, KEY_SEQUENCE, sequence) == ESP_OK &&
+           nvs_set_u32(handle, KEY_PURGED, purged) == ESP_OK && nvs_commit(handle) == ESP_OK;
+}
+
+void NvsTier::LoadCounters(uint32_t &sequence, uint32_t &purged) const
+{
+    if (!open)
+    {
+        return;
+    }
+    nvs_get_u32(handle, KEY_SEQUENCE, &sequence);
+    nvs_get_u32(handle, KEY_PURGED, &purged);
+}
+
+std::vector<NvsTier::Entry> NvsTier::List(uint32_t since, bool tombstones) const
+{
+    std::vector<Entry> entries;
+    if (!open)
+    {
+        return entries;
+    }
+
+    nvs_iterator_t it  = nullptr;
+    esp_err_t      res = nvs_entry_find(PARTITION, NAMESPACE, NVS_TYPE_STR, &it);
+    while (res == ESP_OK)
+    {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+
+        Entry entry;
+        entry.id = static_cast<long>(strtoul(info.key, nullptr, 16));
+        if (Get(entry.id, entry) && entry.sequence > since && (tombstones || !entry.deleted))
+        {
+            entries.push_back(std::move(entry));
+        }
+        res = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.sequence < b.sequence; });
+    return entries;
+}
+
+size_t NvsTier::Count() const
+{
+    return List(0, false).size();
+}
@@ -0,0 +1,188 @@
+#ifndef NVS_TIER_HPP
+#define NVS_TIER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "nvs.h"
+#include "sdkconfig.h"
+
+/**
+ * @brief Small-value tier of the record store, kept in an NVS namespace of its own partition.
+ *
+ * NVS appends each update to its log-structured pages, so changing a small value costs one
+ * entry write instead of the data file rewrite. The `storenvs` partition keeps the tier from
+ * using up the default partition, which BT bonding and PHY calibration need; once it is full,
+ * `Put` reports it and the caller keeps the value in the data file. Each key holds `<seq>$<data>` for a record or
+ * `<seq>x` for a tombstone, where `<seq>` is the store sequence number of the mutation; the
+ * store counters are kept next to them so the tier can be updated without touching SPIFFS.
+ */
+class NvsTier
+{
+  public:
+    static constexpr size_t MAX_VALUE = CONFIG_APP_STORAGE_NVS_MAX_VALUE; ///< Largest value kept in this tier.
+
+    /**
+     * @brief Outcome of a write.
+     */
+    enum Result
+    {
+        RESULT_OK,     ///< Record stored.
+        RESULT_FULL,   ///< The partition has no room for the record.
+        RESULT_FAILED, ///< Tier closed, value too long or flash error.
+    };
+
+    /**
+     * @brief Record or tombstone held by the tier.
+     */
+    struct Entry
+    {
+        long        id;       ///< Record identifier.
+        uint32_t    sequence; ///< Sequence number of the last mutation.
+        bool        deleted;  ///< Whether this is a tombstone.
+        std::string data;     ///< Record data, empty for tombstones.
+    };
+
+    /**
+     * @brief Default constructor.
+     */
+    NvsTier();
+
+    /**
+     * @brief Initializes the partition and opens the namespace. Calling it again has no effect.
+     * @return `true` if the tier is usable, `false` otherwise.
+     */
+    bool Init();
+
+    /**
+     * @brief Checks whether a value belongs in this tier.
+     * @param len Value length.
+     * @return `true` if the tier is open and the value is small enough, `false` otherwise.
+     */
+    bool Accepts(size_t len) const;
+
+    /**
+     * @brief Reads a record or tombstone.
+     * @param id Record identifier.
+     * @param entry Output entry; only valid when `true` is returned.
+     * @return `true` if the key exists, `false` otherwise.
+     */
+    bool Get(long id, Entry &entry) const;
+
+    /**
+     * @brief Checks whether the tier holds a record or tombstone of a key, without copying it.
+     * @param id Record identifier.
+     * @param deleted Optional output, set to `true` when the key holds a tombstone.
+     * @return `true` if the key exists, `false` otherwise.
+     */
+    bool Contains(long id, bool *deleted) const;
+
+    /**
+     * @brief Reads a record without building an `Entry`.
+     * @param id Record identifier.
+     * @param data Output data, assigned within its capacity; only set for a record.
+     * @param deleted Set to `true` when the key holds a tombstone.
+     * @return `true` if the key exists, `false` otherwise.
+     */
+    bool Read(long id, std::string &data, bool *deleted) const;
+
+    /**
+     * @brief Stores a record.
+     * @param id Record identifier.
+     * @param sequence Sequence number of the mutation, also saved as the current sequence.
+     * @param data Record data, at most `MAX_VALUE` bytes.
+     * @return Outcome; on `RESULT_FULL` the previous value of the key, if any, is unchanged.
+     */
+    Result Put(long id, uint32_t sequence, std::string_view data);
+
+    /**
+     * @brief Replaces a record with a tombstone and drops tombstones past the horizon.
+     * @param id Record identifier.
+     * @param sequence Sequence number of the mutation, also saved as the current sequence.
+     * @param purged In: highest purged sequence number; out: updated with the tombstones dropped.
+     * @return Outcome; on `RESULT_FULL` the record is unchanged.
+     */
+    Result Remove(long id, uint32_t sequence, uint32_t &purged);
+
+    /**
+     * @brief Deletes a key without leaving a tombstone, when the record moves to the file tier.
+     * @param id Record identifier.
+     * @return `true` if the key is gone, `false` otherwise.
+     */
+    bool Erase(long id);
+
+    /**
+     * @brief Deletes every record and tombstone and saves the counters.
+     * @param sequence Current sequence number.
+     * @param purged Highest purged sequence number.
+     * @return `true` on success, `false` otherwise.
+     */
+    bool Clear(uint32_t sequence, uint32_t purged);
+
+    /**
+     * @brief Reads the saved counters.
+     * @param sequence Output current sequence number, unchanged if none is saved.
+     * @param purged Output highest purged sequence number, unchanged if none is saved.
+     */
+    void LoadCounters(uint32_t &sequence, uint32_t &purged) const;
+
+    /**
+     * @brief Lists the records and tombstones with a sequence number above a bound.
+     * @param since Lower bound, exclusive.
+     * @param tombstones Whether to include tombstones.
+     * @return Entries sorted by sequence number.
+     */
+    std::vector<Entry> List(uint32_t since, bool tombstones) const;
+
+    /**
+     * @brief Counts the records held by the tier.
+     * @return Number of records, excluding tombstones.
+     */
+    size_t Count() const;
+
+  private:
+    /**
+     * @brief Formats the NVS key of a record.
+     * @param key Destination buffer of `NVS_KEY_NAME_MAX_SIZE` bytes.
+     * @param id Record identifier.
+     */
+    static void formatKey(char *key, long id);
+
+    /**
+     * @brief Reads the stored value of a key.
+     * @param id Record identifier.
+     * @param value Destination buffer of `VALUE_BUF_SIZE` bytes.
+     * @return `true` if the key exists, `false` otherwise.
+     */
+    bool load(long id, char *value) const;
+
+    /**
+     * @brief Parses a stored value.
+     * @param value Stored value.
+     * @param entry Output entry; `id` is left unchanged.
+     * @return `true` if the value is well formed, `false` otherwise.
+     */
+    static bool parseValue(const char *value, Entry &entry);
+
+    /**
+     * @brief Writes a key and the current sequence number, then commits.
+     * @param key NVS key.
+     * @param value Stored value.
+     * @param sequence Current sequence number.
+     * @return `ESP_OK` on success, the first NVS error otherwise.
+     */
+    esp_err_t store(const char *key, const char *value, uint32_t sequence);
+
+    static constexpr const char *PARTITION      = "storenvs"; ///< NVS partition of the tier.
+    static constexpr const char *NAMESPACE      = "store";    ///< NVS namespace of the tier.
+    static constexpr const char *KEY_SEQUENCE   = "seq";      ///< Key of the current sequence number.
+    static constexpr const char *KEY_PURGED     = "purged";   ///< Key of the highest purged sequence number.
+    static constexpr size_t      VALUE_BUF_SIZE = MAX_VALUE + 16;
+
+    nvs_handle_t handle; ///< Namespace handle.
+    bool         open;   ///< Whether `handle` is valid.
+};
+
+#endif // NVS_TIER_HPP
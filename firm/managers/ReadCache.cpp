@@ -0,0 +1,126 @@
+#include "ReadCache.hpp"
+#include <cstring>
+
+ReadCache::ReadCache() : count(0), hand(0), bytes(0), hits(0), misses(0), evictions(0)
+{
+}
+
+bool ReadCache::Get(long id, uint32_t current, std::string &value)
+{
+    int index = find(id);
+    if (index >= 0 && entries[index].expiry != 0 && current >= entries[index].expiry)
+    {
+        // The storage read that follows removes the expired record.
+        remove(index);
+        index = -1;
+    }
+    if (index < 0)
+    {
+        misses++;
+        return false;
+    }
+    entries[index].referenced = true;
+    value.assign(arena + entries[index].offset, entries[index].length);
+    hits++;
+    return true;
+}
+
+void ReadCache::Put(long id, std::string_view value, uint32_t expiry)
+{
+    if (value.empty() || value.size() > MAX_VALUE || MAX_ENTRIES == 0)
+    {
+        return;
+    }
+    Invalidate(id);
+
+    while ((bytes + value.size() > BUDGET || count == MAX_ENTRIES) && count > 0)
+    {
+        if (hand >= count)
+        {
+            hand = 0;
+        }
+        if (entries[hand].referenced)
+        {
+            entries[hand].referenced = false;
+            hand++;
+            continue;
+        }
+        remove(hand);
+        evictions++;
+    }
+
+    // Inserted just behind the hand, so the new entry is the last one it examines.
+    if (hand > count)
+    {
+        hand = 0;
+    }
+    insert(hand, id, value, expiry);
+    hand++;
+}
+
+void ReadCache::Invalidate(long id)
+{
+    int index = find(id);
+    if (index >= 0)
+    {
+        remove(index);
+    }
+}
+
+void ReadCache::Clear()
+{
+    count = 0;
+    hand  = 0;
+    bytes = 0;
+}
+
+std::string ReadCache::Stats() const
+{
+    return std::to_string(hits) + "," + std::to_string(misses) + "," + std::to_string(evictions) + "," + std::to_string(count) + "," +
+           std::to_string(bytes) + "," + std::to_string(BUDGET);
+}
+
+int ReadCache::find(long id) const
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (entries[i].id == id)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void ReadCache::remove(size_t index)
+{
+    size_t offset = entries[index].offset;
+    size_t length = entries[index].length;
+    memmove(arena + offset, arena + offset + length, bytes - offset - length);
+    for (size_t i = index + 1; i < count; ++i)
+    {
+        entries[i - 1] = entries[i];
+        entries[i - 1].offset -= length;
+    }
+    count--;
+    bytes -= length;
+    if (index < hand)
+    {
+        hand--;
+    }
+}
+
+void ReadCache::insert(size_t index, long id, std::string_view value, uint32_t expiry)
+{
+    size_t offset = (index < count) ? entries[index].offset : bytes;
+    memmove(arena + offset + value.size(), arena + offset, bytes - offset);
+    memcpy(arena + offset, value.data(), value.size());
+    for (size_t i = count; i > index; --i)
+    {
+        entries[i] = entries[i - 1];
+        entries[i].offset += value.size();
+    }
+    entries[index] = {id, expiry, static_cast<uint16_t>(offset), static_cast<uint16_t>(value.size()), false};
+    count++;
+    bytes += value.size();
+}
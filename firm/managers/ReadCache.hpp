@@ -0,0 +1,118 @@
+#ifndef READ_CACHE_HPP
+#define READ_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "sdkconfig.h"
+
+/**
+ * @brief RAM cache of recently read values of the data file.
+ *
+ * A read of the data file opens it and scans it line by line, and may decompress the record, so
+ * keys read over and over are kept here as plain values. The values are packed in clock order
+ * into a fixed arena of `BUDGET` bytes, next to a table of at most `MAX_ENTRIES` entries, so the
+ * cache never uses the heap; an insertion or removal moves the values behind it. Entries are
+ * replaced with the CLOCK policy: a hit sets the entry's reference bit, and the eviction hand
+ * clears set bits and evicts the first entry found without one. New entries start without the
+ * bit, so a single pass over many keys replaces other such entries instead of the hot ones.
+ * Values larger than a quarter of the budget are not cached.
+ *
+ * The owner must call `Invalidate` or `Clear` whenever a cached value may change.
+ */
+class ReadCache
+{
+  public:
+    static constexpr size_t BUDGET      = CONFIG_APP_STORAGE_CACHE_SIZE; ///< Bytes of values held, 0 to disable.
+    static constexpr size_t MAX_ENTRIES = BUDGET / 32;                   ///< Entries held; shorter values mostly live in the NVS tier.
+
+    /**
+     * @brief Default constructor.
+     */
+    ReadCache();
+
+    /**
+     * @brief Looks up a value.
+     * @param id Record identifier.
+     * @param current Current time in seconds, to drop an expired entry.
+     * @param value Output value, assigned within its capacity; only set when `true` is returned.
+     * @return `true` on a hit.
+     */
+    bool Get(long id, uint32_t current, std::string &value);
+
+    /**
+     * @brief Adds a value read from storage, evicting entries to make room.
+     * @param id Record identifier.
+     * @param value Value to cache.
+     * @param expiry Expiry time of the record in seconds, 0 if it does not expire.
+     */
+    void Put(long id, std::string_view value, uint32_t expiry);
+
+    /**
+     * @brief Drops the entry of a key, if any.
+     * @param id Record identifier.
+     */
+    void Invalidate(long id);
+
+    /**
+     * @brief Drops every entry.
+     */
+    void Clear();
+
+    /**
+     * @brief Describes the cache counters since boot.
+     * @return `<hits>,<misses>,<evictions>,<entries>,<bytes>,<budget>`.
+     */
+    std::string Stats() const;
+
+  private:
+    static constexpr size_t MAX_VALUE = BUDGET / 4; ///< Largest value cached.
+
+    static_assert(BUDGET <= UINT16_MAX + 1, "Arena offsets are 16 bits wide");
+
+    /**
+     * @brief Cached value.
+     */
+    struct Entry
+    {
+        long     id;         ///< Record identifier.
+        uint32_t expiry;     ///< Expiry time in seconds, 0 if none.
+        uint16_t offset;     ///< Start of the value in `arena`.
+        uint16_t length;     ///< Length of the value.
+        bool     referenced; ///< Set by a hit, cleared as the hand passes.
+    };
+
+    /**
+     * @brief Finds the entry of a key.
+     * @param id Record identifier.
+     * @return Index in `entries`, or -1 if not cached.
+     */
+    int find(long id) const;
+
+    /**
+     * @brief Removes an entry, keeping the hand on the entry that followed it.
+     * @param index Index in `entries`.
+     */
+    void remove(size_t index);
+
+    /**
+     * @brief Inserts an entry, moving the entries and values from its position back.
+     * @param index Position in `entries`, at most `count`.
+     * @param id Record identifier.
+     * @param value Value to cache.
+     * @param expiry Expiry time of the record in seconds, 0 if it does not expire.
+     */
+    void insert(size_t index, long id, std::string_view value, uint32_t expiry);
+
+    Entry    entries[MAX_ENTRIES > 0 ? MAX_ENTRIES : 1]; ///< Entries in clock order.
+    char     arena[BUDGET > 0 ? BUDGET : 1];             ///< Values, in the order of `entries`.
+    size_t   count;                                      ///< Entries in use.
+    size_t   hand;                                       ///< Next entry the eviction hand examines.
+    size_t   bytes;                                      ///< Bytes of `arena` in use.
+    uint32_t hits;                                       ///< Lookups served from the cache.
+    uint32_t misses;                                     ///< Lookups that went to storage.
+    uint32_t evictions;                                  ///< Entries evicted to make room.
+};
+
+#endif // READ_CACHE_HPP
@@ -0,0 +1,192 @@
+#include "RecordCodec.hpp"
+#include <cstring>
+
+static inline uint32_t read32(const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void RecordCodec::putLength(std::string &out, size_t len)
+{
+    while (len >= 255)
+    {
+        out.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    out.push_back(static_cast<char>(len));
+}
+
+void RecordCodec::putSequence(std::string &out, const char *literals, size_t literalLen, size_t offset, size_t matchLen)
+{
+    size_t  extraMatch = (matchLen >= MIN_MATCH) ? matchLen - MIN_MATCH : 0;
+    uint8_t token      = static_cast<uint8_t>(((literalLen < 15 ? literalLen : 15) << 4) | (extraMatch < 15 ? extraMatch : 15));
+    out.push_back(static_cast<char>(token));
+    if (literalLen >= 15)
+    {
+        putLength(out, literalLen - 15);
+    }
+    out.append(literals, literalLen);
+    if (matchLen == 0)
+    {
+        return;
+    }
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (extraMatch >= 15)
+    {
+        putLength(out, extraMatch - 15);
+    }
+}
+
+bool RecordCodec::Compress(std::string_view in, std::string &out, Workspace &work)
+{
+    size_t n = in.size();
+    if (n < MIN_VALUE_LEN || n > MAX_VALUE_LEN)
+    {
+        return false;
+    }
+
+    const char  *src    = in.data();
+    uint16_t    *table  = work.table;
+    std::string &packed = work.packed;
+    memset(work.table, 0, sizeof(work.table));
+    packed.clear();
+    packed.reserve(n);
+
+    size_t anchor = 0;
+    size_t pos    = 0;
+    while (pos + MIN_MATCH <= n)
+    {
+        uint32_t sample = read32(src + pos);
+        size_t   hash   = (sample * 2654435761u) >> (32 - HASH_BITS);
+        size_t   ref    = table[hash];
+        table[hash]     = static_cast<uint16_t>(pos + 1);
+
+        if (ref == 0 || pos - (ref - 1) > MAX_OFFSET || read32(src + ref - 1) != sample)
+        {
+            pos++;
+            continue;
+        }
+        ref--;
+
+        size_t len = MIN_MATCH;
+        while (pos + len < n && src[ref + len] == src[pos + len])
+        {
+            len++;
+        }
+        putSequence(packed, src + anchor, pos - anchor, pos - ref, len);
+        pos += len;
+        anchor = pos;
+        if (packed.size() >= n)
+        {
+            return false;
+        }
+    }
+    putSequence(packed, src + anchor, n - anchor, 0, 0);
+
+    out.clear();
+    out.reserve(packed.size() + packed.size() / 64);
+    for (char c : packed)
+    {
+        uint8_t b = static_cast<uint8_t>(c);
+        if (b == 0 || b == '\n' || b == ESCAPE)
+        {
+            out.push_back(static_cast<char>(ESCAPE));
+            b ^= ESCAPE_XOR;
+        }
+        out.push_back(static_cast<char>(b));
+        if (out.size() >= n)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RecordCodec::Decompress(const char *in, size_t len, std::string &out, Workspace &work)
+{
+    std::string &packed = work.packed;
+    packed.clear();
+    packed.reserve(len);
+    for (size_t i = 0; i < len; ++i)
+    {
+        uint8_t b = static_cast<uint8_t>(in[i]);
+        if (b == ESCAPE)
+        {
+            if (++i == len)
+            {
+                return false;
+            }
+            b = static_cast<uint8_t>(in[i]) ^ ESCAPE_XOR;
+        }
+        packed.push_back(static_cast<char>(b));
+    }
+
+    const uint8_t *p   = reinterpret_cast<const uint8_t *>(packed.data());
+    const uint8_t *end = p + packed.size();
+    out.clear();
+    out.reserve(packed.size() * 2);
+
+    while (p < end)
+    {
+        uint8_t token      = *p++;
+        size_t  literalLen = token >> 4;
+        if (literalLen == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (p == end)
+                {
+                    return false;
+                }
+                b = *p++;
+                literalLen += b;
+            } while (b == 255);
+        }
+        if (static_cast<size_t>(end - p) < literalLen)
+        {
+            return false;
+        }
+        out.append(reinterpret_cast<const char *>(p), literalLen);
+        p += literalLen;
+        if (p == end)
+        {
+            break;
+        }
+
+        if (end - p < 2)
+        {
+            return false;
+        }
+        size_t offset = p[0] | (p[1] << 8);
+        p += 2;
+        size_t matchLen = (token & 0x0F) + MIN_MATCH;
+        if ((token & 0x0F) == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (p == end)
+                {
+                    return false;
+                }
+                b = *p++;
+                matchLen += b;
+            } while (b == 255);
+        }
+        if (offset == 0 || offset > out.size() || out.size() + matchLen > MAX_VALUE_LEN)
+        {
+            return false;
+        }
+        // Byte by byte, since a match may overlap the bytes it produces.
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < matchLen; ++i)
+        {
+            out.push_back(out[from + i]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef RECORD_CODEC_HPP
+#define RECORD_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Compresses record values for the line-oriented data file.
+ *
+ * Values are compressed with a byte-oriented LZ77 codec in the LZ4 block layout: each
+ * sequence is a token (literal length in the high nibble, match length minus 4 in the low
+ * nibble, 15 meaning "extended by 255-terminated bytes"), the literals, and a two-byte
+ * little-endian match offset. The last sequence carries literals only.
+ *
+ * The compressed bytes are then escaped so they contain no NUL or newline and can be
+ * stored and read back with `fputs`/`fgets` like plain records.
+ */
+class RecordCodec
+{
+  public:
+    static constexpr size_t MIN_VALUE_LEN = 32;    ///< Shorter values are never compressed.
+    static constexpr size_t MAX_VALUE_LEN = 65535; ///< Longer values are never compressed.
+
+    static constexpr size_t HASH_BITS = 8; ///< Match finder size.
+
+    /**
+     * @brief Scratch space of the codec, kept by the caller so its capacity is reused.
+     *
+     * The match table is part of it, so compressing takes no stack beyond a few locals; callers
+     * keep one workspace per task or guard a shared one.
+     */
+    struct Workspace
+    {
+        std::string packed;                ///< Sequences before escaping or after unescaping.
+        uint16_t    table[1 << HASH_BITS]; ///< Position + 1 of the last occurrence of each hash, 0 when unused.
+    };
+
+    /**
+     * @brief Compresses and escapes a value.
+     * @param in Value to compress.
+     * @param out Encoded value; only valid when `true` is returned.
+     * @param work Scratch space; once its capacity covers the value, nothing is allocated.
+     * @return `true` if the encoded value is shorter than `in`, `false` otherwise.
+     */
+    static bool Compress(std::string_view in, std::string &out, Workspace &work);
+
+    /**
+     * @brief Unescapes and decompresses a value produced by `Compress`.
+     * @param in Encoded value.
+     * @param len Length of the encoded value.
+     * @param out Decompressed value.
+     * @param work Scratch space; once its capacity covers the value, nothing is allocated.
+     * @return `true` on success, `false` if the input is corrupt.
+     */
+    static bool Decompress(const char *in, size_t len, std::string &out, Workspace &work);
+
+  private:
+    static constexpr size_t  MIN_MATCH  = 4;     ///< Shortest match encoded.
+    static constexpr size_t  MAX_OFFSET = 65535; ///< Farthest match distance.
+    static constexpr uint8_t ESCAPE     = 0x7F;  ///< Escape byte; followed by the escaped byte XOR `ESCAPE_XOR`.
+    static constexpr uint8_t ESCAPE_XOR = 0x40;  ///< Maps NUL, newline and `ESCAPE` to printable bytes.
+
+    /**
+     * @brief Appends a length in the extended 255-terminated form.
+     * @param out Destination.
+     * @param len Length remaining after the token nibble.
+     */
+    static void putLength(std::string &out, size_t len);
+
+    /**
+     * @brief Appends one sequence.
+     * @param out Destination.
+     * @param literals First literal byte.
+     * @param literalLen Number of literals.
+     * @param offset Match distance, ignored for the last sequence.
+     * @param matchLen Match length, or 0 for the last sequence.
+     */
+    static void putSequence(std::string &out, const char *literals, size_t literalLen, size_t offset, size_t matchLen);
+};
+
+#endif // RECORD_CODEC_HPP
@@ -0,0 +1,49 @@
+#include "SystemEvents.hpp"
+
+EventGroupHandle_t SystemEvents::group        = nullptr;
+StaticEventGroup_t SystemEvents::group_buffer = {};
+
+bool SystemEvents::Init()
+{
+    if (group == nullptr)
+    {
+        group = xEventGroupCreateStatic(&group_buffer);
+    }
+    return group != nullptr;
+}
+
+void SystemEvents::SetState(EventBits_t bits, bool active)
+{
+    if (group == nullptr)
+    {
+        return;
+    }
+
+    EventBits_t current = xEventGroupGetBits(group) & bits;
+    if (active && current != bits)
+    {
+        xEventGroupSetBits(group, bits | EVT_STATE_CHANGED);
+    }
+    else if (!active && current != 0)
+    {
+        xEventGroupClearBits(group, bits);
+        xEventGroupSetBits(group, EVT_STATE_CHANGED);
+    }
+}
+
+void SystemEvents::Signal(EventBits_t bits)
+{
+    if (group != nullptr)
+    {
+        xEventGroupSetBits(group, bits);
+    }
+}
+
+EventBits_t SystemEvents::Wait(TickType_t timeout)
+{
+    if (group == nullptr)
+    {
+        return 0;
+    }
+    return xEventGroupWaitBits(group, EVT_COMMAND | EVT_STATE_CHANGED, pdTRUE, pdFALSE, timeout);
+}
@@ -0,0 +1,52 @@
+#ifndef SYSTEM_EVENTS_HPP
+#define SYSTEM_EVENTS_HPP
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/**
+ * @brief System-wide state and event flags shared between subsystems and the supervisor.
+ *
+ * State bits are levels that stay set while the condition holds. Changing one of them,
+ * or signalling an event bit, wakes the supervisor waiting in `Wait`.
+ */
+class SystemEvents
+{
+  public:
+    static constexpr EventBits_t STATE_BLE_CONNECTED = (1 << 0); ///< At least one BLE client is connected.
+    static constexpr EventBits_t STATE_STORAGE_ERROR = (1 << 1); ///< The last storage operation failed.
+    static constexpr EventBits_t EVT_COMMAND         = (1 << 2); ///< A command was processed.
+    static constexpr EventBits_t EVT_STATE_CHANGED   = (1 << 3); ///< A state bit changed.
+
+    /**
+     * @brief Creates the event group. Must run before any other call.
+     * @return `true` if the event group is available, `false` otherwise.
+     */
+    static bool Init();
+
+    /**
+     * @brief Sets or clears a state bit and wakes the supervisor if it changed.
+     * @param bits State bits to update.
+     * @param active `true` to set the bits, `false` to clear them.
+     */
+    static void SetState(EventBits_t bits, bool active);
+
+    /**
+     * @brief Signals an event bit.
+     * @param bits Event bits to set.
+     */
+    static void Signal(EventBits_t bits);
+
+    /**
+     * @brief Waits for a state change or an event.
+     * @param timeout Maximum time to wait.
+     * @return Event group bits when the wait ended; event bits are cleared on exit.
+     */
+    static EventBits_t Wait(TickType_t timeout);
+
+  private:
+    static EventGroupHandle_t group;        ///< Event group holding the bits.
+    static StaticEventGroup_t group_buffer; ///< Storage for `group`.
+};
+
+#endif // SYSTEM_EVENTS_HPP
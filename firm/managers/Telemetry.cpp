@@ -0,0 +1,213 @@
+#include "Telemetry.hpp"
+#include "esp_heap_caps.h"
+#include <cstring>
+
+Telemetry::Telemetry() :
+    tasks{}, status{}, history{}, history_head(0), history_count(0), total_runtime(0), min_free_heap(UINT32_MAX), max_fragmentation(0),
+    timer(nullptr), mutex(nullptr)
+{
+    // Created here so that concurrent Init calls, one per transport, are serialized by it.
+    mutex = xSemaphoreCreateMutexStatic(&mutex_buffer);
+}
+
+bool Telemetry::Init()
+{
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return false;
+    }
+
+    bool running = timer != nullptr;
+    if (!running)
+    {
+        esp_timer_create_args_t args = {};
+        args.callback                = SampleStatic;
+        args.arg                     = this;
+        args.dispatch_method         = ESP_TIMER_TASK;
+        args.name                    = "telemetry";
+
+        esp_timer_handle_t created = nullptr;
+        if (esp_timer_create(&args, &created) == ESP_OK)
+        {
+            if (esp_timer_start_periodic(created, SAMPLE_PERIOD_US) == ESP_OK)
+            {
+                timer   = created;
+                running = true;
+            }
+            else
+            {
+                esp_timer_delete(created);
+            }
+        }
+    }
+
+    xSemaphoreGive(mutex);
+    if (running)
+    {
+        // The first sample runs now instead of one period later.
+        Sample();
+    }
+    return running;
+}
+
+void Telemetry::SampleStatic(void *arg)
+{
+    static_cast<Telemetry *>(arg)->Sample();
+}
+
+void Telemetry::Sample()
+{
+    uint32_t    runtime = 0;
+    UBaseType_t count   = uxTaskGetSystemState(status, MAX_TASKS, &runtime);
+
+    uint32_t free     = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t largest  = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    uint8_t  fragment = (free > 0) ? 100 - static_cast<uint8_t>((static_cast<uint64_t>(largest) * 100) / free) : 0;
+
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+
+    // Run-time counters are per core, so a task busy on one core of two reports 50%.
+    uint64_t elapsed = static_cast<uint64_t>(runtime - total_runtime) * portNUM_PROCESSORS;
+    total_runtime    = runtime;
+
+    for (size_t i = 0; i < MAX_TASKS; ++i)
+    {
+        tasks[i].seen = false;
+    }
+
+    for (UBaseType_t i = 0; i < count; ++i)
+    {
+        TaskStats *task = findTask(status[i]);
+        if (task == nullptr)
+        {
+            continue;
+        }
+
+        uint32_t delta    = status[i].ulRunTimeCounter - task->runtime;
+        task->runtime     = status[i].ulRunTimeCounter;
+        task->cpu_percent = (elapsed > 0) ? static_cast<uint8_t>((static_cast<uint64_t>(delta) * 100) / elapsed) : 0;
+        if (task->cpu_percent > task->cpu_percent_max)
+        {
+            task->cpu_percent_max = task->cpu_percent;
+        }
+        if (status[i].usStackHighWaterMark < task->min_stack_free)
+        {
+            task->min_stack_free = status[i].usStackHighWaterMark;
+        }
+        BaseType_t core = xTaskGetCoreID(status[i].xHandle);
+        task->priority  = status[i].uxCurrentPriority;
+        task->core      = (core == tskNO_AFFINITY) ? -1 : core;
+        task->seen      = true;
+    }
+
+    // Release the slots of deleted tasks.
+    for (size_t i = 0; i < MAX_TASKS; ++i)
+    {
+        if (!tasks[i].seen)
+        {
+            tasks[i].name[0] = '\0';
+        }
+    }
+
+    if (free < min_free_heap)
+    {
+        min_free_heap = free;
+    }
+    if (fragment > max_fragmentation)
+    {
+        max_fragmentation = fragment;
+    }
+
+    history[history_head] = {static_cast<uint32_t>(esp_timer_get_time() / 1000000), free, largest};
+    history_head          = (history_head + 1) % HISTORY_LEN;
+    if (history_count < HISTORY_LEN)
+    {
+        history_count++;
+    }
+
+    xSemaphoreGive(mutex);
+}
+
+Telemetry::TaskStats *Telemetry::findTask(const TaskStatus_t &task)
+{
+    TaskStats *empty = nullptr;
+    for (size_t i = 0; i < MAX_TASKS; ++i)
+    {
+        if (tasks[i].name[0] == '\0')
+        {
+            if (empty == nullptr)
+            {
+                empty = &tasks[i];
+            }
+            continue;
+        }
+        if (strncmp(tasks[i].name, task.pcTaskName, sizeof(tasks[i].name)) == 0)
+        {
+            return &tasks[i];
+        }
+    }
+
+    if (empty != nullptr)
+    {
+        // A new task starts measuring CPU share from the next sample.
+        *empty = {};
+        strncpy(empty->name, task.pcTaskName, sizeof(empty->name) - 1);
+        empty->runtime        = task.ulRunTimeCounter;
+        empty->min_stack_free = UINT32_MAX;
+    }
+    return empty;
+}
+
+std::string Telemetry::Report() const
+{
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return "";
+    }
+
+    uint32_t    free    = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t    largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    uint8_t     frag    = (free > 0) ? 100 - static_cast<uint8_t>((static_cast<uint64_t>(largest) * 100) / free) : 0;
+    std::string result  = "heap," + std::to_string(free) + "," + std::to_string(min_free_heap) + "," + std::to_string(largest) + "," +
+                         std::to_string(frag) + "," + std::to_string(max_fragmentation);
+
+    for (size_t i = 0; i < MAX_TASKS; ++i)
+    {
+        const TaskStats &task = tasks[i];
+        if (task.name[0] == '\0')
+        {
+            continue;
+        }
+        result += "\n" + std::string(task.name) + "," + std::to_string(task.core) + "," + std::to_string(task.priority) + "," +
+                  std::to_string(task.min_stack_free) + "," + std::to_string(task.cpu_percent) + "," + std::to_string(task.cpu_percent_max);
+    }
+
+    xSemaphoreGive(mutex);
+    return result;
+}
+
+std::string Telemetry::History() const
+{
+    if (mutex == nullptr || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+    {
+        return "";
+    }
+
+    std::string result;
+    size_t      start = (history_head + HISTORY_LEN - history_count) % HISTORY_LEN;
+    for (size_t i = 0; i < history_count; ++i)
+    {
+        const HeapSample &sample = history[(start + i) % HISTORY_LEN];
+        if (!result.empty())
+        {
+            result += "\n";
+        }
+        result += std::to_string(sample.uptime_s) + "," + std::to_string(sample.free) + "," + std::to_string(sample.largest);
+    }
+
+    xSemaphoreGive(mutex);
+    return result;
+}
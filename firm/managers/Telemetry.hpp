@@ -0,0 +1,107 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+/**
+ * @brief Periodically samples task stacks, CPU share and heap usage.
+ *
+ * Sampling runs from an `esp_timer` callback using the FreeRTOS run-time statistics,
+ * so no extra task is needed. Per-task extremes and a short heap history are kept in
+ * fixed-size buffers.
+ */
+class Telemetry
+{
+  public:
+    static constexpr size_t   MAX_TASKS        = 24;      ///< Maximum number of tasks tracked.
+    static constexpr size_t   HISTORY_LEN      = 16;      ///< Number of heap samples kept.
+    static constexpr uint64_t SAMPLE_PERIOD_US = 5000000; ///< Sampling period.
+
+    /**
+     * @brief Default constructor.
+     */
+    Telemetry();
+
+    /**
+     * @brief Starts periodic sampling. Calling it again, from any task, has no effect.
+     * @return `true` if sampling is running, `false` otherwise.
+     */
+    bool Init();
+
+    /**
+     * @brief Describes the current heap and task statistics.
+     * @return A `heap,<free>,<min_free>,<largest>,<frag%>,<max_frag%>` line followed by one
+     *         `<name>,<core>,<priority>,<min_stack_free>,<cpu%>,<max_cpu%>` line per task.
+     */
+    std::string Report() const;
+
+    /**
+     * @brief Describes the heap history, oldest first.
+     * @return One `<uptime_s>,<free>,<largest>` line per sample.
+     */
+    std::string History() const;
+
+  private:
+    /**
+     * @brief Per-task statistics.
+     */
+    struct TaskStats
+    {
+        char     name[configMAX_TASK_NAME_LEN]; ///< Task name.
+        uint32_t runtime;                       ///< Run-time counter at the last sample.
+        uint32_t min_stack_free;                ///< Lowest stack high-water mark seen, in bytes.
+        uint8_t  cpu_percent;                   ///< CPU share over the last period.
+        uint8_t  cpu_percent_max;               ///< Highest CPU share seen.
+        uint8_t  priority;                      ///< Current priority.
+        int8_t   core;                          ///< Core affinity, -1 when unpinned.
+        bool     seen;                          ///< Whether the task existed at the last sample.
+    };
+
+    /**
+     * @brief Heap sample.
+     */
+    struct HeapSample
+    {
+        uint32_t uptime_s; ///< Seconds since boot.
+        uint32_t free;     ///< Free heap bytes.
+        uint32_t largest;  ///< Largest free block.
+    };
+
+    /**
+     * @brief Timer callback.
+     * @param arg Pointer to the Telemetry instance.
+     */
+    static void SampleStatic(void *arg);
+
+    /**
+     * @brief Takes one sample.
+     */
+    void Sample();
+
+    /**
+     * @brief Finds or allocates the statistics slot of a task.
+     * @param task Current status of the task.
+     * @return Slot pointer, or `nullptr` if the table is full.
+     */
+    TaskStats *findTask(const TaskStatus_t &task);
+
+    TaskStats          tasks[MAX_TASKS];     ///< Statistics of each task.
+    TaskStatus_t       status[MAX_TASKS];    ///< Scratch buffer for `uxTaskGetSystemState`.
+    HeapSample         history[HISTORY_LEN]; ///< Heap history ring buffer.
+    size_t             history_head;         ///< Next history slot to write.
+    size_t             history_count;        ///< Number of valid history samples.
+    uint32_t           total_runtime;        ///< Total run-time counter at the last sample.
+    uint32_t           min_free_heap;        ///< Lowest free heap seen.
+    uint8_t            max_fragmentation;    ///< Highest heap fragmentation seen, in percent.
+    esp_timer_handle_t timer;                ///< Sampling timer.
+    SemaphoreHandle_t  mutex;                ///< Protects the statistics.
+    StaticSemaphore_t  mutex_buffer;         ///< Storage for `mutex`.
+};
+
+#endif // TELEMETRY_HPP
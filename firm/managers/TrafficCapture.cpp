@@ -0,0 +1,118 @@
+#include "TrafficCapture.hpp"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cstring>
+
+TrafficCapture::TrafficCapture() : buffer{0}, head(0), tail(0), used(0), records(0), dropped(0), enabled(false), lock(portMUX_INITIALIZER_UNLOCKED)
+{
+}
+
+void TrafficCapture::SetEnabled(bool enable)
+{
+    portENTER_CRITICAL(&lock);
+    enabled = enable;
+    portEXIT_CRITICAL(&lock);
+}
+
+void TrafficCapture::Record(uint8_t transport, uint16_t session, bool response, const std::string &payload)
+{
+    Record(transport, session, response, payload.data(), payload.size());
+}
+
+void TrafficCapture::Record(uint8_t transport, uint16_t session, bool response, const char *payload, size_t size)
+{
+    uint16_t len       = std::min(size, MAX_PAYLOAD);
+    uint64_t timestamp = static_cast<uint64_t>(esp_timer_get_time());
+    uint8_t  header[HEADER_SIZE];
+
+    for (int i = 0; i < 8; ++i)
+    {
+        header[i] = (timestamp >> (8 * i)) & 0xFF;
+    }
+    header[8]  = (transport & ~FLAG_RESPONSE) | (response ? FLAG_RESPONSE : 0);
+    header[9]  = session & 0xFF;
+    header[10] = session >> 8;
+    header[11] = len & 0xFF;
+    header[12] = len >> 8;
+
+    portENTER_CRITICAL(&lock);
+    if (enabled)
+    {
+        while (CAPACITY - used < HEADER_SIZE + len)
+        {
+            dropOldest();
+        }
+        push(header, HEADER_SIZE);
+        push(reinterpret_cast<const uint8_t *>(payload), len);
+        records++;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void TrafficCapture::Clear()
+{
+    portENTER_CRITICAL(&lock);
+    head    = 0;
+    tail    = 0;
+    used    = 0;
+    records = 0;
+    dropped = 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+std::string TrafficCapture::Export() const
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    // Reserve up front so no allocation happens inside the critical section.
+    std::string out;
+    out.reserve(CAPACITY * 2);
+
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < used; ++i)
+    {
+        uint8_t byte = peek(i);
+        out.push_back(hex[byte >> 4]);
+        out.push_back(hex[byte & 0x0F]);
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return out;
+}
+
+std::string TrafficCapture::Status() const
+{
+    portENTER_CRITICAL(&lock);
+    bool     isEnabled    = enabled;
+    uint32_t recordCount  = records;
+    size_t   bytesUsed    = used;
+    uint32_t droppedCount = dropped;
+    portEXIT_CRITICAL(&lock);
+
+    return std::to_string(isEnabled ? 1 : 0) + "," + std::to_string(recordCount) + "," + std::to_string(bytesUsed) + "," +
+           std::to_string(droppedCount);
+}
+
+void TrafficCapture::dropOldest()
+{
+    size_t len  = peek(11) | (peek(12) << 8);
+    size_t size = HEADER_SIZE + len;
+    tail        = (tail + size) % CAPACITY;
+    used -= size;
+    records--;
+    dropped++;
+}
+
+void TrafficCapture::push(const uint8_t *src, size_t len)
+{
+    size_t first = std::min(len, CAPACITY - head);
+    memcpy(buffer + head, src, first);
+    memcpy(buffer, src + first, len - first);
+    head = (head + len) % CAPACITY;
+    used += len;
+}
+
+uint8_t TrafficCapture::peek(size_t offset) const
+{
+    return buffer[(tail + offset) % CAPACITY];
+}
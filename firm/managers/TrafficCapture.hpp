@@ -0,0 +1,106 @@
+#ifndef TRAFFIC_CAPTURE_HPP
+#define TRAFFIC_CAPTURE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Records the command traffic of every transport into a binary ring buffer.
+ *
+ * Each record is a 13-byte little-endian header followed by the payload:
+ * - `uint64_t` timestamp in microseconds since boot,
+ * - `uint8_t`  flags: bits 0-6 transport, bit 7 set for a response,
+ * - `uint16_t` session (BLE connection ID, 0 for USB),
+ * - `uint16_t` payload length, followed by the payload bytes.
+ *
+ * When the buffer is full the oldest records are dropped. Payloads longer than
+ * `MAX_PAYLOAD` are truncated.
+ */
+class TrafficCapture
+{
+  public:
+    static constexpr size_t  CAPACITY      = 4096; ///< Ring buffer size in bytes.
+    static constexpr size_t  HEADER_SIZE   = 13;   ///< Size of a record header in bytes.
+    static constexpr size_t  MAX_PAYLOAD   = 256;  ///< Maximum payload bytes stored per record.
+    static constexpr uint8_t FLAG_RESPONSE = 0x80; ///< Flag marking a response record.
+
+    /**
+     * @brief Default constructor.
+     */
+    TrafficCapture();
+
+    /**
+     * @brief Enables or disables recording.
+     * @param enable `true` to record new traffic.
+     */
+    void SetEnabled(bool enable);
+
+    /**
+     * @brief Records one request or response.
+     * @param transport Transport the traffic went through.
+     * @param session Session within the transport.
+     * @param response `true` for a response, `false` for a request.
+     * @param payload Command or response text.
+     */
+    void Record(uint8_t transport, uint16_t session, bool response, const std::string &payload);
+
+    /**
+     * @brief Records one request or response held outside a string, such as a mapped value.
+     * @param transport Transport the traffic went through.
+     * @param session Session within the transport.
+     * @param response `true` for a response, `false` for a request.
+     * @param payload First byte of the payload.
+     * @param size Payload length.
+     */
+    void Record(uint8_t transport, uint16_t session, bool response, const char *payload, size_t size);
+
+    /**
+     * @brief Drops every recorded entry.
+     */
+    void Clear();
+
+    /**
+     * @brief Exports the recorded entries, oldest first.
+     * @return Raw ring buffer contents encoded as uppercase hexadecimal.
+     */
+    std::string Export() const;
+
+    /**
+     * @brief Describes the capture state.
+     * @return `<enabled>,<records>,<bytes>,<dropped>`.
+     */
+    std::string Status() const;
+
+  private:
+    /**
+     * @brief Drops the oldest record.
+     */
+    void dropOldest();
+
+    /**
+     * @brief Copies bytes into the ring buffer at the head.
+     * @param src Source bytes.
+     * @param len Number of bytes to copy.
+     */
+    void push(const uint8_t *src, size_t len);
+
+    /**
+     * @brief Reads a byte at a logical offset from the tail.
+     * @param offset Offset from the tail.
+     * @return The byte at that offset.
+     */
+    uint8_t peek(size_t offset) const;
+
+    uint8_t              buffer[CAPACITY]; ///< Ring buffer storage.
+    size_t               head;             ///< Next write position.
+    size_t               tail;             ///< Position of the oldest record.
+    size_t               used;             ///< Bytes currently in use.
+    uint32_t             records;          ///< Records currently in the buffer.
+    uint32_t             dropped;          ///< Records dropped to make room.
+    bool                 enabled;          ///< Whether new traffic is recorded.
+    mutable portMUX_TYPE lock;             ///< Protects the buffer across tasks and cores.
+};
+
+#endif // TRAFFIC_CAPTURE_HPP
@@ -1,6 +0,0 @@
-#ifndef BLINK_TASK_HPP
-#define BLINK_TASK_HPP
-
-void BlinkTaskCreate(void);
-
-#endif // BLINK_TASK_HPP
@@ -0,0 +1,25 @@
+#include "LogTask.hpp"
+#include "TaskConfig.hpp"
+#include "Logger.hpp"
+
+static void LogTask(void *param);
+
+void LogTaskCreate()
+{
+    TaskCreate(TASK_LOG, LogTask, NULL, NULL);
+}
+
+static void LogTask(void *)
+{
+    if (!Logger::Init(xTaskGetCurrentTaskHandle()))
+    {
+        vTaskDelete(NULL);
+    }
+
+    while (true)
+    {
+        // Entries logged before Init() are drained on the first pass.
+        Logger::Drain();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
@@ -0,0 +1,9 @@
+#ifndef LOG_TASK_HPP
+#define LOG_TASK_HPP
+
+/**
+ * @brief Creates Log Task, which drains the deferred log buffer
+ */
+void LogTaskCreate(void);
+
+#endif // LOG_TASK_HPP
@@ -2,26 +2,51 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <string.h>
-#include "BlinkTask.hpp"
 #include "UsbTask.hpp"
+#include "LogTask.hpp"
 #include "BleManager.hpp"
+#include "LedManager.hpp"
+#include "SystemEvents.hpp"
+#include "BootProfile.hpp"
 
-static void MainTask(void *param);
+#define LED_PIN GPIO_NUM_2
 
+/// Time the LED keeps the busy pattern after the last command.
+static const TickType_t BUSY_HOLD_TICKS = pdMS_TO_TICKS(500);
 
-void MainTaskCreate()
-{
-    xTaskCreate(MainTask, "Main Task", 4096, NULL, 5, NULL);
-}
+static BleManager bleManager;
+static LedManager ledManager(LED_PIN);
 
-static void MainTask(void *param)
+void MainTaskRun()
 {
-    BlinkTaskCreate();
+    BootProfile::Mark(BootProfile::PHASE_APP_MAIN);
+    SystemEvents::Init();
+    ledManager.Init();
+    LogTaskCreate();
     UsbTaskCreate();
-    BleManager bleManager;
     bleManager.Init();
+
+    bool busy = false;
     while (true)
     {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        EventBits_t bits = SystemEvents::Wait(busy ? BUSY_HOLD_TICKS : portMAX_DELAY);
+        busy             = (bits & SystemEvents::EVT_COMMAND) != 0;
+
+        if (bits & SystemEvents::STATE_STORAGE_ERROR)
+        {
+            ledManager.SetPattern(LedManager::PATTERN_STORAGE_ERROR);
+        }
+        else if (busy)
+        {
+            ledManager.SetPattern(LedManager::PATTERN_BUSY);
+        }
+        else if (bits & SystemEvents::STATE_BLE_CONNECTED)
+        {
+            ledManager.SetPattern(LedManager::PATTERN_BLE_CONNECTED);
+        }
+        else
+        {
+            ledManager.SetPattern(LedManager::PATTERN_IDLE);
+        }
     }
 }
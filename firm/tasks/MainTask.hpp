@@ -1,6 +1,12 @@
 #ifndef MAIN_TASK_HPP
 #define MAIN_TASK_HPP
 
-void MainTaskCreate(void);
+/**
+ * @brief Brings the system up and runs the supervisor on the calling task. Never returns.
+ *
+ * The supervisor sleeps on the system event group and only wakes to update the status LED
+ * when a state changes or a command is processed.
+ */
+void MainTaskRun(void);
 
 #endif // MAIN_TASK_HPP
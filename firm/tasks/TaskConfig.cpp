@@ -0,0 +1,30 @@
+#include "TaskConfig.hpp"
+
+#if CONFIG_APP_STATIC_ALLOCATION
+static StackType_t  usbTaskStack[TASK_CONFIGS[TASK_USB].stack_size];
+static StaticTask_t usbTaskBuffer;
+static StackType_t  bleTaskStack[TASK_CONFIGS[TASK_BLE].stack_size];
+static StaticTask_t bleTaskBuffer;
+static StackType_t  logTaskStack[TASK_CONFIGS[TASK_LOG].stack_size];
+static StaticTask_t logTaskBuffer;
+
+/// Stack and control block of each task, indexed by `TaskId`.
+static StackType_t *const  taskStacks[TASK_COUNT]  = {usbTaskStack, bleTaskStack, logTaskStack};
+static StaticTask_t *const taskBuffers[TASK_COUNT] = {&usbTaskBuffer, &bleTaskBuffer, &logTaskBuffer};
+#endif
+
+BaseType_t TaskCreate(TaskId id, TaskFunction_t function, void *param, TaskHandle_t *handle)
+{
+    const TaskConfig &config = TASK_CONFIGS[id];
+#if CONFIG_APP_STATIC_ALLOCATION
+    TaskHandle_t created = xTaskCreateStaticPinnedToCore(function, config.name, config.stack_size, param, config.priority, taskStacks[id],
+                                                         taskBuffers[id], config.core);
+    if (handle != nullptr)
+    {
+        *handle = created;
+    }
+    return (created != nullptr) ? pdPASS : pdFAIL;
+#else
+    return xTaskCreatePinnedToCore(function, config.name, config.stack_size, param, config.priority, handle, config.core);
+#endif
+}
@@ -0,0 +1,72 @@
+#ifndef TASK_CONFIG_HPP
+#define TASK_CONFIG_HPP
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief Identifies each application task in the task table.
+ */
+enum TaskId
+{
+    TASK_USB,
+    TASK_BLE,
+    TASK_LOG,
+    TASK_COUNT
+};
+
+/**
+ * @brief Creation parameters of an application task.
+ */
+struct TaskConfig
+{
+    const char *name;       ///< Task name.
+    uint32_t    stack_size; ///< Stack size in bytes (ESP-IDF `StackType_t` is one byte).
+    UBaseType_t priority;   ///< Task priority.
+    BaseType_t  core;       ///< Core the task is pinned to, or `tskNO_AFFINITY`.
+};
+
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+/**
+ * @brief Core used for command processing and storage, away from the Bluedroid stack.
+ */
+constexpr BaseType_t APP_CORE = (CONFIG_BT_BLUEDROID_PINNED_TO_CORE == 0) ? 1 : 0;
+#else
+constexpr BaseType_t APP_CORE = 0;
+#endif
+
+/**
+ * @brief Task table, indexed by `TaskId`.
+ *
+ * The supervisor runs on the ESP-IDF main task (see `MainTaskRun`), whose stack and
+ * affinity come from `CONFIG_ESP_MAIN_TASK_*`.
+ */
+constexpr TaskConfig TASK_CONFIGS[TASK_COUNT] = {
+    {"UsbTask", 4096, 10, APP_CORE},
+    {"BleTask", 4096, 10, APP_CORE},
+    {"LogTask", 2560, 1, tskNO_AFFINITY},
+};
+
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+static_assert(TASK_CONFIGS[TASK_USB].core != CONFIG_BT_BLUEDROID_PINNED_TO_CORE, "Command processing must not share a core with Bluedroid");
+static_assert(TASK_CONFIGS[TASK_BLE].core != CONFIG_BT_BLUEDROID_PINNED_TO_CORE, "Command processing must not share a core with Bluedroid");
+static_assert(CONFIG_ESP_MAIN_TASK_AFFINITY == APP_CORE, "The supervisor runs on the main task, which must share the application core");
+#endif
+// The main task also runs `BleManager::Init` and the Bluedroid bring-up it calls; `tm` reports its
+// stack high-water mark as task "main".
+static_assert(CONFIG_ESP_MAIN_TASK_STACK_SIZE >= 4096, "The main task stack must hold BleManager::Init");
+
+/**
+ * @brief Creates an application task from its entry in the task table.
+ *
+ * With `CONFIG_APP_STATIC_ALLOCATION` the stack and control block come from static buffers.
+ * @param id Task to create.
+ * @param function Task entry point.
+ * @param param Parameter passed to the task.
+ * @param handle Optional output for the task handle.
+ * @return `pdPASS` on success, an error code otherwise.
+ */
+BaseType_t TaskCreate(TaskId id, TaskFunction_t function, void *param, TaskHandle_t *handle);
+
+#endif // TASK_CONFIG_HPP
@@ -1,12 +1,15 @@
 #include "UsbTask.hpp"
 #include "driver/uart.h"
 #include "CommandManager.hpp"
+#include "TaskConfig.hpp"
+#include "BootProfile.hpp"
+#include "Logger.hpp"
 #include <string>
 
 #define BUF_SIZE (1024)
 #define UART_NUM UART_NUM_0
 
-CommandManager commandManagerUsb;
+CommandManager commandManagerUsb(CommandManager::TRANSPORT_USB);
 
 static void UsbTask(void *param);
 
@@ -24,18 +27,18 @@ void UsbTaskCreate()
     esp_err_t err = uart_param_config(UART_NUM, &uart_config);
     if (err != ESP_OK)
     {
-        printf("Failed to configure UART parameters: %s\n", esp_err_to_name(err));
+        Logger::Log(LOG_UART_CONFIG_FAILED, static_cast<uint32_t>(err));
         return;
     }
 
-    QueueHandle_t uartQueue;
+    static QueueHandle_t uartQueue;
     err = uart_driver_install(UART_NUM, BUF_SIZE * 2, BUF_SIZE * 2, 10, &uartQueue, 0);
     if (err != ESP_OK)
     {
         return;
     }
 
-    if (xTaskCreate(UsbTask, "UsbTask", 4096, &uartQueue, 10, NULL) != pdPASS)
+    if (TaskCreate(TASK_USB, UsbTask, &uartQueue, NULL) != pdPASS)
     {
         uart_driver_delete(UART_NUM);
     }
@@ -45,21 +48,27 @@ static void UsbTask(void *param)
 {
     if (param == NULL)
     {
-        printf("Error: UART queue handle is NULL\n");
+        Logger::Log(LOG_UART_QUEUE_INVALID);
         vTaskDelete(NULL);
     }
 
     QueueHandle_t queue = *(QueueHandle_t *)param;
     if (queue == NULL)
     {
-        printf("Error: Invalid UART queue handle\n");
+        Logger::Log(LOG_UART_QUEUE_INVALID);
         vTaskDelete(NULL);
     }
 
     uart_event_t event;
     std::string  inputString;
+    std::string  response;
     uint8_t      data[BUF_SIZE];
+    bool         overflow = false;
+    // Both are reused for every line, so receiving and answering get and put commands does not reallocate.
+    inputString.reserve(BUF_SIZE);
+    response.reserve(BUF_SIZE);
     commandManagerUsb.Init();
+    BootProfile::Mark(BootProfile::PHASE_USB_READY);
 
     while (true)
     {
@@ -75,14 +84,36 @@ static void UsbTask(void *param)
                         char inChar = (char)data[i];
                         if (inChar == '\n')
                         {
-                            std::string code = commandManagerUsb.ProcessCommand(inputString);
-                            printf("%s\n", code.c_str());
+                            if (overflow)
+                            {
+                                printf("SYNTAX_ERROR\n");
+                            }
+                            else
+                            {
+                                BlobStore::View view;
+                                commandManagerUsb.ProcessCommand(inputString, response, 0, &view);
+                                if (view.Valid())
+                                {
+                                    // Written straight from the flash mapping.
+                                    fwrite(view.Data(), 1, view.Size(), stdout);
+                                    putchar('\n');
+                                }
+                                else
+                                {
+                                    printf("%s\n", response.c_str());
+                                }
+                            }
                             inputString.clear();
+                            overflow = false;
                         }
-                        else
+                        else if (inputString.size() < BUF_SIZE)
                         {
                             inputString.push_back(inChar);
                         }
+                        else
+                        {
+                            overflow = true;
+                        }
                     }
                 }
             }